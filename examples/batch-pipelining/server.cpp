@@ -15,66 +15,43 @@ public:
         // Initialize in-memory data
         initializeData();
 
-        // Register methods
-        method("authenticate", [this](const json& args) -> json
-        {
-            // Extract session token from arguments
-            std::string sessionToken;
-            if (args.is_array() && !args.empty() && args[0].is_string())
-                sessionToken = args[0];
-            else if (args.is_string())
-                sessionToken = args;
-            else
-                throw std::runtime_error("Invalid session token");
-
-            // Look up user by session token
-            auto it = users.find(sessionToken);
-            if (it == users.end())
-                throw std::runtime_error("Invalid session");
-
-            return it->second;
-        });
+        // Register methods; arguments are decoded into the parameter types.
+        method("authenticate", &UserServer::authenticate);
+        method("getUserProfile", &UserServer::getUserProfile);
+        method("getNotifications", &UserServer::getNotifications);
+    }
 
-        method("getUserProfile", [this](const json& args) -> json
-        {
-            // Extract user ID from arguments
-            std::string userId;
-            if (args.is_array() && !args.empty() && args[0].is_string())
-                userId = args[0];
-            else if (args.is_string())
-                userId = args;
-            else
-                throw std::runtime_error("Invalid user ID");
+private:
+    json authenticate(const std::string& sessionToken) const
+    {
+        // Look up user by session token
+        auto it = users.find(sessionToken);
+        if (it == users.end())
+            throw std::runtime_error("Invalid session");
 
-            // Look up profile by user ID
-            auto it = profiles.find(userId);
-            if (it == profiles.end())
-                throw std::runtime_error("No such user");
+        return it->second;
+    }
 
-            return it->second;
-        });
+    json getUserProfile(const std::string& userId) const
+    {
+        // Look up profile by user ID
+        auto it = profiles.find(userId);
+        if (it == profiles.end())
+            throw std::runtime_error("No such user");
 
-        method("getNotifications", [this](const json& args) -> json
-        {
-            // Extract user ID from arguments
-            std::string userId;
-            if (args.is_array() && !args.empty() && args[0].is_string())
-                userId = args[0];
-            else if (args.is_string())
-                userId = args;
-            else
-                throw std::runtime_error("Invalid user ID");
+        return it->second;
+    }
 
-            // Look up notifications by user ID
-            auto it = notifications.find(userId);
-            if (it == notifications.end())
-                return json::array();
+    json getNotifications(const std::string& userId) const
+    {
+        // Look up notifications by user ID
+        auto it = notifications.find(userId);
+        if (it == notifications.end())
+            return json::array();
 
-            return it->second;
-        });
+        return it->second;
     }
 
-private:
     // In-memory data stores
     std::map<std::string, json> users;
     std::map<std::string, json> profiles;
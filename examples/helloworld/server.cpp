@@ -1,6 +1,7 @@
 #include <capnwebcpp/rpc_target.h>
 #include <capnwebcpp/rpc_endpoint.h>
 #include <capnwebcpp/file_endpoint.h>
+#include <capnwebcpp/metrics_endpoint.h>
 
 using namespace capnwebcpp;
 
@@ -26,6 +27,7 @@ int main(int argc, char** argv)
         uWS::App app;
         setupRpcEndpoint(app, "/api", std::make_shared<HelloServer>());
         setupFileEndpoint(app, "/static/", path);
+        setupMetricsEndpoint(app, "/metrics");
 
         app.listen(port, [port](auto* token)
         {
@@ -89,10 +89,9 @@ int main(int argc, char** argv)
                 auto* userData = ws->getUserData();
                 try
                 {
-                    UwsWebSocketTransport<decltype(ws)> transport(ws);
                     // Update context in case of per-connection change.
                     target->setSessionContext(session.get(), userData);
-                    pumpMessage(*session, userData, transport, std::string(message));
+                    pumpMessage(*session, userData, *userData->transport, message);
                     session->processTasks();
                 }
                 catch (const std::exception& e)
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
 
 #include "capnwebcpp/rpc_session.h"
 #include "capnwebcpp/logging.h"
@@ -12,30 +13,165 @@
 namespace capnwebcpp
 {
 
-// Process a newline-delimited batch body using an accumulating transport.
-// Returns all outbound messages (responses and any server->client frames) in send order.
-inline std::vector<std::string> processBatch(RpcSession& session, RpcSessionData* sessionData, const std::string& body)
+// Pump each non-empty line of a newline-delimited batch body through the session, then drain and
+// flush the batch's releases.
+// Lines are parsed in place from `body`.
+inline void pumpBatchBody(RpcSession& session, RpcSessionData* sessionData, RpcTransport& transport,
+                          std::string_view body)
 {
-    std::vector<std::string> outbox;
-    auto transportPtr = std::make_shared<AccumTransport>(outbox);
-    if (sessionData) sessionData->transport = transportPtr;
-
-    std::istringstream stream(body);
-    std::string line;
-    while (std::getline(stream, line))
+    while (!body.empty())
     {
+        std::size_t end = body.find('\n');
+        std::string_view line = body.substr(0, end);
+        body.remove_prefix(end == std::string_view::npos ? body.size() : end + 1);
         if (!line.empty())
         {
-            debugLog(std::string("batch line: ") + line);
-            pumpMessage(session, sessionData, *transportPtr, line);
+            if (debugEnabled()) debugLog("batch line: " + std::string(line));
+            pumpMessageQueued(session, sessionData, transport, line);
             // After each message, run microtasks (simulate microtask queue).
             session.processTasks();
         }
     }
     // Drain any remaining queued tasks before returning accumulated messages.
     session.drain(sessionData);
+    // Releases for the whole batch go out once, summed per import ID.
+    flushReleases(sessionData, transport);
+}
+
+// Process a newline-delimited batch body using an accumulating transport.
+// Returns all outbound messages (responses and any server->client frames) in send order.
+inline std::vector<std::string> processBatch(RpcSession& session, RpcSessionData* sessionData, std::string_view body)
+{
+    std::vector<std::string> outbox;
+    auto transportPtr = std::make_shared<AccumTransport>(outbox, sessionData ? &sessionData->memory : nullptr);
+    if (sessionData) sessionData->transport = transportPtr;
+
+    pumpBatchBody(session, sessionData, *transportPtr, body);
     debugLog(std::string("batch done, outbox=") + std::to_string(outbox.size()));
     return outbox;
 }
 
+// --------------------------------------------------------------------------------------
+// Pooled batch sessions
+
+// All per-request state of one HTTP batch: session, tables and the accumulating transport.
+// Recycled through BatchSessionPool; clear() drops request state but keeps allocated capacity
+// (table pages, hash buckets, outbox storage).
+struct PooledBatchSession
+{
+    RpcSession session;
+    RpcSessionData data;
+    std::vector<std::string> outbox;
+    std::shared_ptr<AccumTransport> transport;
+
+    PooledBatchSession()
+        : session(nullptr), transport(std::make_shared<AccumTransport>(outbox, &data.memory))
+    {
+        data.transport = transport;
+    }
+
+    PooledBatchSession(const PooledBatchSession&) = delete;
+    PooledBatchSession& operator=(const PooledBatchSession&) = delete;
+
+    // Bind to `target`. The local target hook is kept when the target is unchanged.
+    void bind(std::shared_ptr<RpcTarget> target)
+    {
+        if (data.target != target)
+        {
+            data.target = target;
+            data.localTargetHook = makeLocalTargetHook(target);
+        }
+        session.reset(std::move(target));
+        Metrics::instance().liveSessions.add();
+    }
+
+    void clear()
+    {
+        Metrics::instance().liveSessions.sub();
+        session.reset(nullptr);
+        data.reset();
+        outbox.clear();
+    }
+
+    // Run a batch body; responses accumulate in `outbox`.
+    void run(std::string_view body)
+    {
+        pumpBatchBody(session, &data, *transport, body);
+        debugLog(std::string("batch done, outbox=") + std::to_string(outbox.size()));
+    }
+};
+
+// Per-thread free list of PooledBatchSession objects.
+class BatchSessionPool
+{
+public:
+    // Returns a pooled session to its pool when destroyed.
+    class Lease
+    {
+    public:
+        Lease(BatchSessionPool* pool, std::unique_ptr<PooledBatchSession> item)
+            : pool(pool), item(std::move(item)) {}
+        Lease(Lease&&) noexcept = default;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease()
+        {
+            if (item) pool->release(std::move(item));
+        }
+
+        PooledBatchSession* operator->() const { return item.get(); }
+        PooledBatchSession& operator*() const { return *item; }
+
+    private:
+        BatchSessionPool* pool;
+        std::unique_ptr<PooledBatchSession> item;
+    };
+
+    // Pool owned by the calling thread.
+    static BatchSessionPool& local()
+    {
+        thread_local BatchSessionPool pool;
+        return pool;
+    }
+
+    Lease acquire(std::shared_ptr<RpcTarget> target)
+    {
+        std::unique_ptr<PooledBatchSession> item;
+        if (!idle.empty())
+        {
+            item = std::move(idle.back());
+            idle.pop_back();
+        }
+        else
+        {
+            item = std::make_unique<PooledBatchSession>();
+        }
+        item->bind(std::move(target));
+        return Lease(this, std::move(item));
+    }
+
+    // Upper bound on idle sessions retained; extra sessions are freed on release.
+    void setMaxIdle(std::size_t n) { maxIdle = n; }
+    std::size_t idleCount() const { return idle.size(); }
+
+private:
+    std::vector<std::unique_ptr<PooledBatchSession>> idle;
+    std::size_t maxIdle = 16;
+
+    void release(std::unique_ptr<PooledBatchSession> item)
+    {
+        item->clear();
+        if (idle.size() < maxIdle)
+            idle.push_back(std::move(item));
+    }
+};
+
+// Process a batch body against `target` using a session from the calling thread's pool.
+inline std::vector<std::string> processBatch(std::shared_ptr<RpcTarget> target, std::string_view body)
+{
+    auto lease = BatchSessionPool::local().acquire(std::move(target));
+    lease->run(body);
+    return std::vector<std::string>(std::make_move_iterator(lease->outbox.begin()),
+                                    std::make_move_iterator(lease->outbox.end()));
+}
+
 } // namespace capnwebcpp
@@ -1,14 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "capnwebcpp/client_cache.h"
+#include "capnwebcpp/client_calls.h"
+#include "capnwebcpp/client_pipeline.h"
+
 namespace capnwebcpp
 {
 
@@ -21,6 +27,10 @@ class ClientBatchTransport
 public:
     virtual ~ClientBatchTransport() = default;
     virtual std::vector<std::string> sendBatch(const std::vector<std::string>& lines) = 0;
+
+    // True when consecutive batches reach the same server session (import IDs and stubs stay
+    // valid across batches). HTTP batches each get a fresh session.
+    virtual bool persistent() const { return false; }
 };
 
 // Adapter to a std::function for convenience.
@@ -48,56 +58,247 @@ public:
     explicit RpcClient(std::shared_ptr<ClientBatchTransport> transport)
         : transport(std::move(transport)) {}
 
-    // Call a method on the remote main target.
+    // Call a method on the remote main target. Methods with a cache policy may be served from the
+    // cache or share an identical call in flight on another thread.
     json callMethod(const std::string& method, const json& argsArray)
     {
-        int importId = allocateImportId();
-        json push = json::array({
-            "push",
-            json::array({ "pipeline", 0, json::array({ method }), argsArray.is_null() ? json::array() : argsArray })
-        });
-        json pull = json::array({ "pull", importId });
-        std::vector<std::string> batch;
-        batch.push_back(push.dump());
-        batch.push_back(pull.dump());
+        if (cache && cache->cacheable(method))
+            return cachedCall(method, argsArray);
+        Batch b(*this);
+        return b.await(b.call(method, argsArray));
+    }
 
-        auto responses = transport->sendBatch(batch);
-        return parseResultFor(importId, responses);
+    // Cache results of an idempotent main-target method; see ClientCachePolicy. Configure before
+    // calls start.
+    void setCachePolicy(const std::string& method, ClientCachePolicy policy)
+    {
+        if (!cache) cache = std::make_shared<ClientResultCache>();
+        cache->setPolicy(method, policy);
+    }
+
+    void invalidateCache(const std::string& method = std::string())
+    {
+        if (cache) cache->invalidate(method);
+    }
+
+    ClientResultCache::Stats cacheStats() const
+    {
+        return cache ? cache->stats() : ClientResultCache::Stats{};
+    }
+
+    // On persistent transports every call leaves an import the server keeps until released.
+    // Releases of finished batches ride along with the next batch; this sends those still owed
+    // right away.
+    void flushReleases()
+    {
+        if (!transport->persistent() || releases.size() == 0)
+            return;
+        transport->sendBatch(releases.take());
     }
 
     // Call a method on a previously-returned remote stub ({"$stub": exportId}).
     json callStubMethod(const json& stub, const std::string& method, const json& argsArray)
     {
-        int exportId = getStubId(stub);
-        if (exportId == 0) throw std::runtime_error("callStubMethod: not a stub");
-        int importId = allocateImportId();
-        json push = json::array({
-            "push",
-            json::array({ "pipeline", exportId, json::array({ method }), argsArray.is_null() ? json::array() : argsArray })
-        });
-        json pull = json::array({ "pull", importId });
-        std::vector<std::string> batch;
-        batch.push_back(push.dump());
-        batch.push_back(pull.dump());
-        auto responses = transport->sendBatch(batch);
-        return parseResultFor(importId, responses);
+        if (getStubId(stub) == 0) throw std::runtime_error("callStubMethod: not a stub");
+        Batch b(*this);
+        return b.await(b.callStub(stub, method, argsArray));
     }
 
     // Get a property path from a previously-returned remote stub.
     json getStubProperty(const json& stub, const json& path)
     {
-        int exportId = getStubId(stub);
-        if (exportId == 0) throw std::runtime_error("getStubProperty: not a stub");
-        int importId = allocateImportId();
-        json push = json::array({ "push", json::array({ "pipeline", exportId, path }) });
-        json pull = json::array({ "pull", importId });
-        std::vector<std::string> batch;
-        batch.push_back(push.dump());
-        batch.push_back(pull.dump());
-        auto responses = transport->sendBatch(batch);
-        return parseResultFor(importId, responses);
+        Batch b(*this);
+        return b.await(b.getStubProperty(stub, path));
     }
 
+    // Any number of calls sent with one ClientBatchTransport::sendBatch(). Calls are queued and
+    // return RpcPromise handles; results of earlier calls can be passed to later ones (promise
+    // pipelining) without a round trip. send() pulls every queued call and resolves all handles
+    // from the combined response; await() pulls only the promises it is given.
+    //
+    //   auto b = client.batch();
+    //   auto user = b.call("authenticate", json::array({ token }));
+    //   auto profile = b.call("getUserProfile", json::array({ user["id"] }));
+    //   auto notes = b.call("getNotifications", json::array({ user["id"] }));
+    //   b.send();
+    //   json p = b.result(profile);     // throws if that call was rejected
+    //
+    // On non-persistent transports (HTTP) each send is a fresh server session: import IDs restart
+    // at 1 and handles from earlier sends can no longer be used as arguments.
+    class Batch
+    {
+    public:
+        explicit Batch(RpcClient& client) : client(client) {}
+
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        // On persistent transports the batch's imports stay valid as arguments for as long as it
+        // lives; they are released with the next batch once it is gone.
+        ~Batch()
+        {
+            for (int id : imports)
+                client.releases.add(id);
+        }
+
+        // Call a method on the main target.
+        RpcPromise call(const std::string& method, const json& argsArray)
+        {
+            return push(RpcPromise().callExpression(method, argsArray));
+        }
+
+        // Call a method on the stub an earlier call returns (at the promise's path when it is
+        // narrowed). The call is rejected when the server finds no stub there.
+        RpcPromise call(const RpcPromise& target, const std::string& method, const json& argsArray)
+        {
+            return push(target.callExpression(method, argsArray));
+        }
+
+        // Call a method on a stub returned by a previous call.
+        RpcPromise callStub(const json& stub, const std::string& method, const json& argsArray)
+        {
+            int exportId = getStubId(stub);
+            if (exportId == 0) throw std::runtime_error("callStub: not a stub");
+            return call(RpcPromise(exportId), method, argsArray);
+        }
+
+        // Get a property path from a stub returned by a previous call.
+        RpcPromise getStubProperty(const json& stub, const json& path)
+        {
+            int exportId = getStubId(stub);
+            if (exportId == 0) throw std::runtime_error("getStubProperty: not a stub");
+            return push(json::array({ "pipeline", exportId, path }));
+        }
+
+        // Apply `mapper` on the server to the result of `source` (to each element when it is an
+        // array) in one call; see RpcMapper.
+        template<typename Mapper>
+        RpcPromise map(const RpcPromise& source, Mapper&& mapper)
+        {
+            return push(RpcMapper::expression(source, std::forward<Mapper>(mapper)));
+        }
+
+        // Number of calls queued since the last send.
+        std::size_t size() const { return pending.size(); }
+
+        // Pull every queued call and send the batch.
+        void send()
+        {
+            flush(pending);
+        }
+
+        // Result of a call from an earlier send(); throws std::runtime_error if the call was
+        // rejected or got no resolution.
+        json result(const RpcPromise& promise) const
+        {
+            auto it = settled.find(promise.importId());
+            if (it == settled.end())
+                throw std::runtime_error("No resolution for importId");
+            if (!it->second.error.empty())
+                throw std::runtime_error(it->second.error);
+            return promise.select(it->second.value);
+        }
+
+        // Error text of a rejected call ("Name: message"); empty if it resolved.
+        std::string error(const RpcPromise& promise) const
+        {
+            auto it = settled.find(promise.importId());
+            if (it == settled.end())
+                return "No resolution for importId";
+            return it->second.error;
+        }
+
+        // Send queued calls, pulling only `promise`, and return its result.
+        json await(const RpcPromise& promise)
+        {
+            return await(std::vector<RpcPromise>{ promise }).front();
+        }
+
+        // Send queued calls, pulling only `promises`; throws on the first rejection. Each import
+        // is pulled once; narrowed promises select their path from its result.
+        std::vector<json> await(const std::vector<RpcPromise>& promises)
+        {
+            std::vector<int> ids;
+            for (const auto& p : promises)
+            {
+                if (std::find(ids.begin(), ids.end(), p.importId()) == ids.end())
+                    ids.push_back(p.importId());
+            }
+            flush(ids);
+            std::vector<json> results;
+            results.reserve(promises.size());
+            for (const auto& p : promises)
+                results.push_back(result(p));
+            return results;
+        }
+
+    private:
+        struct Settled
+        {
+            json value;
+            std::string error;
+        };
+
+        RpcClient& client;
+        std::vector<std::string> lines;
+        std::vector<int> pending;                   // Pushed since the last send
+        std::unordered_map<int, Settled> settled;
+        std::vector<int> imports;                   // Persistent transports: released on destruction
+        int nextLocalImportId = 1;                  // Non-persistent transports: per send
+
+        RpcPromise push(const json& expression)
+        {
+            int importId;
+            if (client.transport->persistent())
+            {
+                importId = client.allocateImportId();
+                imports.push_back(importId);
+            }
+            else
+            {
+                // Each send is a new server session, so IDs restart.
+                if (lines.empty())
+                    nextLocalImportId = 1;
+                importId = nextLocalImportId++;
+            }
+            lines.push_back(json::array({ "push", expression }).dump());
+            pending.push_back(importId);
+            return RpcPromise(importId);
+        }
+
+        void flush(std::vector<int> pulls)
+        {
+            bool persistent = client.transport->persistent();
+            std::vector<std::string> batch;
+            // Releases owed by batches already gone go first; none of them is referenced here.
+            if (persistent)
+                batch = client.releases.take();
+            batch.insert(batch.end(), std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+            lines.clear();
+            for (int id : pulls)
+                batch.push_back(json::array({ "pull", id }).dump());
+            pending.clear();
+
+            auto responses = client.transport->sendBatch(batch);
+            if (!persistent)
+                settled.clear();
+            for (const auto& line : responses)
+            {
+                int importId = 0;
+                Settled s;
+                if (!parseSettled(line, importId, s.value, s.error))
+                    continue;
+                settled[importId] = std::move(s);
+            }
+        }
+    };
+
+    // Calls whose results feed later calls; see Batch.
+    using Pipeline = Batch;
+
+    Batch batch() { return Batch(*this); }
+    Pipeline pipeline() { return Batch(*this); }
+
     // Construct a stub representation from an export id.
     static json makeStub(int exportId)
     {
@@ -114,10 +315,40 @@ public:
         return isStub(v) ? v["$stub"].get<int>() : 0;
     }
 
+    // Convert a resolve payload to the client's value representation (stubs as {"$stub": id}, etc.).
+    static json decodeResult(const json& v)
+    {
+        return decodeSpecial(unwrapArrayIfNeeded(v));
+    }
+
 private:
     std::shared_ptr<ClientBatchTransport> transport;
+    std::shared_ptr<ClientResultCache> cache;
+    DeferredReleases releases;                      // Persistent transports only
     int nextImportId = 1;
 
+    json cachedCall(const std::string& method, const json& argsArray)
+    {
+        auto [done, future] = PendingCalls::makeFuture();
+        std::string key;
+        if (!cache->tryServe(method, argsArray, std::move(done), key))
+        {
+            json value;
+            std::string error;
+            try
+            {
+                Batch b(*this);
+                value = b.await(b.call(method, argsArray));
+            }
+            catch (const std::exception& e)
+            {
+                error = e.what();
+            }
+            cache->complete(key, std::move(value), std::move(error));
+        }
+        return future.get();
+    }
+
     int allocateImportId()
     {
         return nextImportId++;
@@ -170,33 +401,30 @@ private:
         return v;
     }
 
-    json parseResultFor(int importId, const std::vector<std::string>& responses)
+    // Decode a resolve/reject frame into its import ID and either the decoded value or the
+    // error text ("Name: message"); false for any other frame.
+    static bool parseSettled(const std::string& line, int& importId, json& value, std::string& error)
     {
-        for (const auto& line : responses)
+        json m = json::parse(line, nullptr, false);
+        if (!m.is_array() || m.size() < 2 || !m[0].is_string() || !m[1].is_number_integer())
+            return false;
+        const std::string& type = m[0].get_ref<const std::string&>();
+        if (type != "resolve" && type != "reject")
+            return false;
+        importId = m[1].get<int>();
+        if (type == "reject")
         {
-            json m = json::parse(line, nullptr, false);
-            if (!m.is_array() || m.size() < 2 || !m[0].is_string()) continue;
-            std::string type = m[0];
-            if ((type == "resolve" || type == "reject") && m[1].is_number_integer() && m[1] == importId)
+            error = "RPC rejected";
+            if (m.size() >= 3 && m[2].is_array() && m[2].size() >= 3)
             {
-                if (type == "reject")
-                {
-                    if (m.size() >= 3 && m[2].is_array() && m[2].size() >= 3)
-                    {
-                        std::string name = m[2][1].is_string() ? m[2][1].get<std::string>() : std::string("Error");
-                        std::string message = m[2][2].is_string() ? m[2][2].get<std::string>() : std::string("rejected");
-                        throw std::runtime_error(name + ": " + message);
-                    }
-                    throw std::runtime_error("RPC rejected");
-                }
-                // resolve value
-                json val = (m.size() >= 3) ? m[2] : json();
-                val = unwrapArrayIfNeeded(val);
-                val = decodeSpecial(val);
-                return val;
+                std::string name = m[2][1].is_string() ? m[2][1].get<std::string>() : std::string("Error");
+                std::string message = m[2][2].is_string() ? m[2][2].get<std::string>() : std::string("rejected");
+                error = name + ": " + message;
             }
+            return true;
         }
-        throw std::runtime_error("No resolution for importId");
+        value = decodeResult(m.size() >= 3 ? m[2] : json());
+        return true;
     }
 };
 
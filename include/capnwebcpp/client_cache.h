@@ -0,0 +1,218 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "capnwebcpp/client_calls.h"
+#include "capnwebcpp/memory_accounting.h"
+
+namespace capnwebcpp
+{
+
+using json = nlohmann::json;
+
+// Caching of one idempotent main-target method on a client. Results are kept for `ttl`; beyond
+// maxEntries or maxBytes (approximate, see estimateJsonBytes) the least recently used go first.
+// Only suitable for methods returning plain data: cached stubs would outlive their exports.
+struct ClientCachePolicy
+{
+    std::chrono::milliseconds ttl{ 1000 };
+    std::size_t maxEntries = 1024;
+    std::size_t maxBytes = 1024 * 1024;
+};
+
+// Client-side result cache keyed by method and canonical arguments (object keys sorted, as
+// json::dump() emits them). Concurrent identical calls share one request: the first caller
+// makes it and the others wait for its outcome. Rejections are passed to every waiter but not
+// cached. Thread-safe.
+class ClientResultCache
+{
+public:
+    using Completion = PendingCalls::Completion;
+    using Clock = std::chrono::steady_clock;
+
+    void setPolicy(const std::string& method, ClientCachePolicy policy)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        MethodCache& m = methods[method];
+        m.policy = policy;
+        evict(m);
+    }
+
+    bool cacheable(const std::string& method) const
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        return methods.count(method) != 0;
+    }
+
+    // Serve `done` from the cache (it runs now, on this thread) or attach it to an identical
+    // call in flight; true if either happened. Otherwise the caller must make the call and report
+    // its outcome with complete(key, ...), which also runs `done`.
+    bool tryServe(const std::string& method, const json& args, Completion done, std::string& key)
+    {
+        key = method;
+        key.push_back('\0');
+        key += args.dump();
+        json hit;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto m = methods.find(method);
+            if (m == methods.end() || !lookup(m->second, key, hit))
+            {
+                auto [flight, leader] = inFlight.try_emplace(key);
+                if (leader) flight->second.generation = generation;
+                flight->second.waiters.push_back(std::move(done));
+                ++misses;
+                return !leader;
+            }
+            ++hits;
+        }
+        done(std::move(hit), std::string());
+        return true;
+    }
+
+    // Outcome of a call started after tryServe() returned false: cache a value and complete
+    // every waiter.
+    void complete(const std::string& key, json value, std::string error)
+    {
+        std::vector<Completion> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto flight = inFlight.find(key);
+            if (flight == inFlight.end())
+                return;
+            waiters = std::move(flight->second.waiters);
+            // Not cached if invalidate() ran while the call was in flight.
+            if (error.empty() && flight->second.generation == generation)
+                store(key, value);
+            inFlight.erase(flight);
+        }
+        for (auto& done : waiters)
+        {
+            if (done) done(value, error);
+        }
+    }
+
+    // Drop cached results of `method`, or of every method when empty. Calls in flight still
+    // complete their waiters but are not cached.
+    void invalidate(const std::string& method = std::string())
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        ++generation;
+        for (auto& [name, m] : methods)
+        {
+            if (!method.empty() && name != method) continue;
+            m.lru.clear();
+            m.index.clear();
+            m.bytes = 0;
+        }
+    }
+
+    struct Stats
+    {
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+        std::size_t hits = 0;           // Served from the cache
+        std::size_t misses = 0;         // Requests made or joined
+    };
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        Stats s;
+        for (const auto& [name, m] : methods)
+        {
+            s.entries += m.lru.size();
+            s.bytes += m.bytes;
+        }
+        s.hits = hits;
+        s.misses = misses;
+        return s;
+    }
+
+private:
+    struct Entry
+    {
+        std::string key;
+        json value;
+        Clock::time_point expires;
+        std::size_t bytes = 0;
+    };
+
+    struct MethodCache
+    {
+        ClientCachePolicy policy;
+        std::list<Entry> lru;           // Most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        std::size_t bytes = 0;
+    };
+
+    mutable std::mutex mu;
+    std::unordered_map<std::string, MethodCache> methods;
+    struct Flight
+    {
+        std::vector<Completion> waiters;
+        std::size_t generation = 0;
+    };
+
+    std::unordered_map<std::string, Flight> inFlight;
+    std::size_t generation = 0;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+
+    bool lookup(MethodCache& m, const std::string& key, json& out)
+    {
+        auto it = m.index.find(key);
+        if (it == m.index.end())
+            return false;
+        if (it->second->expires <= Clock::now())
+        {
+            remove(m, it->second);
+            return false;
+        }
+        m.lru.splice(m.lru.begin(), m.lru, it->second);
+        out = it->second->value;
+        return true;
+    }
+
+    void store(const std::string& key, const json& value)
+    {
+        auto m = methods.find(key.substr(0, key.find('\0')));
+        if (m == methods.end()) return;
+        MethodCache& cache = m->second;
+        auto old = cache.index.find(key);
+        if (old != cache.index.end())
+            remove(cache, old->second);
+        std::size_t bytes = key.capacity() + estimateJsonBytes(value);
+        if (bytes > cache.policy.maxBytes || cache.policy.maxEntries == 0)
+            return;
+        cache.lru.push_front(Entry{ key, value, Clock::now() + cache.policy.ttl, bytes });
+        cache.index[key] = cache.lru.begin();
+        cache.bytes += bytes;
+        evict(cache);
+    }
+
+    void evict(MethodCache& m)
+    {
+        while (!m.lru.empty() && (m.lru.size() > m.policy.maxEntries || m.bytes > m.policy.maxBytes))
+            remove(m, std::prev(m.lru.end()));
+    }
+
+    void remove(MethodCache& m, std::list<Entry>::iterator it)
+    {
+        m.bytes -= it->bytes;
+        m.index.erase(it->key);
+        m.lru.erase(it);
+    }
+};
+
+} // namespace capnwebcpp
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "capnwebcpp/id_table.h"
+
+namespace capnwebcpp
+{
+
+using json = nlohmann::json;
+
+// Outstanding calls of a persistent client, keyed by import ID. Completion slots live in an
+// IdTable: import IDs are sequential, so slots are dense pages reused across calls rather than
+// per-call heap objects, and any number of calls may be in flight at once.
+class PendingCalls
+{
+public:
+    // Receives the decoded value, or an empty value and a non-empty "Name: message" error.
+    using Completion = std::function<void(json value, std::string error)>;
+
+    // Register `done` under a fresh import ID and call send(importId) while still holding the
+    // lock, so pushes reach the transport in import ID order even when calls start on several
+    // threads. If send() throws, the call and its ID are forgotten and the exception propagates.
+    template<typename Send>
+    int start(Completion done, Send&& send)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        int importId = nextImportId++;
+        slots[importId] = std::move(done);
+        try
+        {
+            send(importId);
+        }
+        catch (...)
+        {
+            slots.erase(importId);
+            nextImportId = importId;
+            throw;
+        }
+        return importId;
+    }
+
+    // As start(), for a push whose result is only referenced by later calls: no completion slot.
+    template<typename Send>
+    int reserve(Send&& send)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        int importId = nextImportId++;
+        try
+        {
+            send(importId);
+        }
+        catch (...)
+        {
+            nextImportId = importId;
+            throw;
+        }
+        return importId;
+    }
+
+    // Register `done` for an import pushed earlier via reserve(), then call send() (its pull).
+    template<typename Send>
+    void expect(int importId, Completion done, Send&& send)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        slots[importId] = std::move(done);
+        try
+        {
+            send();
+        }
+        catch (...)
+        {
+            slots.erase(importId);
+            throw;
+        }
+    }
+
+    // Complete the call waiting on `importId`; false if there is none. The completion runs on
+    // the calling thread, outside the lock.
+    bool settle(int importId, json value, std::string error)
+    {
+        Completion done;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            Completion* slot = slots.get(importId);
+            if (!slot) return false;
+            done = std::move(*slot);
+            slots.erase(importId);
+        }
+        if (done) done(std::move(value), std::move(error));
+        return true;
+    }
+
+    // Fail every outstanding call with `reason` (connection closed or aborted).
+    void failAll(const std::string& reason)
+    {
+        std::vector<Completion> failed;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            failed.reserve(slots.size());
+            for (auto& kv : slots)
+                failed.push_back(std::move(kv.second));
+            slots.clear();
+        }
+        for (auto& done : failed)
+        {
+            if (done) done(json(), reason);
+        }
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        return slots.size();
+    }
+
+    // Completion fulfilling a std::future: the value, or std::runtime_error carrying the error.
+    static std::pair<Completion, std::future<json>> makeFuture()
+    {
+        auto promise = std::make_shared<std::promise<json>>();
+        std::future<json> future = promise->get_future();
+        Completion done = [promise](json value, std::string error)
+        {
+            if (error.empty())
+                promise->set_value(std::move(value));
+            else
+                promise->set_exception(std::make_exception_ptr(std::runtime_error(error)));
+        };
+        return { std::move(done), std::move(future) };
+    }
+
+private:
+    mutable std::mutex mu;
+    int nextImportId = 1;
+    IdTable<Completion> slots;
+};
+
+// Releases a client owes the peer, aggregated per import ID. Rather than a frame per settled
+// call, they are taken in front of the next outbound push/pull burst, or by a short flush timer
+// when no burst comes.
+class DeferredReleases
+{
+public:
+    // True for the first release since the last take(): the caller should arm the flush timer.
+    bool add(int importId, int count = 1)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        bool first = counts.empty();
+        auto [it, inserted] = index.try_emplace(importId, counts.size());
+        if (inserted)
+            counts.emplace_back(importId, count);
+        else
+            counts[it->second].second += count;
+        return first;
+    }
+
+    // Queue a release for a client with a flush timer. With `delayMs` <= 0 the queued frames go
+    // to `send` at once; otherwise the first release since the last take() calls `arm(delayMs)`.
+    void schedule(int importId, int delayMs,
+                  const std::function<void(std::string)>& send, const std::function<void(int)>& arm)
+    {
+        bool first = add(importId);
+        if (delayMs <= 0)
+        {
+            for (auto& frame : take())
+                send(std::move(frame));
+        }
+        else if (first)
+        {
+            arm(delayMs);
+        }
+    }
+
+    // ["release", importId, count] frames, in first-release order; clears the set.
+    std::vector<std::string> take()
+    {
+        std::vector<std::pair<int, int>> taken;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            taken.swap(counts);
+            index.clear();
+        }
+        std::vector<std::string> frames;
+        frames.reserve(taken.size());
+        for (const auto& [importId, count] : taken)
+            frames.push_back(json::array({ "release", importId, count }).dump());
+        return frames;
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        return counts.size();
+    }
+
+private:
+    mutable std::mutex mu;
+    std::vector<std::pair<int, int>> counts;
+    std::unordered_map<int, std::size_t> index;
+};
+
+} // namespace capnwebcpp
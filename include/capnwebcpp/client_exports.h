@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+#include "capnwebcpp/protocol.h"
+#include "capnwebcpp/rpc_session.h"
+#include "capnwebcpp/transport.h"
+
+namespace capnwebcpp
+{
+
+using json = nlohmann::json;
+
+// Local targets a persistent client exports to its peer, served by a session of their own on the
+// client's connection, so the server can call back (e.g. push notifications) instead of being
+// polled. An exported target travels as ["export", id] inside call arguments; the peer's
+// push/pull/release frames go to handle() and responses leave through `send`.
+//
+// The peer releases a target it received once the call carrying it completes, so the client
+// keeps a reference of its own until unexport(). Thread-safe.
+class ClientExports
+{
+public:
+    using Send = std::function<void(std::string)>;
+
+    // `main` serves calls on the client's main target (import 0 on the peer), if any.
+    explicit ClientExports(Send send, std::shared_ptr<RpcTarget> main = nullptr)
+        : session(main ? main : (main = std::make_shared<RpcTarget>())),
+          transport(std::make_shared<SendTransport>(std::move(send)))
+    {
+        data.target = std::move(main);
+        data.transport = transport;
+        session.onOpen(&data);
+    }
+
+    ClientExports(const ClientExports&) = delete;
+    ClientExports& operator=(const ClientExports&) = delete;
+
+    ~ClientExports()
+    {
+        session.onClose(&data);
+    }
+
+    // ["export", id] expression for `target`, to place in call arguments. Exporting a target
+    // again yields the same ID.
+    json exportTarget(std::shared_ptr<RpcTarget> target)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        RpcTarget* key = target.get();
+        json expression = session.exportLocalTarget(&data, target);
+        if (pinned.try_emplace(key, expression[1].get<int>()).second)
+            session.exportLocalTarget(&data, std::move(target));
+        return expression;
+    }
+
+    // Drop the client's own reference; the target goes once the peer has released its copies.
+    // False if `target` is not exported.
+    bool unexport(const std::shared_ptr<RpcTarget>& target)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        auto it = pinned.find(target.get());
+        if (it == pinned.end()) return false;
+        protocol::Message release;
+        release.type = protocol::MessageType::Release;
+        release.params = json::array({ it->second, 1 });
+        pinned.erase(it);
+        session.handleMessageValue(&data, release);
+        return true;
+    }
+
+    // Serve a push, pull or release from the peer. False for any other frame, which belongs to
+    // the client's own calls.
+    bool handle(std::string_view frame)
+    {
+        protocol::Message m;
+        if (!isInbound(frame) || !protocol::parse(frame, m))
+            return false;
+        std::lock_guard<std::mutex> lock(mu);
+        pumpMessage(session, &data, *transport, m);
+        session.processTasks();
+        return true;
+    }
+
+    // Connection lost: fail the peer's calls in progress and forget every export.
+    void abort(const std::string& reason)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        session.markAborted(&data, reason);
+        pinned.clear();
+    }
+
+    // Targets currently exported (including promises the peer has yet to pull).
+    std::size_t exports() const
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        return static_cast<std::size_t>(session.getStats(&data).exports);
+    }
+
+private:
+    class SendTransport : public RpcTransport
+    {
+    public:
+        explicit SendTransport(Send send) : sendFrame(std::move(send)) {}
+
+        using RpcTransport::send;
+
+        void send(const std::string& message) override { sendFrame(message); }
+        void send(std::string&& message) override { sendFrame(std::move(message)); }
+        void abort(const std::string& /*reason*/) override {}
+
+    private:
+        Send sendFrame;
+    };
+
+    mutable std::mutex mu;
+    RpcSession session;
+    RpcSessionData data;
+    std::shared_ptr<SendTransport> transport;
+    std::unordered_map<RpcTarget*, int> pinned;
+
+    // Frames the peer sends as a caller, told apart by their tag without a full parse.
+    static bool isInbound(std::string_view frame)
+    {
+        auto start = frame.find('"');
+        if (start == std::string_view::npos) return false;
+        std::string_view tag = frame.substr(start);
+        return tag.starts_with("\"push\"") || tag.starts_with("\"pull\"") || tag.starts_with("\"release\"");
+    }
+};
+
+} // namespace capnwebcpp
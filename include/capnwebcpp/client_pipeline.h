@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+namespace capnwebcpp
+{
+
+using json = nlohmann::json;
+
+// Handle to the result of a pushed call that may not have resolved yet, optionally narrowed to a
+// property path. Passing it as (part of) a call argument references the result on the server as
+// ["pipeline", importId, path], so dependent calls need no round trip of their own. Import ID 0
+// is the peer's main target.
+class RpcPromise
+{
+public:
+    RpcPromise() = default;
+    explicit RpcPromise(int importId, json path = json::array())
+        : id(importId), propertyPath(std::move(path)) {}
+
+    int importId() const { return id; }
+    const json& path() const { return propertyPath; }
+
+    // Narrow to a property of the eventual result.
+    RpcPromise get(const std::string& key) const { return extended(json(key)); }
+    RpcPromise get(int index) const { return extended(json(index)); }
+    RpcPromise operator[](const std::string& key) const { return get(key); }
+    RpcPromise operator[](int index) const { return get(index); }
+
+    // ["pipeline", importId] or ["pipeline", importId, path].
+    json ref() const
+    {
+        if (propertyPath.empty())
+            return json::array({ "pipeline", id });
+        return json::array({ "pipeline", id, propertyPath });
+    }
+
+    // Pick this promise's property path out of the resolved (decoded) value of its import; null
+    // when the path does not exist.
+    json select(json value) const
+    {
+        for (const auto& part : propertyPath)
+        {
+            json next;
+            if (part.is_string() && value.is_object() && value.contains(part.get<std::string>()))
+                next = std::move(value[part.get<std::string>()]);
+            else if (part.is_number_integer() && value.is_array() && part.get<std::size_t>() < value.size())
+                next = std::move(value[part.get<std::size_t>()]);
+            else
+                return json();
+            value = std::move(next);
+        }
+        return value;
+    }
+
+    // Push expression calling `method` on the referenced object.
+    json callExpression(const std::string& method, const json& argsArray) const
+    {
+        json path = propertyPath;
+        path.push_back(method);
+        return json::array({ "pipeline", id, std::move(path), argsArray.is_null() ? json::array() : argsArray });
+    }
+
+private:
+    int id = 0;
+    json propertyPath = json::array();
+
+    RpcPromise extended(json part) const
+    {
+        json path = propertyPath;
+        path.push_back(std::move(part));
+        return RpcPromise(id, std::move(path));
+    }
+};
+
+// Lets promises appear directly inside json argument arrays.
+inline void to_json(json& j, const RpcPromise& p)
+{
+    j = p.ref();
+}
+
+// Records a mapping function over a remote value as a ["remap", ...] expression, so transforming
+// a remote array runs on the server in one call instead of one round trip per element. The mapper
+// runs once, here, on placeholders: inside it promises name mapper variables, not imports.
+// element is variable 0, call() results follow in instruction order, and capture() brings in a
+// promise from outside the mapper. Whatever the mapper returns (a promise, or json built from
+// promises) becomes the result for each element.
+//
+//   auto profiles = batch.map(users, [](RpcMapper& m, const RpcPromise& user)
+//   {
+//       return json{ {"name", user["name"]}, {"profile", m.call("getUserProfile", json::array({ user["id"] }))} };
+//   });
+class RpcMapper
+{
+public:
+    // Call a method on the peer's main target.
+    RpcPromise call(const std::string& method, const json& argsArray)
+    {
+        return append(json::array({ "pipeline", captureIndex(0), json::array({ method }),
+                                    argsArray.is_null() ? json::array() : argsArray }));
+    }
+
+    // Refer to a promise from outside the mapper, e.g. an earlier call of the same batch.
+    RpcPromise capture(const RpcPromise& outer)
+    {
+        return RpcPromise(captureIndex(outer.importId()), outer.path());
+    }
+
+    // ["remap", importId, path, captures, instructions] applying `mapper` to `source`, or to each
+    // element when it resolves to an array. `mapper` is called as mapper(RpcMapper&, RpcPromise).
+    template<typename Mapper>
+    static json expression(const RpcPromise& source, Mapper&& mapper)
+    {
+        RpcMapper m;
+        json result = mapper(m, RpcPromise(0));
+        m.finish(result);
+        return json::array({ "remap", source.importId(), source.path(), std::move(m.captures), std::move(m.instructions) });
+    }
+
+private:
+    json captures = json::array();
+    json instructions = json::array();
+
+    RpcMapper() = default;
+
+    // Captures are referenced as -1, -2, ...; each import is captured once.
+    int captureIndex(int importId)
+    {
+        json capture = json::array({ "import", importId });
+        for (std::size_t i = 0; i < captures.size(); ++i)
+        {
+            if (captures[i] == capture)
+                return -static_cast<int>(i) - 1;
+        }
+        captures.push_back(std::move(capture));
+        return -static_cast<int>(captures.size());
+    }
+
+    RpcPromise append(json instruction)
+    {
+        instructions.push_back(std::move(instruction));
+        return RpcPromise(static_cast<int>(instructions.size()));
+    }
+
+    // The last instruction's value is the mapper's result.
+    void finish(const json& result)
+    {
+        bool isRef = result.is_array() && (result.size() == 2 || result.size() == 3) &&
+                     result[0] == "pipeline" && result[1].is_number_integer();
+        if (isRef && result.size() == 2 && result[1] == static_cast<int>(instructions.size()))
+            return;
+        if (isRef)
+            instructions.push_back(json::array({ "get", result[1], result.size() == 3 ? result[2] : json::array() }));
+        else if (result.is_array())
+            instructions.push_back(json::array({ "array", result }));
+        else
+            instructions.push_back(json::array({ "value", result }));
+    }
+};
+
+} // namespace capnwebcpp
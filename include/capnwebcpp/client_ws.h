@@ -1,15 +1,22 @@
 #pragma once
 
-#include <condition_variable>
-#include <functional>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "capnwebcpp/client_api.h"
+#include "capnwebcpp/client_cache.h"
+#include "capnwebcpp/client_calls.h"
+#include "capnwebcpp/client_exports.h"
 #include "capnwebcpp/transports/uws_websocket_client.h"
 
 namespace capnwebcpp
@@ -17,16 +24,25 @@ namespace capnwebcpp
 
 using json = nlohmann::json;
 
-// Persistent WebSocket RPC client using uWebSockets.
+// Persistent WebSocket RPC client using uWebSockets. Calls are multiplexed over one socket:
+// the *Async variants return immediately with a std::future or invoke a completion callback, so
+// any number of calls from any number of threads can be in flight at once. Completions run on
+// the client's loop thread and should not block. The blocking variants wait on the future.
+// Local targets exported with exportTarget() can be called back by the server on the same socket;
+// their methods run on the loop thread too.
 class RpcWsClient
 {
 public:
+    using Completion = PendingCalls::Completion;
+
+    // Connect on a loop thread of its own.
     explicit RpcWsClient(const std::string& url)
-        : url(url), ws(std::make_shared<UwsWebSocketClient>())
-    {
-        ws->setOnMessage([this](const std::string& message) { this->handleMessage(message); });
-        ws->connect(url);
-    }
+        : RpcWsClient(url, std::make_shared<UwsWebSocketClient>()) {}
+
+    // Connect on a loop shared with other clients. Blocking calls and close() must not be made
+    // from that loop's threads (e.g. from a completion).
+    RpcWsClient(std::shared_ptr<UwsClientLoop> loop, const std::string& url)
+        : RpcWsClient(url, std::make_shared<UwsWebSocketClient>(std::move(loop))) {}
 
     ~RpcWsClient()
     {
@@ -35,172 +51,332 @@ public:
 
     void close()
     {
-        std::lock_guard<std::mutex> lock(mu);
-        if (closed) return;
-        closed = true;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            if (closed) return;
+            closed = true;
+        }
         ws->close();
+        pending.failAll("connection closed");
     }
 
     // Call a method on main target; blocks until resolution and returns decoded JSON.
     json callMethod(const std::string& method, const json& argsArray)
     {
-        int importId = allocateImportId();
-        json push = json::array({
-            "push",
-            json::array({ "pipeline", 0, json::array({ method }), argsArray.is_null() ? json::array() : argsArray })
-        });
-        send(push.dump());
-        send(json::array({ "pull", importId }).dump());
-
-        json value = awaitResolution(importId);
-        // Release our import to avoid server leaks.
-        send(json::array({ "release", importId, 1 }).dump());
-        return value;
+        return callMethodAsync(method, argsArray).get();
     }
 
     // Call a method on a stub returned by a previous call.
     json callStubMethod(const json& stub, const std::string& method, const json& argsArray)
     {
-        int exportId = getStubId(stub);
-        if (exportId == 0) throw std::runtime_error("callStubMethod: not a stub");
-        int importId = allocateImportId();
-        json push = json::array({
-            "push",
-            json::array({ "pipeline", exportId, json::array({ method }), argsArray.is_null() ? json::array() : argsArray })
-        });
-        send(push.dump());
-        send(json::array({ "pull", importId }).dump());
-        json value = awaitResolution(importId);
-        send(json::array({ "release", importId, 1 }).dump());
-        return value;
+        return callStubMethodAsync(stub, method, argsArray).get();
     }
 
     // Get a property from a stub (path is a JSON array of string/number parts).
     json getStubProperty(const json& stub, const json& path)
     {
-        int exportId = getStubId(stub);
-        if (exportId == 0) throw std::runtime_error("getStubProperty: not a stub");
-        int importId = allocateImportId();
-        send(json::array({ "push", json::array({ "pipeline", exportId, path }) }).dump());
-        send(json::array({ "pull", importId }).dump());
-        json value = awaitResolution(importId);
-        send(json::array({ "release", importId, 1 }).dump());
-        return value;
+        return getStubPropertyAsync(stub, path).get();
     }
 
-    // Helpers for stub markers.
-    static json makeStub(int exportId) { return json{ {"$stub", exportId} }; }
-    static bool isStub(const json& v) { return v.is_object() && v.contains("$stub") && v["$stub"].is_number_integer(); }
-    static int getStubId(const json& v) { return isStub(v) ? v["$stub"].get<int>() : 0; }
+    std::future<json> callMethodAsync(const std::string& method, const json& argsArray)
+    {
+        auto [done, future] = PendingCalls::makeFuture();
+        callMethodAsync(method, argsArray, std::move(done));
+        return std::move(future);
+    }
 
-private:
-    std::string url;
-    std::shared_ptr<UwsWebSocketClient> ws;
+    std::future<json> callStubMethodAsync(const json& stub, const std::string& method, const json& argsArray)
+    {
+        auto [done, future] = PendingCalls::makeFuture();
+        callStubMethodAsync(stub, method, argsArray, std::move(done));
+        return std::move(future);
+    }
 
-    std::mutex mu;
-    bool closed = false;
-    int nextImportId = 1;
-    struct Pending
-    {
-        std::mutex m;
-        std::condition_variable cv;
-        bool done = false;
-        json value;
-        std::string error;
-    };
-    std::map<int, std::shared_ptr<Pending>> pending;
+    std::future<json> getStubPropertyAsync(const json& stub, const json& path)
+    {
+        auto [done, future] = PendingCalls::makeFuture();
+        getStubPropertyAsync(stub, path, std::move(done));
+        return std::move(future);
+    }
 
-    int allocateImportId()
+    // Calls to methods with a cache policy may complete from the cache on the calling thread, or
+    // join an identical call in flight.
+    void callMethodAsync(const std::string& method, const json& argsArray, Completion done)
     {
-        std::lock_guard<std::mutex> lock(mu);
-        int id = nextImportId++;
-        pending[id] = std::make_shared<Pending>();
-        return id;
+        json expression = json::array({ "pipeline", 0, json::array({ method }), argsArray.is_null() ? json::array() : argsArray });
+        if (!cache.cacheable(method))
+        {
+            start(std::move(expression), std::move(done));
+            return;
+        }
+        std::string key;
+        if (cache.tryServe(method, argsArray, std::move(done), key))
+            return;
+        try
+        {
+            start(std::move(expression), [this, key](json value, std::string error)
+            {
+                cache.complete(key, std::move(value), std::move(error));
+            });
+        }
+        catch (const std::exception& e)
+        {
+            cache.complete(key, json(), e.what());
+            throw;
+        }
     }
 
-    void send(const std::string& m)
+    void callStubMethodAsync(const json& stub, const std::string& method, const json& argsArray, Completion done)
     {
-        ws->send(m);
+        int exportId = getStubId(stub);
+        if (exportId == 0) throw std::runtime_error("callStubMethod: not a stub");
+        start(json::array({ "pipeline", exportId, json::array({ method }), argsArray.is_null() ? json::array() : argsArray }),
+              std::move(done));
     }
 
-    static json unwrapArrayIfNeeded(const json& v)
+    void getStubPropertyAsync(const json& stub, const json& path, Completion done)
     {
-        if (v.is_array() && v.size() == 1 && v[0].is_array()) return v[0];
-        return v;
+        int exportId = getStubId(stub);
+        if (exportId == 0) throw std::runtime_error("getStubProperty: not a stub");
+        start(json::array({ "pipeline", exportId, path }), std::move(done));
     }
 
-    static json decodeSpecial(const json& v)
+    // Calls whose results feed later calls without waiting for them. Each call() pushes at once
+    // and returns a promise usable in later arguments (or as a call target); await() pulls. Every
+    // result stays usable until the pipeline is destroyed, awaited or not, and is released then.
+    //
+    //   auto p = client.pipeline();
+    //   auto user = p.call("authenticate", json::array({ token }));
+    //   auto notes = p.call("getNotifications", json::array({ user["id"] }));
+    //   json value = p.await(notes);
+    class Pipeline
     {
-        if (v.is_array() && v.size() >= 1 && v[0].is_string())
+    public:
+        explicit Pipeline(RpcWsClient& client) : client(client) {}
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        ~Pipeline()
         {
-            std::string tag = v[0];
-            if (tag == "export")
-            {
-                if (v.size() >= 2 && v[1].is_number_integer()) return makeStub(v[1].get<int>());
-            }
-            else if (tag == "promise")
-            {
-                if (v.size() >= 2 && v[1].is_number_integer()) return json{ {"$promise_stub", v[1].get<int>()} };
-            }
-            else if (tag == "undefined")
-            {
-                return json{ {"$undefined", true} };
-            }
-            else if (tag == "bigint" && v.size() >= 2 && v[1].is_string())
+            for (int id : imports)
             {
-                return json{ {"$bigint", v[1]} };
+                client.unhold(id);
+                client.release(id);
             }
-            else if (tag == "date" && v.size() >= 2 && v[1].is_number())
+        }
+
+        // Call a method on the main target.
+        RpcPromise call(const std::string& method, const json& argsArray)
+        {
+            return push(RpcPromise().callExpression(method, argsArray));
+        }
+
+        // Call a method on the stub an earlier call returns (at the promise's path when it is
+        // narrowed). The call is rejected when the server finds no stub there.
+        RpcPromise call(const RpcPromise& target, const std::string& method, const json& argsArray)
+        {
+            return push(target.callExpression(method, argsArray));
+        }
+
+        // Call a method on a stub returned by a previous call.
+        RpcPromise callStub(const json& stub, const std::string& method, const json& argsArray)
+        {
+            int exportId = getStubId(stub);
+            if (exportId == 0) throw std::runtime_error("callStub: not a stub");
+            return call(RpcPromise(exportId), method, argsArray);
+        }
+
+        // Apply `mapper` on the server to the result of `source` (to each element when it is an
+        // array) in one call; see RpcMapper.
+        template<typename Mapper>
+        RpcPromise map(const RpcPromise& source, Mapper&& mapper)
+        {
+            return push(RpcMapper::expression(source, std::forward<Mapper>(mapper)));
+        }
+
+        std::future<json> awaitAsync(const RpcPromise& promise)
+        {
+            auto [done, future] = PendingCalls::makeFuture();
+            awaitAsync(promise, std::move(done));
+            return std::move(future);
+        }
+
+        // Each call's result can be awaited once, either whole or through one narrowed promise
+        // (which selects its path from the result).
+        void awaitAsync(const RpcPromise& promise, Completion done)
+        {
+            int importId = promise.importId();
+            auto it = std::find(unpulled.begin(), unpulled.end(), importId);
+            if (it == unpulled.end())
+                throw std::runtime_error("await: promise is not an unawaited result of this pipeline");
+            if (!promise.path().empty())
             {
-                return json{ {"$date", v[1]} };
+                done = [promise, done = std::move(done)](json value, std::string error)
+                {
+                    done(error.empty() ? promise.select(std::move(value)) : json(), std::move(error));
+                };
             }
-            else if (tag == "bytes" && v.size() >= 2 && v[1].is_string())
+            client.pending.expect(importId, std::move(done), [&]()
             {
-                return json{ {"$bytes", v[1]} };
-            }
-            else if (tag == "error" && v.size() >= 3 && v[1].is_string() && v[2].is_string())
+                client.sendReleases();
+                client.send(json::array({ "pull", importId }).dump());
+            });
+            unpulled.erase(it);
+        }
+
+        json await(const RpcPromise& promise)
+        {
+            return awaitAsync(promise).get();
+        }
+
+    private:
+        RpcWsClient& client;
+        std::vector<int> imports;
+        std::vector<int> unpulled;
+
+        RpcPromise push(const json& expression)
+        {
+            std::string frame = json::array({ "push", expression }).dump();
+            int importId = client.pending.reserve([&](int)
             {
-                return json{ {"$error", json{ {"name", v[1]}, {"message", v[2]} } } };
-            }
+                client.sendReleases();
+                client.send(std::move(frame));
+            });
+            client.hold(importId);
+            imports.push_back(importId);
+            unpulled.push_back(importId);
+            return RpcPromise(importId);
         }
-        return v;
+    };
+
+    Pipeline pipeline() { return Pipeline(*this); }
+
+    // Calls sent and not yet settled.
+    std::size_t inFlight() const { return pending.size(); }
+
+    // Cache results of an idempotent main-target method; see ClientCachePolicy.
+    void setCachePolicy(const std::string& method, ClientCachePolicy policy)
+    {
+        cache.setPolicy(method, policy);
     }
 
-    json awaitResolution(int importId)
+    void invalidateCache(const std::string& method = std::string()) { cache.invalidate(method); }
+    ClientResultCache::Stats cacheStats() const { return cache.stats(); }
+
+    // How long a release may wait for an outbound burst to ride along with (default 5 ms). Zero
+    // sends each release as its call settles.
+    void setReleaseDelay(std::chrono::milliseconds delay)
+    {
+        releaseDelayMs.store(std::max(0, static_cast<int>(delay.count())), std::memory_order_relaxed);
+    }
+
+    // Export a local target for the server to call back, e.g. for push notifications. Pass the
+    // returned ["export", id] in call arguments; it stays exported until unexport(). See
+    // ClientExports.
+    //
+    //   client.callMethod("subscribe", json::array({ client.exportTarget(listener) }));
+    json exportTarget(std::shared_ptr<RpcTarget> target) { return exports.exportTarget(std::move(target)); }
+    bool unexport(const std::shared_ptr<RpcTarget>& target) { return exports.unexport(target); }
+
+    // Helpers for stub markers.
+    static json makeStub(int exportId) { return RpcClient::makeStub(exportId); }
+    static bool isStub(const json& v) { return RpcClient::isStub(v); }
+    static int getStubId(const json& v) { return RpcClient::getStubId(v); }
+
+private:
+    std::string url;
+    std::shared_ptr<UwsWebSocketClient> ws;
+
+    RpcWsClient(const std::string& url, std::shared_ptr<UwsWebSocketClient> socket)
+        : url(url), ws(std::move(socket))
     {
-        std::shared_ptr<Pending> p;
+        ws->setOnMessage([this](const std::string& message) { this->handleMessage(message); });
+        ws->setOnClose([this]()
         {
-            std::lock_guard<std::mutex> lock(mu);
-            auto it = pending.find(importId);
-            if (it == pending.end()) throw std::runtime_error("awaitResolution: unknown id");
-            p = it->second;
-        }
-        std::unique_lock<std::mutex> plock(p->m);
-        p->cv.wait(plock, [&]() { return p->done; });
-        if (!p->error.empty()) throw std::runtime_error(p->error);
-        json v = p->value;
+            pending.failAll("connection closed");
+            exports.abort("connection closed");
+        });
+        ws->setOnTimer([this]() { sendReleases(); });
+        ws->connect(url);
+    }
+
+    std::mutex mu;
+    bool closed = false;
+    std::unordered_set<int> held;
+    PendingCalls pending;
+    DeferredReleases releases;
+    ClientResultCache cache;
+    std::atomic<int> releaseDelayMs{ 5 };
+    ClientExports exports{ [this](std::string frame) { send(std::move(frame)); } };
+
+    // Push `expression` and pull its result; `done` runs when the resolution arrives.
+    void start(json expression, Completion done)
+    {
+        std::string push = json::array({ "push", std::move(expression) }).dump();
+        pending.start(std::move(done), [&](int importId)
         {
-            std::lock_guard<std::mutex> lock(mu);
-            pending.erase(importId);
-        }
-        return v;
+            sendReleases();
+            send(std::move(push));
+            send(json::array({ "pull", importId }).dump());
+        });
+    }
+
+    void send(std::string frame)
+    {
+        ws->send(std::move(frame));
+    }
+
+    // Imports of live pipelines are released when their pipeline goes, not as they settle.
+    void hold(int importId)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        held.insert(importId);
+    }
+
+    void unhold(int importId)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        held.erase(importId);
+    }
+
+    bool isHeld(int importId)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        return held.count(importId) != 0;
+    }
+
+    // Releases wait for the next push/pull burst, which sends them first, or for the flush timer.
+    void release(int importId)
+    {
+        releases.schedule(importId, releaseDelayMs.load(std::memory_order_relaxed),
+                          [this](std::string frame) { sendRelease(std::move(frame)); },
+                          [this](int delayMs) { ws->armTimer(delayMs); });
+    }
+
+    void sendReleases()
+    {
+        for (auto& frame : releases.take())
+            sendRelease(std::move(frame));
+    }
+
+    void sendRelease(std::string frame)
+    {
+        try { ws->send(std::move(frame)); } catch (...) {}
     }
 
     void handleMessage(const std::string& message)
     {
+        // Calls from the server on our exports.
+        if (exports.handle(message)) return;
         json m = json::parse(message, nullptr, false);
         if (!m.is_array() || m.empty() || !m[0].is_string()) return;
-        std::string tag = m[0];
+        const std::string& tag = m[0].get_ref<const std::string&>();
         if ((tag == "resolve" || tag == "reject") && m.size() >= 3 && m[1].is_number_integer())
         {
             int importId = m[1].get<int>();
-            std::shared_ptr<Pending> p;
-            {
-                std::lock_guard<std::mutex> lock(mu);
-                auto it = pending.find(importId);
-                if (it == pending.end()) return;
-                p = it->second;
-            }
+            json value;
+            std::string error;
             if (tag == "reject")
             {
                 std::string name = "Error";
@@ -210,38 +386,22 @@ private:
                     if (m[2][1].is_string()) name = m[2][1].get<std::string>();
                     if (m[2][2].is_string()) messageText = m[2][2].get<std::string>();
                 }
-                {
-                    std::lock_guard<std::mutex> lk(p->m);
-                    p->error = name + ": " + messageText;
-                    p->done = true;
-                }
-                p->cv.notify_all();
-                return;
+                error = name + ": " + messageText;
+            }
+            else
+            {
+                value = RpcClient::decodeResult(m[2]);
             }
-            // resolve
-            json val = m[2];
-            val = unwrapArrayIfNeeded(val);
-            val = decodeSpecial(val);
+            if (pending.settle(importId, std::move(value), std::move(error)) && !isHeld(importId))
             {
-                std::lock_guard<std::mutex> lk(p->m);
-                p->value = val;
-                p->done = true;
+                // Release our import to avoid server leaks.
+                release(importId);
             }
-            p->cv.notify_all();
         }
         else if (tag == "abort")
         {
-            std::lock_guard<std::mutex> lock(mu);
-            for (auto& kv : pending)
-            {
-                {
-                    std::lock_guard<std::mutex> lk(kv.second->m);
-                    kv.second->error = "aborted";
-                    kv.second->done = true;
-                }
-                kv.second->cv.notify_all();
-            }
-            pending.clear();
+            pending.failAll("aborted");
+            exports.abort("aborted");
         }
     }
 };
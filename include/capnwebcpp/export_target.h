@@ -17,7 +17,9 @@ inline json exportTarget(RpcSessionData* sessionData, std::shared_ptr<RpcTarget>
 {
     if (!sessionData) return json();
     std::uintptr_t key = reinterpret_cast<std::uintptr_t>(target.get());
-    sessionData->targetRegistry[key] = std::move(target);
+    RegisteredTarget& registered = sessionData->targetRegistry[key];
+    registered.target = std::move(target);
+    ++registered.markers;
     return json{ {"$export_target_ptr", key} };
 }
 
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace capnwebcpp
+{
+
+// --------------------------------------------------------------------------------------
+// Length-prefixed framing for stream transports (TCP, Unix domain sockets)
+//
+// Each frame is a 4-byte big-endian payload length followed by the payload (one protocol
+// message as JSON text).
+
+constexpr std::size_t kFrameHeaderSize = 4;
+
+inline std::array<char, kFrameHeaderSize> encodeFrameHeader(std::size_t length)
+{
+    auto n = static_cast<std::uint32_t>(length);
+    return { static_cast<char>(n >> 24), static_cast<char>(n >> 16),
+             static_cast<char>(n >> 8), static_cast<char>(n) };
+}
+
+inline std::size_t decodeFrameHeader(const char* p)
+{
+    auto b = [p](int i) { return static_cast<std::uint32_t>(static_cast<unsigned char>(p[i])); };
+    return (b(0) << 24) | (b(1) << 16) | (b(2) << 8) | b(3);
+}
+
+// Incremental decoder for a length-prefixed byte stream. Frames contained entirely in one
+// feed() chunk are passed through without copying; only frames split across chunks are
+// assembled in an internal buffer.
+class FrameDecoder
+{
+public:
+    explicit FrameDecoder(std::size_t maxFrameSize = 16 * 1024 * 1024) : maxFrameSize(maxFrameSize) {}
+
+    // Feed received bytes; calls onFrame(std::string_view) for each complete frame. Throws
+    // std::length_error for a frame larger than the limit (the stream cannot be resynchronized).
+    template<typename OnFrame>
+    void feed(std::string_view bytes, OnFrame&& onFrame)
+    {
+        // Complete a frame left over from the previous chunk.
+        while (!partial.empty())
+        {
+            if (partial.size() < kFrameHeaderSize)
+            {
+                std::size_t take = std::min(kFrameHeaderSize - partial.size(), bytes.size());
+                partial.append(bytes.data(), take);
+                bytes.remove_prefix(take);
+                if (partial.size() < kFrameHeaderSize)
+                    return;
+            }
+            std::size_t want = kFrameHeaderSize + checkedLength(partial.data());
+            partial.reserve(want);
+            std::size_t take = std::min(want - partial.size(), bytes.size());
+            partial.append(bytes.data(), take);
+            bytes.remove_prefix(take);
+            if (partial.size() < want)
+                return;
+            std::string frame = std::move(partial);
+            partial.clear();
+            onFrame(std::string_view(frame).substr(kFrameHeaderSize));
+        }
+
+        // Whole frames straight from the chunk.
+        while (bytes.size() >= kFrameHeaderSize)
+        {
+            std::size_t length = checkedLength(bytes.data());
+            if (bytes.size() < kFrameHeaderSize + length)
+                break;
+            onFrame(bytes.substr(kFrameHeaderSize, length));
+            bytes.remove_prefix(kFrameHeaderSize + length);
+        }
+
+        if (!bytes.empty())
+            partial.assign(bytes.data(), bytes.size());
+    }
+
+    // Bytes of an incomplete frame held between feed() calls.
+    std::size_t buffered() const { return partial.size(); }
+
+private:
+    std::size_t maxFrameSize;
+    std::string partial;
+
+    std::size_t checkedLength(const char* header) const
+    {
+        std::size_t length = decodeFrameHeader(header);
+        if (length > maxFrameSize)
+            throw std::length_error("frame exceeds maximum size");
+        return length;
+    }
+};
+
+} // namespace capnwebcpp
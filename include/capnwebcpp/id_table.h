@@ -0,0 +1,385 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
+namespace capnwebcpp
+{
+
+// Dense table keyed by signed protocol IDs.
+//
+// Export and import IDs are allocated sequentially (1, 2, 3, ... for pushes and -1, -2, ... for
+// server-originated exports), so entries are stored in fixed-size pages indexed directly by ID
+// magnitude: one lane for non-negative IDs and one for negative IDs. Pages are allocated lazily
+// and freed once all of their entries have been released, so a long-lived
+// session only keeps pages covering its live ID window. Entry addresses are stable for the
+// lifetime of the entry (pages never move), matching the pointer semantics callers relied on
+// with std::unordered_map.
+//
+// IDs that fall far outside the dense window (peer-chosen outliers, or IDs below an already
+// trimmed front) are kept in a small spill map so they can never force large allocations.
+//
+// The interface mirrors the subset of std::unordered_map used by the session code and tests:
+// find()/end(), operator[], erase(), size()/empty()/clear() and iteration yielding
+// `first`/`second` pairs.
+template<typename T>
+class IdTable
+{
+public:
+    static constexpr int kPageBits = 8;
+    static constexpr int kPageSize = 1 << kPageBits;
+    // Maximum number of not-yet-allocated pages a new ID may skip ahead before spilling.
+    static constexpr int kMaxPageGap = 4;
+
+private:
+    struct Page
+    {
+        std::array<std::optional<T>, kPageSize> slots;
+        int live = 0;
+    };
+
+    struct Lane
+    {
+        std::deque<std::unique_ptr<Page>> pages;
+        int basePage = 0;       // Page number of pages[0]
+
+        Page* pageFor(int mag) const
+        {
+            if (mag < 0) return nullptr;
+            int pg = (mag >> kPageBits) - basePage;
+            if (pg < 0 || pg >= static_cast<int>(pages.size())) return nullptr;
+            return pages[pg].get();
+        }
+
+        // Return the page that should hold `mag`, allocating it if it lies within the dense
+        // window; nullptr if the ID should spill.
+        Page* pageForInsert(int mag)
+        {
+            int pageNo = mag >> kPageBits;
+            if (pages.empty())
+            {
+                basePage = pageNo;
+            }
+            int pg = pageNo - basePage;
+            if (pg < 0) return nullptr;
+            if (pg >= static_cast<int>(pages.size()))
+            {
+                if (pg - static_cast<int>(pages.size()) >= kMaxPageGap) return nullptr;
+                // The previous tail is no longer where allocation continues; drop it if empty.
+                if (!pages.empty() && pages.back() && pages.back()->live == 0) pages.back().reset();
+                pages.resize(pg + 1);
+            }
+            if (!pages[pg]) pages[pg] = std::make_unique<Page>();
+            Page* p = pages[pg].get();
+            trimFront();
+            return p;
+        }
+
+        // Called after an entry on page `pageNo` was removed. Frees emptied pages other than the
+        // tail (which is where sequential allocation continues) and trims the front.
+        void release(int pageNo)
+        {
+            int pg = pageNo - basePage;
+            Page* p = pages[pg].get();
+            --p->live;
+            if (p->live > 0 || pg + 1 == static_cast<int>(pages.size())) return;
+            pages[pg].reset();
+            trimFront();
+        }
+
+        void trimFront()
+        {
+            while (pages.size() > 1 && !pages.front())
+            {
+                pages.pop_front();
+                ++basePage;
+            }
+        }
+
+        // Drop all entries. One emptied page is kept (rebased to page 0) so a table that is
+        // reused for a new session does not reallocate for its first IDs.
+        void clear()
+        {
+            std::unique_ptr<Page> keep;
+            for (auto& p : pages)
+            {
+                if (p)
+                {
+                    keep = std::move(p);
+                    break;
+                }
+            }
+            pages.clear();
+            basePage = 0;
+            if (!keep) return;
+            if (keep->live > 0)
+            {
+                for (auto& slot : keep->slots) slot.reset();
+                keep->live = 0;
+            }
+            pages.push_back(std::move(keep));
+        }
+    };
+
+public:
+    // Value yielded by iterators; `second` refers to the stored entry.
+    struct Ref
+    {
+        int first;
+        T& second;
+    };
+
+    class iterator
+    {
+    public:
+        iterator() = default;
+
+        Ref& operator*() const { return *ref; }
+        Ref* operator->() const { return &*ref; }
+
+        iterator& operator++()
+        {
+            advance();
+            return *this;
+        }
+
+        bool operator==(const iterator& o) const
+        {
+            return phase == o.phase && page == o.page && slot == o.slot &&
+                   (phase != Phase::Spill || spillIt == o.spillIt);
+        }
+        bool operator!=(const iterator& o) const { return !(*this == o); }
+
+    private:
+        friend class IdTable;
+        enum class Phase { Positive, Negative, Spill, End };
+
+        IdTable* table = nullptr;
+        Phase phase = Phase::End;
+        std::size_t page = 0;
+        int slot = 0;
+        typename std::unordered_map<int, T>::iterator spillIt;
+        mutable std::optional<Ref> ref;
+
+        iterator(IdTable* t, Phase ph, std::size_t pg, int sl)
+            : table(t), phase(ph), page(pg), slot(sl)
+        {
+        }
+
+        iterator(IdTable* t, typename std::unordered_map<int, T>::iterator it)
+            : table(t), phase(Phase::Spill), spillIt(it)
+        {
+            settle();
+        }
+
+        Lane* lane() const
+        {
+            return phase == Phase::Positive ? &table->positive : &table->negative;
+        }
+
+        // Position on the first occupied slot at or after the current position.
+        void settle()
+        {
+            while (phase == Phase::Positive || phase == Phase::Negative)
+            {
+                Lane* l = lane();
+                while (page < l->pages.size())
+                {
+                    Page* p = l->pages[page].get();
+                    if (p && p->live > 0)
+                    {
+                        for (; slot < kPageSize; ++slot)
+                        {
+                            if (p->slots[slot])
+                            {
+                                int mag = static_cast<int>((l->basePage + page) << kPageBits) + slot;
+                                ref.emplace(Ref{ phase == Phase::Positive ? mag : -mag, *p->slots[slot] });
+                                return;
+                            }
+                        }
+                    }
+                    ++page;
+                    slot = 0;
+                }
+                phase = (phase == Phase::Positive) ? Phase::Negative : Phase::Spill;
+                page = 0;
+                slot = 0;
+                if (phase == Phase::Spill) spillIt = table->spill.begin();
+            }
+            if (phase == Phase::Spill)
+            {
+                if (spillIt != table->spill.end())
+                {
+                    ref.emplace(Ref{ spillIt->first, spillIt->second });
+                    return;
+                }
+                phase = Phase::End;
+            }
+            page = 0;
+            slot = 0;
+            ref.reset();
+        }
+
+        void advance()
+        {
+            if (phase == Phase::Spill) ++spillIt;
+            else if (phase != Phase::End) ++slot;
+            settle();
+        }
+    };
+
+    IdTable() = default;
+    IdTable(const IdTable&) = delete;
+    IdTable& operator=(const IdTable&) = delete;
+
+    iterator begin()
+    {
+        iterator it(this, iterator::Phase::Positive, 0, 0);
+        it.settle();
+        return it;
+    }
+
+    iterator end() { return iterator(this, iterator::Phase::End, 0, 0); }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Return a pointer to the entry for `id`, or nullptr if absent. Never allocates.
+    T* get(int id)
+    {
+        Lane& l = laneFor(id);
+        int mag = magnitude(id);
+        if (Page* p = l.pageFor(mag))
+        {
+            auto& s = p->slots[mag & (kPageSize - 1)];
+            if (s) return &*s;
+        }
+        if (spill.empty()) return nullptr;
+        auto it = spill.find(id);
+        return it == spill.end() ? nullptr : &it->second;
+    }
+
+    const T* get(int id) const
+    {
+        return const_cast<IdTable*>(this)->get(id);
+    }
+
+    iterator find(int id)
+    {
+        Lane& l = laneFor(id);
+        int mag = magnitude(id);
+        if (Page* p = l.pageFor(mag))
+        {
+            int sl = mag & (kPageSize - 1);
+            if (p->slots[sl])
+            {
+                iterator it(this, id >= 0 ? iterator::Phase::Positive : iterator::Phase::Negative,
+                            static_cast<std::size_t>((mag >> kPageBits) - l.basePage), sl);
+                it.settle();
+                return it;
+            }
+        }
+        auto sit = spill.find(id);
+        if (sit == spill.end()) return end();
+        return iterator(this, sit);
+    }
+
+    // Return the entry for `id`, default-constructing it if absent.
+    T& operator[](int id)
+    {
+        if (T* e = get(id)) return *e;
+        return emplace(id, T());
+    }
+
+    // Insert or overwrite the entry for `id`.
+    T& assign(int id, T value)
+    {
+        if (T* e = get(id))
+        {
+            *e = std::move(value);
+            return *e;
+        }
+        return emplace(id, std::move(value));
+    }
+
+    bool erase(int id)
+    {
+        Lane& l = laneFor(id);
+        int mag = magnitude(id);
+        if (Page* p = l.pageFor(mag))
+        {
+            auto& s = p->slots[mag & (kPageSize - 1)];
+            if (s)
+            {
+                s.reset();
+                --count;
+                l.release(mag >> kPageBits);
+                return true;
+            }
+        }
+        if (spill.erase(id) > 0)
+        {
+            --count;
+            return true;
+        }
+        return false;
+    }
+
+    void erase(const iterator& it)
+    {
+        if (it.phase == iterator::Phase::End) return;
+        if (it.phase == iterator::Phase::Spill)
+        {
+            spill.erase(it.spillIt);
+            --count;
+            return;
+        }
+        erase(it.ref->first);
+    }
+
+    void clear()
+    {
+        positive.clear();
+        negative.clear();
+        spill.clear();
+        count = 0;
+    }
+
+private:
+    Lane positive;                      // IDs >= 0, indexed by id
+    Lane negative;                      // IDs < 0, indexed by -id
+    std::unordered_map<int, T> spill;   // Outliers outside the dense window
+    std::size_t count = 0;
+
+    Lane& laneFor(int id) { return id >= 0 ? positive : negative; }
+    // Index within a lane; -1 for INT_MIN, which has no lane slot and always spills.
+    static int magnitude(int id)
+    {
+        if (id >= 0) return id;
+        return id == std::numeric_limits<int>::min() ? -1 : -id;
+    }
+
+    T& emplace(int id, T value)
+    {
+        ++count;
+        int mag = magnitude(id);
+        if (mag >= 0)
+        {
+            if (Page* p = laneFor(id).pageForInsert(mag))
+            {
+                auto& s = p->slots[mag & (kPageSize - 1)];
+                s.emplace(std::move(value));
+                ++p->live;
+                return *s;
+            }
+        }
+        return spill.emplace(id, std::move(value)).first->second;
+    }
+};
+
+} // namespace capnwebcpp
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+namespace capnwebcpp
+{
+
+using json = nlohmann::json;
+
+// --------------------------------------------------------------------------------------
+// Per-session memory accounting
+
+// Kinds of memory a session retains on behalf of its peer.
+enum class MemoryCategory
+{
+    Results = 0,        // Export results retained until pulled / released
+    PendingArgs,        // Method names and arguments of not-yet-evaluated operations
+    Microtasks,         // Arguments captured by queued microtasks
+    Outbound,           // Serialized frames buffered for the peer but not yet delivered
+};
+
+constexpr std::size_t kMemoryCategoryCount = 4;
+
+// Soft and hard byte limits for a single session. Zero disables the respective limit.
+// - Soft limit: new pushes are rejected (their pull yields a "ResourceExhausted" error).
+// - Hard limit: the connection is aborted; others sharing its RpcSession carry on.
+struct MemoryLimits
+{
+    std::size_t softLimit = 0;
+    std::size_t hardLimit = 0;
+};
+
+// Approximate heap footprint of a JSON value, including the node itself.
+inline std::size_t estimateJsonBytes(const json& v)
+{
+    std::size_t bytes = sizeof(json);
+    switch (v.type())
+    {
+        case json::value_t::string:
+            bytes += v.get_ref<const json::string_t&>().capacity();
+            break;
+        case json::value_t::binary:
+            bytes += v.get_binary().capacity();
+            break;
+        case json::value_t::array:
+            for (const auto& e : v) bytes += estimateJsonBytes(e);
+            break;
+        case json::value_t::object:
+            for (auto it = v.begin(); it != v.end(); ++it)
+            {
+                // Key storage plus a rough per-node overhead of the underlying map.
+                bytes += it.key().capacity() + 4 * sizeof(void*);
+                bytes += estimateJsonBytes(it.value());
+            }
+            break;
+        default:
+            break;
+    }
+    return bytes;
+}
+
+// Process-wide totals across all live MemoryAccounts, per category.
+class ProcessMemoryTotals
+{
+public:
+    static ProcessMemoryTotals& instance()
+    {
+        static ProcessMemoryTotals totals;
+        return totals;
+    }
+
+    std::size_t bytes(MemoryCategory c) const
+    {
+        return counters[static_cast<std::size_t>(c)].load(std::memory_order_relaxed);
+    }
+
+    std::size_t total() const
+    {
+        std::size_t sum = 0;
+        for (const auto& c : counters) sum += c.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    friend class MemoryAccount;
+    std::array<std::atomic<std::size_t>, kMemoryCategoryCount> counters{};
+};
+
+// Byte counters for one session. Not thread-safe by itself (a session is driven from a single
+// thread); the process-wide totals it feeds are atomic.
+class MemoryAccount
+{
+public:
+    MemoryAccount() = default;
+    MemoryAccount(const MemoryAccount&) = delete;
+    MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+    ~MemoryAccount()
+    {
+        clear();
+    }
+
+    void add(MemoryCategory c, std::size_t n)
+    {
+        if (n == 0) return;
+        bytesByCategory[index(c)] += n;
+        global()[index(c)].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void sub(MemoryCategory c, std::size_t n)
+    {
+        auto& cur = bytesByCategory[index(c)];
+        if (n > cur) n = cur;
+        if (n == 0) return;
+        cur -= n;
+        global()[index(c)].fetch_sub(n, std::memory_order_relaxed);
+    }
+
+    // Replace a category's value (for gauges such as a socket's buffered amount).
+    void set(MemoryCategory c, std::size_t n)
+    {
+        std::size_t cur = bytesByCategory[index(c)];
+        if (n > cur) add(c, n - cur);
+        else sub(c, cur - n);
+    }
+
+    void clear(MemoryCategory c)
+    {
+        sub(c, bytesByCategory[index(c)]);
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < kMemoryCategoryCount; ++i)
+            clear(static_cast<MemoryCategory>(i));
+    }
+
+    std::size_t bytes(MemoryCategory c) const { return bytesByCategory[index(c)]; }
+
+    std::size_t total() const
+    {
+        std::size_t sum = 0;
+        for (auto b : bytesByCategory) sum += b;
+        return sum;
+    }
+
+private:
+    std::array<std::size_t, kMemoryCategoryCount> bytesByCategory{};
+
+    static std::size_t index(MemoryCategory c) { return static_cast<std::size_t>(c); }
+    static std::array<std::atomic<std::size_t>, kMemoryCategoryCount>& global()
+    {
+        return ProcessMemoryTotals::instance().counters;
+    }
+};
+
+} // namespace capnwebcpp
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "capnwebcpp/protocol.h"
+
+namespace capnwebcpp
+{
+
+// --------------------------------------------------------------------------------------
+// Process-wide metrics
+//
+// Counters are sharded across cache lines; each thread is assigned a shard on first use, so
+// recording is a single relaxed atomic add without cross-thread contention. Reads (scrapes)
+// sum all shards.
+
+constexpr std::size_t kMetricShards = 16;
+
+inline std::size_t metricShardIndex()
+{
+    static std::atomic<std::size_t> next{ 0 };
+    thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return index;
+}
+
+// Monotonic or up/down value sharded per thread.
+class ShardedCounter
+{
+public:
+    void add(std::int64_t n = 1)
+    {
+        shards[metricShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void sub(std::int64_t n = 1) { add(-n); }
+
+    std::int64_t value() const
+    {
+        std::int64_t sum = 0;
+        for (const auto& s : shards) sum += s.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<std::int64_t> value{ 0 };
+    };
+    std::array<Shard, kMetricShards> shards;
+};
+
+// Latency histogram with fixed bucket bounds (microseconds).
+class LatencyHistogram
+{
+public:
+    static constexpr std::array<std::int64_t, 14> kBoundsMicros = {
+        50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+    };
+
+    void record(std::chrono::nanoseconds elapsed)
+    {
+        std::int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        std::size_t i = 0;
+        while (i < kBoundsMicros.size() && micros > kBoundsMicros[i]) ++i;
+        buckets[i].add();
+        sumNanos.add(elapsed.count());
+    }
+
+    // Non-cumulative bucket counts; the last bucket is +Inf.
+    std::array<ShardedCounter, kBoundsMicros.size() + 1> buckets;
+    ShardedCounter sumNanos;
+};
+
+// Per-method handler statistics. One instance per (thread, method); only its owning thread
+// writes to it. When the thread exits its counts are folded into retained totals and the
+// instance is freed.
+struct MethodCounters
+{
+    explicit MethodCounters(std::string method) : method(std::move(method)) {}
+
+    const std::string method;
+    std::atomic<std::int64_t> calls{ 0 };
+    std::atomic<std::int64_t> errors{ 0 };
+    std::atomic<std::int64_t> nanos{ 0 };
+};
+
+class Metrics
+{
+public:
+    static Metrics& instance()
+    {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    // Recording can be switched off process-wide (e.g. in benchmarks).
+    static bool enabled() { return instance().on.load(std::memory_order_relaxed); }
+    void setEnabled(bool value) { on.store(value, std::memory_order_relaxed); }
+
+    void recordInbound(protocol::MessageType type, std::size_t bytes)
+    {
+        if (!on.load(std::memory_order_relaxed)) return;
+        messagesIn[index(type)].add();
+        bytesIn.add(static_cast<std::int64_t>(bytes));
+    }
+
+    void recordOutbound(protocol::MessageType type, std::size_t bytes)
+    {
+        if (!on.load(std::memory_order_relaxed)) return;
+        messagesOut[index(type)].add();
+        bytesOut.add(static_cast<std::int64_t>(bytes));
+    }
+
+    void recordMethod(const std::string& method, std::chrono::nanoseconds elapsed, bool error)
+    {
+        MethodCounters& c = methodCounters(method);
+        c.calls.fetch_add(1, std::memory_order_relaxed);
+        c.nanos.fetch_add(elapsed.count(), std::memory_order_relaxed);
+        if (error) c.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Counters for `method` owned by the calling thread. Distinct method labels are capped at
+    // kMaxMethodLabels; further names are folded into "_other".
+    MethodCounters& methodCounters(const std::string& method);
+
+    // Live per-thread method counter instances; those of exited threads are freed.
+    std::size_t methodCounterInstances() const
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        return methodShards.size();
+    }
+
+    // Render all metrics in the Prometheus text exposition format (version 0.0.4).
+    std::string renderPrometheus() const;
+
+    static constexpr std::size_t kMessageTypes = static_cast<std::size_t>(protocol::MessageType::Unknown) + 1;
+    static constexpr std::size_t kMaxMethodLabels = 256;
+
+    std::array<ShardedCounter, kMessageTypes> messagesIn;
+    std::array<ShardedCounter, kMessageTypes> messagesOut;
+    ShardedCounter bytesIn;
+    ShardedCounter bytesOut;
+    LatencyHistogram pullLatency;
+    ShardedCounter microtaskQueueDepth;     // Gauge
+    ShardedCounter liveSessions;            // Gauge
+    ShardedCounter liveExports;             // Gauge
+    ShardedCounter liveImports;             // Gauge
+
+private:
+    Metrics() = default;
+
+    static std::size_t index(protocol::MessageType type) { return static_cast<std::size_t>(type); }
+
+    // The calling thread's method counters; retires them when the thread exits.
+    struct ThreadMethodCounters;
+
+    struct MethodTotals
+    {
+        std::int64_t calls = 0;
+        std::int64_t errors = 0;
+        std::int64_t nanos = 0;
+    };
+
+    // Fold `counters` into retiredMethods and drop them from methodShards.
+    void retireMethodCounters(const std::vector<MethodCounters*>& counters);
+
+    std::atomic<bool> on{ true };
+    mutable std::mutex mu;                  // Guards registration of per-thread method counters
+    std::vector<std::unique_ptr<MethodCounters>> methodShards;
+    std::unordered_map<std::string, MethodTotals> retiredMethods;  // Counts of exited threads
+    std::unordered_set<std::string> methodNames;
+    std::atomic<bool> methodNamesFull{ false };  // Set once methodNames reaches kMaxMethodLabels
+};
+
+// Measures a handler invocation and records it under `method` when destroyed. A handler
+// leaving by exception is counted as an error.
+class ScopedMethodTimer
+{
+public:
+    explicit ScopedMethodTimer(const std::string& method)
+        : method(Metrics::enabled() ? &method : nullptr), exceptions(std::uncaught_exceptions())
+    {
+        if (this->method) start = std::chrono::steady_clock::now();
+    }
+
+    ScopedMethodTimer(const ScopedMethodTimer&) = delete;
+    ScopedMethodTimer& operator=(const ScopedMethodTimer&) = delete;
+
+    ~ScopedMethodTimer()
+    {
+        if (method)
+        {
+            bool failed = std::uncaught_exceptions() > exceptions;
+            Metrics::instance().recordMethod(*method, std::chrono::steady_clock::now() - start, failed);
+        }
+    }
+
+private:
+    const std::string* method;
+    int exceptions;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace capnwebcpp
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "capnwebcpp/metrics.h"
+
+namespace capnwebcpp
+{
+
+// Serve the process-wide metrics in the Prometheus text format at `path`.
+template<typename App>
+void setupMetricsEndpoint(App& app, const std::string& path)
+{
+    app.get(path, [](auto* res, auto*)
+    {
+        std::string body = Metrics::instance().renderPrometheus();
+        res->writeHeader("Content-Type", "text/plain; version=0.0.4");
+        res->end(body);
+    });
+}
+
+} // namespace capnwebcpp
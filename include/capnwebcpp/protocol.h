@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <nlohmann/json.hpp>
 
 namespace capnwebcpp
@@ -31,9 +32,9 @@ struct Message
     json params = json::array();
 };
 
-// Parse a raw JSON string (one message) into a Message.
-// Returns true on success; false otherwise.
-bool parse(const std::string& text, Message& out);
+// Parse a raw JSON string (one message) into a Message. `text` is read in place; it need not
+// outlive the call. Returns true on success; false otherwise.
+bool parse(std::string_view text, Message& out);
 
 // Serialize a Message into a raw JSON string.
 // Note: Does not transform payloads (e.g. array escaping) — only frames the message array.
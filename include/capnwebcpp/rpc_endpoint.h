@@ -18,56 +18,188 @@
 namespace capnwebcpp
 {
 
+// Per-endpoint session settings applied to every WebSocket connection and HTTP batch.
+struct RpcEndpointOptions
+{
+    MemoryLimits memoryLimits;      // Memory each connection / batch may retain
+    ExportIdlePolicy idlePolicy;    // Reclamation of unreleased exports (WebSocket sessions)
+
+    // WebSocket backpressure. Above `sendHighWaterMark` undelivered bytes a connection stops
+    // executing inbound frames until its socket drains (zero disables). A connection whose
+    // buffered output exceeds `maxBackpressure` is closed.
+    std::size_t sendHighWaterMark = 1024 * 1024;
+    std::size_t maxBackpressure = 16 * 1024 * 1024;
+
+    // WebSocket frames. `compression` selects permessage-deflate and its compressor and window
+    // sizes, e.g. uWS::SHARED_COMPRESSOR or
+    // uWS::CompressOptions(uWS::DEDICATED_COMPRESSOR_32KB | uWS::DEDICATED_DECOMPRESSOR_32KB).
+    // Outbound frames smaller than `compressMinBytes` are sent uncompressed; deflate gains
+    // little on short frames and costs a compressor pass each. Inbound frames larger than
+    // `maxPayloadLength` close the connection.
+    uWS::CompressOptions compression = uWS::DISABLED;
+    std::size_t compressMinBytes = 1024;
+    unsigned int maxPayloadLength = 16 * 1024;
+};
+
+// Close a connection whose transport asked for it (dropped frame or abort). Must be called only
+// once nothing on the stack still uses the connection's session data: the close handler runs
+// synchronously and tears it down.
+template<typename WebSocket>
+void closeIfRequested(WebSocket* ws)
+{
+    using Transport = UwsWebSocketTransport<WebSocket*>;
+    auto* transport = static_cast<Transport*>(ws->getUserData()->transport.get());
+    if (!transport) return;
+    switch (transport->closeRequest())
+    {
+    case Transport::CloseRequest::Dropped:
+        ws->end(1011, "backpressure limit exceeded");
+        break;
+    case Transport::CloseRequest::Aborted:
+        ws->close();
+        break;
+    case Transport::CloseRequest::None:
+        break;
+    }
+}
+
+// WebSocket connections with releases queued during the current event loop iteration. A loop
+// post handler flushes each once per iteration, so all frames read in one iteration share one
+// set of release frames.
+template<typename WebSocket>
+class ReleaseFlushQueue
+{
+public:
+    static ReleaseFlushQueue& local()
+    {
+        thread_local ReleaseFlushQueue queue;
+        return queue;
+    }
+
+    void schedule(WebSocket ws)
+    {
+        PendingReleases& releases = ws->getUserData()->releases;
+        if (releases.empty() || releases.scheduled)
+            return;
+        releases.scheduled = true;
+        if (!registered)
+        {
+            registered = true;
+            uWS::Loop::get()->addPostHandler(this, [this](uWS::Loop*) { flush(); });
+        }
+        sockets.push_back(ws);
+    }
+
+    // Forget a closing connection.
+    void cancel(WebSocket ws)
+    {
+        if (ws->getUserData()->releases.scheduled)
+            std::erase(sockets, ws);
+    }
+
+private:
+    std::vector<WebSocket> sockets;
+    bool registered = false;
+
+    void flush()
+    {
+        if (sockets.empty())
+            return;
+        std::vector<WebSocket> pending;
+        pending.swap(sockets);
+        for (WebSocket ws : pending)
+        {
+            auto* userData = ws->getUserData();
+            try { flushReleases(userData, *userData->transport); } catch (...) {}
+            closeIfRequested(ws);
+        }
+    }
+};
+
+// Run `fn` for a WebSocket connection; on error abort the session. The socket is closed after
+// `fn` unwinds if its transport asked for it.
+template<typename WebSocket, typename Fn>
+void runWebSocketHandler(RpcSession& session, WebSocket* ws, Fn&& fn)
+{
+    auto* userData = ws->getUserData();
+    try
+    {
+        fn();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error processing message: " << e.what() << std::endl;
+        // Attempt to notify the peer and local listeners about the fatal error.
+        try
+        {
+            auto err = serialize::makeError("ServerError", std::string(e.what()));
+            userData->transport->send(session.buildAbort(err));
+            userData->transport->abort("server error");
+        }
+        catch (...) {}
+        session.markAborted(userData, std::string(e.what()));
+    }
+    closeIfRequested(ws);
+}
+
 // Helper to set up RPC endpoint with uWebSockets (WebSocket + HTTP POST).
 template<typename App>
-void setupRpcEndpoint(App& app, const std::string& path, std::shared_ptr<RpcTarget> target)
+void setupRpcEndpoint(App& app, const std::string& path, std::shared_ptr<RpcTarget> target,
+                      const RpcEndpointOptions& options = {})
 {
     auto session = std::make_shared<RpcSession>(target);
+    session->setMemoryLimits(options.memoryLimits);
+    session->setExportIdlePolicy(options.idlePolicy);
+    MemoryLimits limits = options.memoryLimits;
+    std::size_t highWaterMark = options.sendHighWaterMark;
+    // Ignored by uWS on connections without negotiated compression.
+    std::size_t compressMinBytes = options.compressMinBytes;
 
     // WebSocket endpoint.
     app.template ws<RpcSessionData>(path,
     {
-        .open = [session, target](auto* ws)
+        .compression = options.compression,
+        .maxPayloadLength = options.maxPayloadLength,
+        .maxBackpressure = static_cast<unsigned int>(options.maxBackpressure),
+        .closeOnBackpressureLimit = true,
+        .open = [session, target, compressMinBytes](auto* ws)
         {
             auto* userData = ws->getUserData();
             userData->target = target;
             // Persist a transport for out-of-band sends (client-call path).
-            userData->transport = std::make_shared<UwsWebSocketTransport<decltype(ws)>>(ws);
+            userData->transport = std::make_shared<UwsWebSocketTransport<decltype(ws)>>(
+                ws, &userData->memory, compressMinBytes);
             // Create a canonical local target hook for re-export parity.
             userData->localTargetHook = makeLocalTargetHook(target);
             session->onOpen(userData);
         },
-        .message = [session](auto* ws, std::string_view message, uWS::OpCode)
+        .message = [session, highWaterMark](auto* ws, std::string_view message, uWS::OpCode)
         {
-            auto* userData = ws->getUserData();
-            try
-            {
-                UwsWebSocketTransport<decltype(ws)> transport(ws);
-                pumpMessage(*session, userData, transport, std::string(message));
-                session->processTasks();
-            }
-            catch (const std::exception& e)
+            runWebSocketHandler(*session, ws, [&]()
             {
-                std::cerr << "Error processing message: " << e.what() << std::endl;
-                // Attempt to notify the peer and local listeners about the fatal error.
-                try
-                {
-                    UwsWebSocketTransport<decltype(ws)> transport(ws);
-                    auto err = serialize::makeError("ServerError", std::string(e.what()));
-                    transport.send(session->buildAbort(err));
-                    transport.abort("server error");
-                }
-                catch (...) {}
-                session->markAborted(userData, std::string(e.what()));
-            }
+                // The frame is parsed in place; the connection's transport from open() is reused.
+                auto* userData = ws->getUserData();
+                pumpInbound(*session, userData, *userData->transport, message, highWaterMark);
+                ReleaseFlushQueue<decltype(ws)>::local().schedule(ws);
+            });
         },
-        .drain = [](auto*)
+        .drain = [session, highWaterMark](auto* ws)
         {
+            auto* userData = ws->getUserData();
+            userData->memory.set(MemoryCategory::Outbound, ws->getBufferedAmount());
+            if (!userData->inbound.paused)
+                return;
+            runWebSocketHandler(*session, ws, [&]()
+            {
+                resumeInbound(*session, userData, *userData->transport, highWaterMark);
+                ReleaseFlushQueue<decltype(ws)>::local().schedule(ws);
+            });
         },
         .close = [session](auto* ws, int, std::string_view)
         {
             auto* userData = ws->getUserData();
-            // Best-effort: emit pending releases before closing.
+            ReleaseFlushQueue<decltype(ws)>::local().cancel(ws);
+            // Best-effort: emit pending releases (including queued ones) before closing.
             try
             {
                 UwsWebSocketTransport<decltype(ws)> transport(ws);
@@ -79,7 +211,7 @@ void setupRpcEndpoint(App& app, const std::string& path, std::shared_ptr<RpcTarg
     });
 
     // HTTP POST endpoint for batch RPC.
-    app.post(path, [target](auto* res, auto*)
+    app.post(path, [target, limits](auto* res, auto*)
     {
         std::string body;
 
@@ -88,7 +220,7 @@ void setupRpcEndpoint(App& app, const std::string& path, std::shared_ptr<RpcTarg
             std::cerr << "HTTP request aborted" << std::endl;
         });
 
-        res->onData([res, target, body = std::move(body)](std::string_view data, bool isEnd) mutable
+        res->onData([res, target, limits, body = std::move(body)](std::string_view data, bool isEnd) mutable
         {
             body.append(data);
 
@@ -96,36 +228,23 @@ void setupRpcEndpoint(App& app, const std::string& path, std::shared_ptr<RpcTarg
             {
                 try
                 {
-                    // Use a fresh session per HTTP batch to avoid cross-request state.
-                    RpcSession sessionLocal(target);
-                    RpcSessionData sessionData;
-                    sessionData.target = target;
-                    sessionData.exporter.reset();
+                    // Use a clean session per HTTP batch to avoid cross-request state; sessions
+                    // come from a per-thread pool and are cleared on return.
+                    auto lease = BatchSessionPool::local().acquire(target);
+                    lease->session.setMemoryLimits(limits);
 
-                    // Accumulate all outbound messages using a transport adapter, to match capnweb's
+                    // All outbound messages accumulate in the lease's outbox, to match capnweb's
                     // batch semantics where the server returns all responses at once after drain().
-                    std::vector<std::string> outbox;
-                    auto transportPtr = std::make_shared<AccumTransport>(outbox);
-                    // Make the transport available to the session (for remap export-capture calls).
-                    sessionData.transport = transportPtr;
-
-                    std::istringstream stream(body);
-                    std::string line;
-                    while (std::getline(stream, line))
-                    {
-                        if (line.empty()) continue;
-                        pumpMessage(sessionLocal, &sessionData, *transportPtr, line);
-                        sessionLocal.processTasks();
-                    }
-
-                    // Ensure the session has drained outstanding pulls before ending; then return
-                    // all accumulated messages as newline-delimited body.
-                    sessionLocal.drain(&sessionData);
+                    lease->run(body);
 
                     res->writeHeader("Content-Type", "text/plain");
                     res->writeHeader("Access-Control-Allow-Origin", "*");
 
+                    const auto& outbox = lease->outbox;
+                    std::size_t size = 0;
+                    for (const auto& m : outbox) size += m.size() + 1;
                     std::string responseBody;
+                    responseBody.reserve(size);
                     for (size_t i = 0; i < outbox.size(); ++i)
                     {
                         if (i > 0) responseBody += "\n";
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include <nlohmann/json.hpp>
@@ -9,7 +11,9 @@
 #include <deque>
 
 #include "capnwebcpp/rpc_target.h"
+#include "capnwebcpp/metrics.h"
 #include "capnwebcpp/protocol.h"
+#include "capnwebcpp/serialize.h"
 #include "capnwebcpp/session_state.h"
 
 namespace capnwebcpp
@@ -33,8 +37,38 @@ public:
     // - Not applied when merely forwarding a peer-provided reject (e.g., forwarded client errors).
     void setOnSendError(std::function<json(const json&)> cb) { onSendError = std::move(cb); }
 
+    // Optional: per-session memory limits, checked against RpcSessionData::memory on each inbound
+    // message. Over the soft limit new pushes are rejected with a "ResourceExhausted" error;
+    // over the hard limit that connection is aborted.
+    void setMemoryLimits(const MemoryLimits& limits) { memoryLimits = limits; }
+    const MemoryLimits& getMemoryLimits() const { return memoryLimits; }
+
+    // Optional: reclaim exports the peer never released (see ExportIdlePolicy). Sweeps run
+    // opportunistically from handleMessage(); reclaimIdleExports() forces one.
+    void setExportIdlePolicy(const ExportIdlePolicy& policy) { idlePolicy = policy; }
+    const ExportIdlePolicy& getExportIdlePolicy() const { return idlePolicy; }
+
+    // Optional: resolve non-negative pipeline IDs in remap mappers as mapper variables only, as
+    // capnweb does (see serialize::Evaluator::MapperScope). By default an ID that is not a mapper
+    // variable names the session export.
+    void setMapperScope(serialize::Evaluator::MapperScope scope) { mapperScope = scope; }
+
+    // Drop exports that are orphaned under the idle policy as of `now`, unwinding their target
+    // registrations and releasing captured client references. Returns the number reclaimed.
+    std::size_t reclaimIdleExports(RpcSessionData* sessionData,
+                                   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
     // Handle incoming message; returns a response (possibly empty).
-    std::string handleMessage(RpcSessionData* sessionData, const std::string& message);
+    std::string handleMessage(RpcSessionData* sessionData, std::string_view message);
+    // Same, for a message the caller has already parsed.
+    std::string handleMessage(RpcSessionData* sessionData, const protocol::Message& message);
+    // Same, returning the response unserialized (type Unknown when there is none). For transports
+    // that pass message values instead of text.
+    protocol::Message handleMessageValue(RpcSessionData* sessionData, const protocol::Message& message);
+
+    // Return the session to its freshly constructed state, bound to `target`. Configuration
+    // (error callback, memory limits, idle policy, mapper scope) is reset as well. Used by pooled sessions.
+    void reset(std::shared_ptr<RpcTarget> newTarget);
 
     // Connection lifecycle hooks.
     void onOpen(RpcSessionData* sessionData);
@@ -42,7 +76,10 @@ public:
 
     // Lifecycle: return true if there are no outstanding pulls to resolve.
     bool isDrained() const { return pullCount == 0 && pendingMicrotasks == 0; }
-    bool isAborted() const { return aborted; }
+    // True once the session or any of its connections aborted. Given a connection, whether that
+    // connection has stopped running frames.
+    bool isAborted() const { return aborted || connectionAborted; }
+    bool isAborted(const RpcSessionData* sessionData) const { return aborted || (sessionData && sessionData->aborted); }
 
     // Internal onBroken registration (reserved for future use).
     void registerOnBroken(std::function<void(const std::string&)> cb) { onBrokenCallbacks.push_back(std::move(cb)); }
@@ -50,13 +87,21 @@ public:
     // Build a serialized abort frame with the given error payload.
     // Intended to be sent to the peer prior to closing the connection.
     std::string buildAbort(const json& errorPayload);
+    // Same, unserialized.
+    protocol::Message buildAbortMessage(const json& errorPayload);
 
     // Mark session aborted locally and notify registered onBroken callbacks.
     void markAborted(const std::string& reason);
-    // Overload with access to sessionData for deeper cleanup (tables, queues).
+    // Abort one connection only: its tables and queued microtasks are dropped and its frames
+    // ignored from then on, while other connections sharing the session carry on.
     void markAborted(RpcSessionData* sessionData, const std::string& reason);
 
-    // Emit release frames for any imported client refs associated with outstanding exports.
+    // Abort the session if it exceeds the hard memory limit; returns the abort message to send, or
+    // an Unknown message if the session is within limits.
+    protocol::Message enforceHardMemoryLimit(RpcSessionData* sessionData);
+
+    // Emit release frames for any imported client refs associated with outstanding exports, plus
+    // releases still queued in sessionData->releases; one frame per import ID.
     void emitPendingReleases(RpcSessionData* sessionData, RpcTransport& transport);
 
     // ----------------------------------------------------------------------------
@@ -67,6 +112,13 @@ public:
     {
         int imports = 0;
         int exports = 0;
+
+        // Bytes retained for the peer (see MemoryCategory).
+        std::size_t resultBytes = 0;
+        std::size_t pendingArgBytes = 0;
+        std::size_t microtaskBytes = 0;
+        std::size_t outboundBytes = 0;
+        std::size_t totalBytes = 0;
     };
 
     // Compute stats (counts of active imports / exports) from session state.
@@ -99,17 +151,32 @@ public:
     // returned negative export ID. Does not send any messages; the peer will resolve proactively.
     int awaitClientPromise(RpcSessionData* sessionData, int importId);
 
+    // Export `target` outside of any result, e.g. for a client to pass as a call argument, and
+    // return its ["export", id] expression. Each call adds one reference for the peer to release;
+    // a target keeps the same ID while exported.
+    json exportLocalTarget(RpcSessionData* sessionData, std::shared_ptr<RpcTarget> target);
+
 private:
     std::shared_ptr<RpcTarget> target;
 
     // Lifecycle state
     int pullCount = 0;
-    bool aborted = false;
+    bool aborted = false;               // Session-wide abort: no connection runs frames
+    bool connectionAborted = false;     // Some connection aborted (see RpcSessionData::aborted)
     std::vector<std::function<void(const std::string&)>> onBrokenCallbacks;
     std::function<json(const json&)> onSendError;
+    MemoryLimits memoryLimits;
+    ExportIdlePolicy idlePolicy;
+    serialize::Evaluator::MapperScope mapperScope = serialize::Evaluator::MapperScope::LegacySessionRefs;
 
-    // Microtask queue for deferred operation resolution (simulated async).
-    std::deque<std::function<void()>> microtasks;
+    // Microtask queue for deferred operation resolution (simulated async). Each task belongs to
+    // the connection that queued it.
+    struct Microtask
+    {
+        RpcSessionData* owner;
+        std::function<void()> fn;
+    };
+    std::deque<Microtask> microtasks;
     int pendingMicrotasks = 0;
 
 public:
@@ -118,20 +185,47 @@ public:
     {
         while (!microtasks.empty())
         {
-            auto fn = std::move(microtasks.front());
+            auto fn = std::move(microtasks.front().fn);
             microtasks.pop_front();
+            Metrics::instance().microtaskQueueDepth.sub();
             try { fn(); } catch (...) {}
             if (pendingMicrotasks > 0) --pendingMicrotasks;
         }
     }
 
 private:
-    void enqueueTask(std::function<void()> fn)
+    void enqueueTask(RpcSessionData* owner, std::function<void()> fn)
     {
-        microtasks.emplace_back(std::move(fn));
+        microtasks.push_back(Microtask{ owner, std::move(fn) });
         ++pendingMicrotasks;
+        Metrics::instance().microtaskQueueDepth.add();
     }
 
+    bool overSoftMemoryLimit(const RpcSessionData* sessionData) const
+    {
+        return memoryLimits.softLimit > 0 && sessionData->memory.total() > memoryLimits.softLimit;
+    }
+
+    void maybeReclaimIdleExports(RpcSessionData* sessionData);
+
+    // Drop queued microtasks (reset), or only those of `owner` (abort / close).
+    void clearMicrotasks();
+    void clearMicrotasks(RpcSessionData* owner);
+
+    // Route a parsed message to its handler; returns the response (type Unknown when none).
+    protocol::Message dispatchMessage(RpcSessionData* sessionData, const protocol::Message& m);
+
+    // Canonical hook for the session's main target, created on first use.
+    std::shared_ptr<StubHook> mainTargetHook(RpcSessionData* sessionData);
+
+    // Allocate (or reuse) the export ID for a stub or promise appearing in a result.
+    int exportForResult(RpcSessionData* sessionData, bool isPromise, const json& payload);
+    // Hook for a call on a push's result: the stub that result holds at `path`; throws when
+    // there is none.
+    std::shared_ptr<StubHook> pipelinedCallHook(RpcSessionData* sessionData, int importId, const json& path);
+    // Drop the target registration bound to a removed export.
+    void unregisterTarget(RpcSessionData* sessionData, std::uintptr_t targetKey, int exportId);
+
     void handlePush(RpcSessionData* sessionData, const json& pushData);
     protocol::Message handlePull(RpcSessionData* sessionData, int exportId);
     void handleRelease(RpcSessionData* sessionData, int exportId, int refcount);
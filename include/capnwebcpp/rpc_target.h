@@ -1,9 +1,15 @@
 #pragma once
 
+#include <cstddef>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 
 #include <nlohmann/json.hpp>
 
@@ -35,8 +41,123 @@ protected:
         methods[name] = handler;
     }
 
+    // Register a member function with typed parameters, e.g.
+    //   method("getUserProfile", &UserServer::getUserProfile);
+    // Each parameter is decoded from its position in the argument array (a lone non-array
+    // argument counts as the first) with nlohmann::json's conversions, so user types only need
+    // from_json/to_json. `const json&`, `const std::string&` and `std::string_view` parameters
+    // refer into the arguments without a copy; std::optional<T> parameters may be missing or
+    // null. Extra arguments are ignored. The result is converted to json (void gives null).
+    template<typename Self, typename R, typename... Args>
+    void method(const std::string& name, R (Self::*fn)(Args...))
+    {
+        static_assert(std::is_base_of_v<RpcTarget, Self>, "method() must be a member of this target");
+        Self* self = static_cast<Self*>(this);
+        methods[name] = [name, self, fn](const json& args) -> json
+        {
+            return invoke(name, args, [self, fn](auto&&... a) -> R
+            {
+                return (self->*fn)(std::forward<decltype(a)>(a)...);
+            }, std::type_identity<R(Args...)>{}, std::index_sequence_for<Args...>{});
+        };
+    }
+
+    template<typename Self, typename R, typename... Args>
+    void method(const std::string& name, R (Self::*fn)(Args...) const)
+    {
+        static_assert(std::is_base_of_v<RpcTarget, Self>, "method() must be a member of this target");
+        const Self* self = static_cast<const Self*>(this);
+        methods[name] = [name, self, fn](const json& args) -> json
+        {
+            return invoke(name, args, [self, fn](auto&&... a) -> R
+            {
+                return (self->*fn)(std::forward<decltype(a)>(a)...);
+            }, std::type_identity<R(Args...)>{}, std::index_sequence_for<Args...>{});
+        };
+    }
+
 private:
     std::unordered_map<std::string, std::function<json(const json&)>> methods;
+
+    template<typename T> struct IsOptional : std::false_type {};
+    template<typename T> struct IsOptional<std::optional<T>> : std::true_type {};
+
+    // Decode the arguments, call, and encode the result.
+    template<typename Call, typename R, typename... Args, std::size_t... I>
+    static json invoke(const std::string& name, const json& args, Call&& call,
+                       std::type_identity<R(Args...)>, std::index_sequence<I...>)
+    {
+        if constexpr (std::is_void_v<R>)
+        {
+            call(decodeArg<Args>(name, argAt(args, I), I)...);
+            return json();
+        }
+        else
+        {
+            return json(call(decodeArg<Args>(name, argAt(args, I), I)...));
+        }
+    }
+
+    // Argument `index`, or null when missing.
+    static const json* argAt(const json& args, std::size_t index)
+    {
+        if (args.is_array())
+            return index < args.size() ? &args[index] : nullptr;
+        if (index == 0 && !args.is_null())
+            return &args;
+        return nullptr;
+    }
+
+    static std::invalid_argument badArgument(const std::string& name, std::size_t index, const std::string& reason)
+    {
+        return std::invalid_argument(name + ": argument " + std::to_string(index + 1) + ": " + reason);
+    }
+
+    static const std::string& stringRef(const std::string& name, const json& arg, std::size_t index)
+    {
+        if (!arg.is_string())
+            throw badArgument(name, index, std::string("type must be string, but is ") + arg.type_name());
+        return arg.get_ref<const std::string&>();
+    }
+
+    // Value (or reference into the arguments) passed for a parameter declared as P.
+    template<typename P>
+    static decltype(auto) decodeArg(const std::string& name, const json* arg, std::size_t index)
+    {
+        static_assert(!std::is_lvalue_reference_v<P> || std::is_const_v<std::remove_reference_t<P>>,
+                      "method() parameters must be values or const references");
+        using T = std::remove_cvref_t<P>;
+        if constexpr (IsOptional<T>::value)
+        {
+            if (!arg || arg->is_null())
+                return T();
+            return T(decodeArg<typename T::value_type>(name, arg, index));
+        }
+        else
+        {
+            if (!arg)
+                throw std::invalid_argument(name + ": missing argument " + std::to_string(index + 1));
+            try
+            {
+                if constexpr (std::is_same_v<T, json>)
+                    return static_cast<const json&>(*arg);
+                else if constexpr (std::is_same_v<T, std::string_view>)
+                    return std::string_view(stringRef(name, *arg, index));
+                else if constexpr (std::is_same_v<T, std::string> && std::is_reference_v<P>)
+                    return stringRef(name, *arg, index);
+                else
+                    return arg->get<T>();
+            }
+            catch (const json::exception& e)
+            {
+                // Drop nlohmann's "[json.exception.type_error.302] " prefix.
+                std::string reason = e.what();
+                auto end = reason.find("] ");
+                if (end != std::string::npos) reason.erase(0, end + 2);
+                throw badArgument(name, index, reason);
+            }
+        }
+    }
 };
 
 } // namespace capnwebcpp
@@ -14,6 +14,7 @@ namespace serialize
 
 // Wraps arrays in an outer single-element array to escape them per protocol.
 json wrapArrayIfNeeded(const json& value);
+json wrapArrayIfNeeded(json&& value);
 
 // Build an error tuple: ["error", name, message] (stack optional, omitted for now).
 json makeError(const std::string& name, const std::string& message);
@@ -41,20 +42,27 @@ public:
     using Cacher = std::function<void(int /*exportId*/, const json& /*result*/)>;
     using ExportCaller = std::function<json(int /*exportId*/, const json& /*path*/, const json& /*args*/)>;
 
+    // What ["pipeline", n] with n >= 0 names inside a remap mapper. LegacySessionRefs (default):
+    // session export n when there is no such variable, as this server has always resolved it.
+    // Strict: mapper variable n only, out-of-range IDs are rejected, as in capnweb.
+    enum class MapperScope { Strict, LegacySessionRefs };
+
     // Evaluate a value tree, resolving any ["pipeline", exportId, path?] references by using
     // callbacks to fetch or compute results, then traversing property paths.
     static json evaluateValue(const json& value,
                               const ResultGetter& getResult,
                               const OperationGetter& getOperation,
                               const Dispatcher& dispatch,
-                              const Cacher& cache);
+                              const Cacher& cache,
+                              MapperScope scope = MapperScope::LegacySessionRefs);
 
     static json evaluateValueWithCaller(const json& value,
                               const ResultGetter& getResult,
                               const OperationGetter& getOperation,
                               const Dispatcher& dispatch,
                               const Cacher& cache,
-                              const ExportCaller& callExport);
+                              const ExportCaller& callExport,
+                              MapperScope scope = MapperScope::LegacySessionRefs);
 };
 
 // --------------------------------------------------------------------------------------
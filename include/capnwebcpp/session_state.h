@@ -1,11 +1,18 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "capnwebcpp/id_table.h"
+#include "capnwebcpp/memory_accounting.h"
+#include "capnwebcpp/metrics.h"
 #include "capnwebcpp/rpc_target.h"
 #include "capnwebcpp/stub_hook.h"
 
@@ -18,6 +25,30 @@ using json = nlohmann::json;
 // --------------------------------------------------------------------------------------
 // Importer / Exporter roles (session state separation)
 
+// Cold part of an export entry: result values, pending operation and call routing. Kept out of
+// line so table scans and refcount updates only touch the compact ExportEntry header.
+struct ExportPayload
+{
+    json result;                      // Valid if ExportEntry::hasResult
+    std::string method;               // Valid if ExportEntry::hasOperation
+    json args;                        // Valid if ExportEntry::hasOperation
+
+    // Hook on which to dispatch calls for this export (for server-originated exports/stubs).
+    std::shared_ptr<StubHook> callHook;
+
+    // Imported client references (IDs provided by the client in args/captures) used during this
+    // export's lifetime. Will be released back to the client ("release" frames) when the export
+    // completes (on pull resolution or reject).
+    std::unordered_map<int, int> importedClientIds; // id -> refcount
+
+    // targetExportId / targetRegistry key bound to this export (0 if none); unwound on removal.
+    std::uintptr_t targetKey = 0;
+
+    // Bytes currently charged to the session's MemoryAccount for `result` and `method`/`args`.
+    std::size_t resultBytes = 0;
+    std::size_t argsBytes = 0;
+};
+
 // Export table entry, tracks either a pending operation or a computed result,
 // along with the remote refcount for release semantics.
 struct ExportEntry
@@ -25,19 +56,49 @@ struct ExportEntry
     int remoteRefcount = 1;           // Remote-held references to this export
     int localRefcount = 1;            // Local references (future use)
     bool hasResult = false;
-    json result;                      // Valid if hasResult
-
     bool hasOperation = false;
-    std::string method;               // Valid if hasOperation
-    json args;                        // Valid if hasOperation
+    bool pulled = false;              // Result has been delivered to the peer at least once
+    std::unique_ptr<ExportPayload> cold; // Allocated on first payload() access
+    std::chrono::steady_clock::time_point lastUsed{}; // Creation, pull or call via this export
+
+    ExportEntry() = default;
+    ExportEntry(ExportEntry&&) noexcept = default;
+    ExportEntry& operator=(ExportEntry&&) noexcept = default;
+
+    ExportEntry(const ExportEntry& o)
+        : remoteRefcount(o.remoteRefcount), localRefcount(o.localRefcount),
+          hasResult(o.hasResult), hasOperation(o.hasOperation), pulled(o.pulled),
+          cold(o.cold ? std::make_unique<ExportPayload>(*o.cold) : nullptr), lastUsed(o.lastUsed)
+    {
+    }
 
-    // Hook on which to dispatch calls for this export (for server-originated exports/stubs).
-    std::shared_ptr<StubHook> callHook;
+    ExportEntry& operator=(const ExportEntry& o)
+    {
+        if (this != &o) *this = ExportEntry(o);
+        return *this;
+    }
 
-    // Imported client references (IDs provided by the client in args/captures) used during this
-    // export's lifetime. Will be released back to the client ("release" frames) when the export
-    // completes (on pull resolution or reject).
-    std::unordered_map<int, int> importedClientIds; // id -> refcount
+    ExportPayload& payload()
+    {
+        if (!cold) cold = std::make_unique<ExportPayload>();
+        return *cold;
+    }
+
+    // Drop the result / operation payload; frees the cold block if nothing else lives there.
+    void clearPayload()
+    {
+        hasResult = false;
+        hasOperation = false;
+        if (!cold) return;
+        if (!cold->callHook && cold->importedClientIds.empty() && cold->targetKey == 0)
+        {
+            cold.reset();
+            return;
+        }
+        cold->result = json();
+        cold->method.clear();
+        cold->args = json();
+    }
 };
 
 // Import table entry scaffolding for future inbound exports/promises.
@@ -49,6 +110,18 @@ struct ImportEntry
     json resolution;                  // Resolved value or error tuple
 };
 
+// Reclamation of exports the peer never released. Zero disables the respective rule.
+struct ExportIdlePolicy
+{
+    // Exports whose result was pulled but which stay unreleased for this long are dropped.
+    std::chrono::milliseconds pulledTtl{0};
+    // Any export (including stubs still held by the peer) unused for this long is dropped.
+    // Pending operations are never reclaimed.
+    std::chrono::milliseconds idleTtl{0};
+
+    bool enabled() const { return pulledTtl.count() > 0 || idleTtl.count() > 0; }
+};
+
 // Manages ownership and lifecycle of server-side export entries.
 class Exporter
 {
@@ -65,16 +138,12 @@ public:
 
     ExportEntry* find(int id)
     {
-        auto it = table.find(id);
-        if (it == table.end()) return nullptr;
-        return &it->second;
+        return table.get(id);
     }
 
     const ExportEntry* find(int id) const
     {
-        auto it = table.find(id);
-        if (it == table.end()) return nullptr;
-        return &it->second;
+        return table.get(id);
     }
 
     void setOperation(int id, const std::string& method, const json& args, std::shared_ptr<StubHook> callHook)
@@ -82,37 +151,45 @@ public:
         ExportEntry entry;
         entry.remoteRefcount = 1;
         entry.hasOperation = true;
-        entry.method = method;
-        entry.args = args;
-        entry.callHook = std::move(callHook);
-        table[id] = std::move(entry);
+        auto& p = entry.payload();
+        p.method = method;
+        p.args = args;
+        p.callHook = std::move(callHook);
+        put(id, std::move(entry));
     }
 
+    // Complete a pending operation with its result.
     void setResult(int id, const json& result)
     {
-        auto it = table.find(id);
-        if (it == table.end()) return;
-        it->second.hasOperation = false;
-        it->second.hasResult = true;
-        it->second.result = result;
+        auto* e = table.get(id);
+        if (!e) return;
+        auto& p = e->payload();
+        e->hasOperation = false;
+        e->hasResult = true;
+        p.result = result;
+        p.method.clear();
+        p.args = json();
+        account(*e);
     }
 
     void cacheResult(int id, const json& result)
     {
         auto& e = table[id];
+        auto& p = e.payload();
         e.hasResult = true;
-        e.result = result;
+        p.result = result;
         e.hasOperation = false;
-        e.method.clear();
-        e.args = json();
+        p.method.clear();
+        p.args = json();
+        account(e);
     }
 
     bool getResult(int id, json& out) const
     {
-        auto it = table.find(id);
-        if (it != table.end() && it->second.hasResult)
+        auto* e = table.get(id);
+        if (e && e->hasResult)
         {
-            out = it->second.result;
+            out = e->cold->result;
             return true;
         }
         return false;
@@ -120,11 +197,11 @@ public:
 
     bool getOperation(int id, std::string& method, json& args) const
     {
-        auto it = table.find(id);
-        if (it != table.end() && it->second.hasOperation)
+        auto* e = table.get(id);
+        if (e && e->hasOperation)
         {
-            method = it->second.method;
-            args = it->second.args;
+            method = e->cold->method;
+            args = e->cold->args;
             return true;
         }
         return false;
@@ -132,33 +209,121 @@ public:
 
     void put(int id, const ExportEntry& entry)
     {
-        table[id] = entry;
+        put(id, ExportEntry(entry));
     }
 
-    void release(int id, int refcount)
+    void put(int id, ExportEntry&& entry)
     {
-        auto it = table.find(id);
-        if (it == table.end())
-            return;
+        if (auto* old = table.get(id)) unaccount(*old);
+        if (entry.cold) entry.cold->resultBytes = entry.cold->argsBytes = 0;
+        if (entry.lastUsed == std::chrono::steady_clock::time_point{})
+            entry.lastUsed = std::chrono::steady_clock::now();
+        account(table.assign(id, std::move(entry)));
+    }
+
+    // Drop the result / operation payload of an entry while keeping it for refcounting.
+    void clearPayload(int id)
+    {
+        auto* e = table.get(id);
+        if (!e) return;
+        unaccount(*e);
+        e->clearPayload();
+    }
+
+    // Drop `refcount` remote references; returns true if the entry was removed.
+    bool release(int id, int refcount)
+    {
+        auto* e = table.get(id);
+        if (!e)
+            return false;
         if (refcount > 0)
-            it->second.remoteRefcount -= refcount;
-        if (it->second.remoteRefcount <= 0)
-            table.erase(it);
+            e->remoteRefcount -= refcount;
+        if (e->remoteRefcount > 0)
+            return false;
+        remove(id);
+        return true;
+    }
+
+    // Remove an entry regardless of its refcount.
+    void remove(int id)
+    {
+        if (auto* e = table.get(id))
+        {
+            unaccount(*e);
+            table.erase(id);
+        }
+    }
+
+    // IDs of entries that `policy` considers orphaned as of `now`.
+    std::vector<int> collectIdle(const ExportIdlePolicy& policy, std::chrono::steady_clock::time_point now)
+    {
+        std::vector<int> ids;
+        for (auto& kv : table)
+        {
+            const ExportEntry& e = kv.second;
+            if (e.hasOperation) continue;
+            auto idle = now - e.lastUsed;
+            if ((policy.pulledTtl.count() > 0 && e.pulled && idle >= policy.pulledTtl) ||
+                (policy.idleTtl.count() > 0 && idle >= policy.idleTtl))
+            {
+                ids.push_back(kv.first);
+            }
+        }
+        return ids;
+    }
+
+    // Charge retained results and pending arguments to `account` (may be null).
+    void setMemoryAccount(MemoryAccount* account)
+    {
+        memory = account;
     }
 
     void reset()
     {
+        if (memory)
+        {
+            memory->clear(MemoryCategory::Results);
+            memory->clear(MemoryCategory::PendingArgs);
+        }
         table.clear();
         nextExportId = 1;
         nextExportIdNegative = -1;
     }
 
     // Back-compat exposure for testing and transitional code.
-    std::unordered_map<int, ExportEntry> table;
+    IdTable<ExportEntry> table;
 
 private:
     int nextExportId = 1;              // Aligned to client push order (for pull)
     int nextExportIdNegative = -1;     // Server-chosen negative IDs for exporter-originated
+    MemoryAccount* memory = nullptr;
+
+    // Re-estimate the entry's payload and charge the difference to the memory account.
+    void account(ExportEntry& e)
+    {
+        if (!memory || !e.cold) return;
+        auto& p = *e.cold;
+        std::size_t resultBytes = e.hasResult ? estimateJsonBytes(p.result) : 0;
+        std::size_t argsBytes = e.hasOperation ? p.method.capacity() + estimateJsonBytes(p.args) : 0;
+        memory->sub(MemoryCategory::Results, p.resultBytes);
+        memory->add(MemoryCategory::Results, resultBytes);
+        memory->sub(MemoryCategory::PendingArgs, p.argsBytes);
+        memory->add(MemoryCategory::PendingArgs, argsBytes);
+        p.resultBytes = resultBytes;
+        p.argsBytes = argsBytes;
+    }
+
+    void unaccount(ExportEntry& e)
+    {
+        if (!e.cold) return;
+        if (memory)
+        {
+            memory->sub(MemoryCategory::Results, e.cold->resultBytes);
+            memory->sub(MemoryCategory::PendingArgs, e.cold->argsBytes);
+        }
+        e.cold->resultBytes = 0;
+        e.cold->argsBytes = 0;
+    }
 };
 
 // Manages ownership and lifecycle of client-originated imports as seen by the server.
@@ -171,12 +336,11 @@ public:
     }
 
     // Record a resolution (resolve/reject) and return how many remote refs to release.
-    int recordResolutionAndGetReleaseCount(int importId, const json& resolution)
+    int recordResolutionAndGetReleaseCount(int importId)
     {
-        auto& imp = table[importId];
-        imp.hasResolution = true;
-        imp.resolution = resolution;
-        int releaseCount = imp.remoteRefcount > 0 ? imp.remoteRefcount : 1;
+        // The entry is dropped right away, so only its refcount matters.
+        auto* imp = table.get(importId);
+        int releaseCount = imp && imp->remoteRefcount > 0 ? imp->remoteRefcount : 1;
         table.erase(importId);
         return releaseCount;
     }
@@ -199,29 +363,74 @@ public:
     // imported (defensive handling). Erase the entry when localRefcount reaches zero.
     void releaseLocal(int importId, int count)
     {
-        auto it = table.find(importId);
-        if (it == table.end()) return;
+        auto* imp = table.get(importId);
+        if (!imp) return;
         if (count <= 0) return;
-        if (it->second.localRefcount > 0)
+        if (imp->localRefcount > 0)
         {
-            it->second.localRefcount -= count;
-            if (it->second.localRefcount <= 0)
+            imp->localRefcount -= count;
+            if (imp->localRefcount <= 0)
             {
-                table.erase(it);
+                table.erase(importId);
             }
         }
     }
 
     // Back-compat exposure for tests and transitional code.
-    std::unordered_map<int, ImportEntry> table;
+    IdTable<ImportEntry> table;
 
 private:
     int nextImportId = 1;             // Positive IDs we allocate when initiating calls
 };
 
+// Inbound frames held back while the peer is not draining our output (see pumpInbound()).
+struct InboundBacklog
+{
+    std::deque<std::string> frames;
+    bool paused = false;
+};
+
+// Release frames owed to the peer, summed per import ID until the next flush (see flushReleases()).
+struct PendingReleases
+{
+    std::vector<std::pair<int, int>> counts;   // (importId, refcount) in first-queued order
+    std::unordered_map<int, std::size_t> index; // importId -> position in `counts`
+    bool scheduled = false;                     // A flush is already scheduled (endpoint use)
+
+    void add(int importId, int refcount)
+    {
+        if (refcount <= 0) return;
+        auto [it, inserted] = index.try_emplace(importId, counts.size());
+        if (inserted)
+            counts.emplace_back(importId, refcount);
+        else
+            counts[it->second].second += refcount;
+    }
+
+    bool empty() const { return counts.empty(); }
+
+    void clear()
+    {
+        counts.clear();
+        index.clear();
+        scheduled = false;
+    }
+};
+
 // Internal data associated with each connection/session.
+// A server target instance referenced by export markers. `markers` counts markers handed out and
+// not yet turned into an export, e.g. inside results the peer has yet to pull; the registration
+// outlives the target's export while any remain.
+struct RegisteredTarget
+{
+    std::shared_ptr<RpcTarget> target;
+    int markers = 0;
+};
+
 struct RpcSessionData
 {
+    // Bytes retained on behalf of the peer; see RpcSession::setMemoryLimits().
+    MemoryAccount memory;
     Exporter exporter;
     Importer importer;
     std::shared_ptr<RpcTarget> target;
@@ -235,16 +444,74 @@ struct RpcSessionData
     // Reverse export map: target instance pointer -> export ID (for per-target re-export parity).
     std::unordered_map<std::uintptr_t, int> targetExportId;
     // Registry of server target instances referenced by export markers.
-    std::unordered_map<std::uintptr_t, std::shared_ptr<RpcTarget>> targetRegistry;
+    std::unordered_map<std::uintptr_t, RegisteredTarget> targetRegistry;
+
+    // Last idle-export sweep (see RpcSession::setExportIdlePolicy()).
+    std::chrono::steady_clock::time_point lastIdleSweep{};
+
+    // Frames deferred by outbound backpressure; charged to MemoryCategory::PendingArgs.
+    InboundBacklog inbound;
+
+    // Releases queued by pumps that flush once per read window or batch.
+    PendingReleases releases;
+
+    // Set when the session aborts this connection; its frames are ignored from then on.
+    bool aborted = false;
 
     // Back-compat field aliases for existing tests and code paths.
-    std::unordered_map<int, ExportEntry>& exports;
-    std::unordered_map<int, ImportEntry>& imports;
+    IdTable<ExportEntry>& exports;
+    IdTable<ImportEntry>& imports;
 
     RpcSessionData()
         : exports(exporter.table), imports(importer.table)
     {
+        exporter.setMemoryAccount(&memory);
+    }
+
+    ~RpcSessionData()
+    {
+        Metrics::instance().liveExports.sub(reportedExports);
+        Metrics::instance().liveImports.sub(reportedImports);
     }
+
+    // Publish changes in table sizes to the process-wide export/import gauges.
+    void syncTableGauges()
+    {
+        auto exportCount = static_cast<std::int64_t>(exporter.table.size());
+        auto importCount = static_cast<std::int64_t>(importer.table.size());
+        if (exportCount != reportedExports)
+        {
+            Metrics::instance().liveExports.add(exportCount - reportedExports);
+            reportedExports = exportCount;
+        }
+        if (importCount != reportedImports)
+        {
+            Metrics::instance().liveImports.add(importCount - reportedImports);
+            reportedImports = importCount;
+        }
+    }
+
+    // Clear all per-connection state while keeping allocated capacity. The target, transport
+    // and local target hook are left in place.
+    void reset()
+    {
+        exporter.reset();
+        importer.reset();
+        importToPromiseExport.clear();
+        targetExportId.clear();
+        targetRegistry.clear();
+        inbound.frames.clear();
+        inbound.paused = false;
+        releases.clear();
+        memory.clear();
+        lastIdleSweep = {};
+        aborted = false;
+        syncTableGauges();
+    }
+
+private:
+    std::int64_t reportedExports = 0;   // Last table sizes published to Metrics
+    std::int64_t reportedImports = 0;
 };
 
 } // namespace capnwebcpp
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <App.h>
+#include <libusockets.h>
+
+#include "capnwebcpp/framing.h"
+#include "capnwebcpp/rpc_session.h"
+#include "capnwebcpp/serialize.h"
+#include "capnwebcpp/transport.h"
+
+namespace capnwebcpp
+{
+
+// Settings for setupRpcSocketEndpoint() / setupRpcUnixSocketEndpoint().
+struct RpcSocketEndpointOptions
+{
+    MemoryLimits memoryLimits;                          // Memory each connection may retain
+    ExportIdlePolicy idlePolicy;                        // Reclamation of unreleased exports
+    std::size_t maxFrameSize = 16 * 1024 * 1024;        // Larger inbound frames close the connection
+    std::size_t sendHighWaterMark = 1024 * 1024;        // See RpcEndpointOptions::sendHighWaterMark
+};
+
+// RpcTransport writing length-prefixed frames to a uSockets socket. Bytes the kernel does not
+// accept are kept and written from the writable callback.
+class UsSocketTransport : public RpcTransport
+{
+public:
+    UsSocketTransport(us_socket_t* socket, MemoryAccount* memory) : socket(socket), memory(memory) {}
+
+    using RpcTransport::send;
+
+    void send(const std::string& message) override
+    {
+        auto header = encodeFrameHeader(message.size());
+        write(header.data(), header.size(), true);
+        write(message.data(), message.size(), false);
+    }
+
+    void sendv(std::span<const std::string_view> fragments) override
+    {
+        std::size_t size = 0;
+        for (auto f : fragments) size += f.size();
+        auto header = encodeFrameHeader(size);
+        write(header.data(), header.size(), true);
+        for (std::size_t i = 0; i < fragments.size(); ++i)
+            write(fragments[i].data(), fragments[i].size(), i + 1 < fragments.size());
+    }
+
+    // Closing is deferred to the end of the current socket callback (see closeRequested()).
+    void abort(const std::string& /*reason*/) override
+    {
+        closing = true;
+    }
+
+    std::size_t bufferedAmount() const override
+    {
+        return pending.size() - pendingOffset;
+    }
+
+    // Write buffered bytes; called when the socket becomes writable.
+    void flush()
+    {
+        while (pendingOffset < pending.size())
+        {
+            int n = us_socket_write(0, socket, pending.data() + pendingOffset,
+                                    static_cast<int>(pending.size() - pendingOffset), 0);
+            if (n <= 0) break;
+            pendingOffset += static_cast<std::size_t>(n);
+        }
+        if (pendingOffset == pending.size())
+        {
+            pending.clear();
+            pendingOffset = 0;
+        }
+        if (memory) memory->set(MemoryCategory::Outbound, bufferedAmount());
+    }
+
+    bool closeRequested() const { return closing; }
+
+private:
+    us_socket_t* socket;
+    MemoryAccount* memory;
+    std::string pending;
+    std::size_t pendingOffset = 0;
+    bool closing = false;
+
+    void write(const char* data, std::size_t length, bool more)
+    {
+        std::size_t written = 0;
+        if (bufferedAmount() == 0)
+        {
+            int n = us_socket_write(0, socket, data, static_cast<int>(length), more ? 1 : 0);
+            if (n > 0) written = static_cast<std::size_t>(n);
+        }
+        if (written < length)
+        {
+            pending.append(data + written, length - written);
+            if (memory) memory->set(MemoryCategory::Outbound, bufferedAmount());
+        }
+    }
+};
+
+// State of one accepted connection, referenced from the socket's extension area.
+struct RpcSocketConnection
+{
+    RpcSocketConnection(us_socket_t* socket, std::shared_ptr<RpcTarget> target,
+                        const RpcSocketEndpointOptions& options)
+        : session(target), decoder(options.maxFrameSize)
+    {
+        session.setMemoryLimits(options.memoryLimits);
+        session.setExportIdlePolicy(options.idlePolicy);
+        data.target = target;
+        data.localTargetHook = makeLocalTargetHook(target);
+        transport = std::make_shared<UsSocketTransport>(socket, &data.memory);
+        data.transport = transport;
+    }
+
+    RpcSession session;
+    RpcSessionData data;
+    FrameDecoder decoder;
+    std::shared_ptr<UsSocketTransport> transport;
+};
+
+// Endpoint-wide settings, referenced from the socket context's extension area.
+struct RpcSocketEndpointState
+{
+    std::shared_ptr<RpcTarget> target;
+    RpcSocketEndpointOptions options;
+};
+
+inline RpcSocketConnection* rpcSocketConnection(us_socket_t* s)
+{
+    return *static_cast<RpcSocketConnection**>(us_socket_ext(0, s));
+}
+
+inline RpcSocketEndpointState* rpcSocketState(us_socket_t* s)
+{
+    return *static_cast<RpcSocketEndpointState**>(us_socket_context_ext(0, us_socket_context(0, s)));
+}
+
+// Socket context running RPC sessions over length-prefixed frames.
+inline us_socket_context_t* createRpcSocketContext(std::shared_ptr<RpcTarget> target,
+                                                   const RpcSocketEndpointOptions& options)
+{
+    auto* loop = reinterpret_cast<us_loop_t*>(uWS::Loop::get());
+    us_socket_context_options_t contextOptions{};
+    us_socket_context_t* context = us_create_socket_context(0, loop, sizeof(RpcSocketEndpointState*), contextOptions);
+    if (!context)
+        return nullptr;
+    // Lives as long as the loop; endpoints are not torn down individually.
+    *static_cast<RpcSocketEndpointState**>(us_socket_context_ext(0, context)) =
+        new RpcSocketEndpointState{ std::move(target), options };
+
+    us_socket_context_on_open(0, context, [](us_socket_t* s, int, char*, int) -> us_socket_t*
+    {
+        auto* state = rpcSocketState(s);
+        auto* conn = new RpcSocketConnection(s, state->target, state->options);
+        *static_cast<RpcSocketConnection**>(us_socket_ext(0, s)) = conn;
+        conn->session.onOpen(&conn->data);
+        return s;
+    });
+
+    us_socket_context_on_data(0, context, [](us_socket_t* s, char* bytes, int length) -> us_socket_t*
+    {
+        auto* conn = rpcSocketConnection(s);
+        std::size_t highWaterMark = rpcSocketState(s)->options.sendHighWaterMark;
+        try
+        {
+            conn->decoder.feed(std::string_view(bytes, static_cast<std::size_t>(length)), [&](std::string_view frame)
+            {
+                if (!conn->session.isAborted(&conn->data))
+                    pumpInbound(conn->session, &conn->data, *conn->transport, frame, highWaterMark);
+            });
+            // Releases for every frame in this read go out together.
+            flushReleases(&conn->data, *conn->transport);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error processing socket frame: " << e.what() << std::endl;
+            try
+            {
+                auto err = serialize::makeError("ServerError", std::string(e.what()));
+                conn->transport->send(conn->session.buildAbort(err));
+            }
+            catch (...) {}
+            conn->session.markAborted(&conn->data, std::string(e.what()));
+        }
+        if (conn->transport->closeRequested() || conn->session.isAborted(&conn->data))
+            return us_socket_close(0, s, 0, nullptr);
+        return s;
+    });
+
+    us_socket_context_on_writable(0, context, [](us_socket_t* s) -> us_socket_t*
+    {
+        auto* conn = rpcSocketConnection(s);
+        conn->transport->flush();
+        if (conn->data.inbound.paused)
+        {
+            resumeInbound(conn->session, &conn->data, *conn->transport, rpcSocketState(s)->options.sendHighWaterMark);
+            flushReleases(&conn->data, *conn->transport);
+        }
+        return s;
+    });
+
+    us_socket_context_on_end(0, context, [](us_socket_t* s) -> us_socket_t*
+    {
+        return us_socket_close(0, s, 0, nullptr);
+    });
+
+    us_socket_context_on_timeout(0, context, [](us_socket_t* s) -> us_socket_t*
+    {
+        return s;
+    });
+
+    us_socket_context_on_close(0, context, [](us_socket_t* s, int, void*) -> us_socket_t*
+    {
+        auto** slot = static_cast<RpcSocketConnection**>(us_socket_ext(0, s));
+        if (*slot)
+        {
+            (*slot)->session.onClose(&(*slot)->data);
+            delete *slot;
+            *slot = nullptr;
+        }
+        return s;
+    });
+
+    return context;
+}
+
+// Serve the RPC protocol over plain TCP with length-prefixed frames (see framing.h) on the
+// calling thread's uWS loop. Each connection gets its own session. Returns the listen socket,
+// or nullptr if listening failed.
+inline us_listen_socket_t* setupRpcSocketEndpoint(const std::string& host, int port,
+                                                  std::shared_ptr<RpcTarget> target,
+                                                  const RpcSocketEndpointOptions& options = {})
+{
+    us_socket_context_t* context = createRpcSocketContext(std::move(target), options);
+    if (!context)
+        return nullptr;
+    return us_socket_context_listen(0, context, host.empty() ? nullptr : host.c_str(), port, 0,
+                                    sizeof(RpcSocketConnection*));
+}
+
+// As setupRpcSocketEndpoint(), on a Unix domain socket at `path`.
+inline us_listen_socket_t* setupRpcUnixSocketEndpoint(const std::string& path,
+                                                      std::shared_ptr<RpcTarget> target,
+                                                      const RpcSocketEndpointOptions& options = {})
+{
+    us_socket_context_t* context = createRpcSocketContext(std::move(target), options);
+    if (!context)
+        return nullptr;
+    return us_socket_context_listen_unix(0, context, path.c_str(), 0, sizeof(RpcSocketConnection*));
+}
+
+} // namespace capnwebcpp
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "capnwebcpp/rpc_session.h"
 #include "capnwebcpp/protocol.h"
@@ -9,38 +13,90 @@ namespace capnwebcpp
 {
 
 // Abstract transport interface. Implementations deliver strings to the peer.
+// Implementations overriding only send(const std::string&) get copying defaults for the
+// owning and gather overloads; overriding classes should bring the others into scope with
+// `using RpcTransport::send;`.
 class RpcTransport
 {
 public:
     virtual ~RpcTransport() = default;
     virtual void send(const std::string& message) = 0;
     virtual void abort(const std::string& reason) = 0;
+
+    // Send a frame the caller no longer needs; transports that retain frames take it over.
+    virtual void send(std::string&& message)
+    {
+        send(static_cast<const std::string&>(message));
+    }
+
+    // Send one frame made of `fragments` in order, e.g. a small header and a large pre-serialized
+    // payload. The default concatenates; transports with gather writes avoid that copy.
+    virtual void sendv(std::span<const std::string_view> fragments)
+    {
+        std::size_t size = 0;
+        for (auto f : fragments) size += f.size();
+        std::string frame;
+        frame.reserve(size);
+        for (auto f : fragments) frame.append(f);
+        send(std::move(frame));
+    }
+
+    // Send a protocol message. The default serializes it; in-process transports may pass the
+    // value through instead.
+    virtual void sendMessage(protocol::Message&& message)
+    {
+        std::string frame = protocol::serialize(message);
+        Metrics::instance().recordOutbound(message.type, frame.size());
+        send(std::move(frame));
+    }
+
+    // Bytes accepted by send() but not yet delivered to the peer.
+    virtual std::size_t bufferedAmount() const { return 0; }
 };
 
-// Helper to process a single inbound message via session and send any response.
-inline void pumpMessage(RpcSession& session,
-                        RpcSessionData* sessionData,
-                        RpcTransport& transport,
-                        const std::string& message)
+// Send one release frame per import ID queued in `sessionData->releases`, with refcounts summed.
+inline void flushReleases(RpcSessionData* sessionData, RpcTransport& transport)
+{
+    if (!sessionData) return;
+    PendingReleases& releases = sessionData->releases;
+    releases.scheduled = false;
+    if (releases.empty()) return;
+    for (const auto& [importId, count] : releases.counts)
+    {
+        capnwebcpp::protocol::Message rel;
+        rel.type = capnwebcpp::protocol::MessageType::Release;
+        rel.params = json::array({ importId, count });
+        transport.sendMessage(std::move(rel));
+    }
+    releases.clear();
+}
+
+// Process a single parsed inbound message via session and send any response. Release frames it
+// produces (for a settled import, or for client references held by a pulled export) are queued
+// in `sessionData->releases` instead of sent; the caller flushes them with flushReleases() once
+// per read window or batch.
+inline void pumpMessageQueued(RpcSession& session,
+                              RpcSessionData* sessionData,
+                              RpcTransport& transport,
+                              const capnwebcpp::protocol::Message& m)
 {
     int pullExportId = 0;
+    if (m.type == capnwebcpp::protocol::MessageType::Pull && m.params.size() >= 1 && m.params[0].is_number())
     {
-        capnwebcpp::protocol::Message m;
-        if (capnwebcpp::protocol::parse(message, m))
-        {
-            if (m.type == capnwebcpp::protocol::MessageType::Pull && m.params.size() >= 1 && m.params[0].is_number())
-            {
-                pullExportId = m.params[0];
-            }
-        }
+        pullExportId = m.params[0];
     }
 
-    std::string response = session.handleMessage(sessionData, message);
-    if (!response.empty())
+    capnwebcpp::protocol::Message response = session.handleMessageValue(sessionData, m);
+    if (response.type == capnwebcpp::protocol::MessageType::Release && sessionData
+        && response.params.size() >= 2 && response.params[0].is_number_integer() && response.params[1].is_number_integer())
     {
-        transport.send(response);
+        sessionData->releases.add(response.params[0].get<int>(), response.params[1].get<int>());
     }
-    if (session.isAborted())
+    else if (response.type != capnwebcpp::protocol::MessageType::Unknown)
+    {
+        transport.sendMessage(std::move(response));
+    }
+    if (session.isAborted(sessionData))
     {
         // Best-effort attempt to close the transport after abort.
         transport.abort("aborted");
@@ -48,21 +104,136 @@ inline void pumpMessage(RpcSession& session,
 
     if (pullExportId != 0 && sessionData)
     {
-        if (auto* e = sessionData->exporter.find(pullExportId))
+        auto* e = sessionData->exporter.find(pullExportId);
+        if (e && e->cold)
+        {
+            for (const auto& kv : e->cold->importedClientIds)
+                sessionData->releases.add(kv.first, kv.second);
+            e->cold->importedClientIds.clear();
+        }
+    }
+}
+
+// As above, for a raw frame; parsed in place.
+inline void pumpMessageQueued(RpcSession& session,
+                              RpcSessionData* sessionData,
+                              RpcTransport& transport,
+                              std::string_view message)
+{
+    // Parse once; the session handles the parsed message directly.
+    capnwebcpp::protocol::Message m;
+    if (!capnwebcpp::protocol::parse(message, m))
+        return;
+    Metrics::instance().recordInbound(m.type, message.size());
+    pumpMessageQueued(session, sessionData, transport, m);
+}
+
+// Process a single inbound message via session and send any response, including its releases.
+inline void pumpMessage(RpcSession& session,
+                        RpcSessionData* sessionData,
+                        RpcTransport& transport,
+                        const capnwebcpp::protocol::Message& m)
+{
+    pumpMessageQueued(session, sessionData, transport, m);
+    flushReleases(sessionData, transport);
+}
+
+inline void pumpMessage(RpcSession& session,
+                        RpcSessionData* sessionData,
+                        RpcTransport& transport,
+                        std::string_view message)
+{
+    pumpMessageQueued(session, sessionData, transport, message);
+    flushReleases(sessionData, transport);
+}
+
+// Discard deferred inbound frames, e.g. once the session is aborted.
+inline void dropInboundBacklog(RpcSessionData* sessionData)
+{
+    InboundBacklog& backlog = sessionData->inbound;
+    for (const auto& f : backlog.frames)
+        sessionData->memory.sub(MemoryCategory::PendingArgs, f.size());
+    backlog.frames.clear();
+    backlog.paused = false;
+}
+
+// Backpressure-aware variant of pumpMessage for persistent transports. While the transport holds
+// more than `highWaterMark` undelivered bytes, inbound frames are queued instead of executed;
+// call resumeInbound() once the transport drains. A zero mark disables deferral. Releases are
+// queued as in pumpMessageQueued(); flush them at the end of the read window.
+inline void pumpInbound(RpcSession& session,
+                        RpcSessionData* sessionData,
+                        RpcTransport& transport,
+                        std::string_view message,
+                        std::size_t highWaterMark)
+{
+    if (highWaterMark == 0 || !sessionData)
+    {
+        pumpMessageQueued(session, sessionData, transport, message);
+        session.processTasks();
+        return;
+    }
+
+    // An aborted session neither runs nor keeps frames.
+    if (session.isAborted(sessionData))
+        return;
+
+    InboundBacklog& backlog = sessionData->inbound;
+    if (backlog.paused || !backlog.frames.empty())
+    {
+        // Keep frames in arrival order behind those already deferred. Only deferred frames are
+        // copied; the caller's buffer is not retained.
+        sessionData->memory.add(MemoryCategory::PendingArgs, message.size());
+        backlog.frames.emplace_back(message);
+        // The backlog counts against the hard limit, so a peer that keeps sending without
+        // reading cannot grow it without bound.
+        protocol::Message abortMessage = session.enforceHardMemoryLimit(sessionData);
+        if (abortMessage.type != protocol::MessageType::Unknown)
+        {
+            dropInboundBacklog(sessionData);
+            transport.sendMessage(std::move(abortMessage));
+            transport.abort("memory limit exceeded");
+        }
+        return;
+    }
+
+    pumpMessageQueued(session, sessionData, transport, message);
+    session.processTasks();
+    if (transport.bufferedAmount() > highWaterMark)
+        backlog.paused = true;
+}
+
+// Run deferred inbound frames while the transport stays at or below `highWaterMark`. Releases are
+// queued as in pumpInbound().
+inline void resumeInbound(RpcSession& session,
+                          RpcSessionData* sessionData,
+                          RpcTransport& transport,
+                          std::size_t highWaterMark)
+{
+    if (!sessionData)
+        return;
+
+    InboundBacklog& backlog = sessionData->inbound;
+    while (!session.isAborted(sessionData))
+    {
+        if (highWaterMark != 0 && transport.bufferedAmount() > highWaterMark)
         {
-            for (const auto& kv : e->importedClientIds)
-            {
-                int importId = kv.first;
-                int count = kv.second;
-                if (count <= 0) continue;
-                capnwebcpp::protocol::Message rel;
-                rel.type = capnwebcpp::protocol::MessageType::Release;
-                rel.params = json::array({ importId, count });
-                transport.send(capnwebcpp::protocol::serialize(rel));
-            }
-            e->importedClientIds.clear();
+            backlog.paused = true;
+            return;
         }
+        backlog.paused = false;
+        if (backlog.frames.empty())
+            return;
+
+        std::string message = std::move(backlog.frames.front());
+        backlog.frames.pop_front();
+        sessionData->memory.sub(MemoryCategory::PendingArgs, message.size());
+        pumpMessageQueued(session, sessionData, transport, message);
+        session.processTasks();
     }
+
+    // An aborted session never runs its backlog.
+    dropInboundBacklog(sessionData);
 }
 
 } // namespace capnwebcpp
@@ -1,28 +1,55 @@
 #pragma once
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "capnwebcpp/memory_accounting.h"
 #include "capnwebcpp/transport.h"
 
 namespace capnwebcpp
 {
 
 // RpcTransport that collects all outgoing messages into a vector of strings.
+// Buffered bytes are charged to `memory` (if given) as outbound memory. Frames passed by rvalue
+// are moved into the outbox.
 class AccumTransport : public RpcTransport
 {
 public:
-    explicit AccumTransport(std::vector<std::string>& out) : out(out) {}
+    explicit AccumTransport(std::vector<std::string>& out, MemoryAccount* memory = nullptr)
+        : out(out), memory(memory) {}
+
+    using RpcTransport::send;
 
     void send(const std::string& message) override
     {
         out.push_back(message);
+        if (memory) memory->add(MemoryCategory::Outbound, message.size());
+    }
+
+    void send(std::string&& message) override
+    {
+        if (memory) memory->add(MemoryCategory::Outbound, message.size());
+        out.push_back(std::move(message));
+    }
+
+    void sendv(std::span<const std::string_view> fragments) override
+    {
+        // Assemble directly in the outbox slot.
+        std::string& frame = out.emplace_back();
+        std::size_t size = 0;
+        for (auto f : fragments) size += f.size();
+        frame.reserve(size);
+        for (auto f : fragments) frame.append(f);
+        if (memory) memory->add(MemoryCategory::Outbound, frame.size());
     }
 
     void abort(const std::string& /*reason*/) override {}
 
 private:
     std::vector<std::string>& out;
+    MemoryAccount* memory;
 };
 
 } // namespace capnwebcpp
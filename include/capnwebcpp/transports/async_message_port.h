@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "capnwebcpp/transport.h"
+
+namespace capnwebcpp
+{
+
+// Lock-free multi-producer single-consumer queue (Vyukov's linked list with a stub node).
+// push() may be called from any thread; pop() only from the single consumer thread.
+template<typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+    {
+        Node* stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        T discard;
+        while (pop(discard)) {}
+        delete tail;
+    }
+
+    void push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // False when empty, or while a concurrent push has not linked its node yet; the producer's
+    // wakeup follows the link, so the consumer is called again.
+    bool pop(T& out)
+    {
+        Node* first = tail;
+        Node* next = first->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        out = std::move(next->value);
+        tail = next;
+        delete first;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{ nullptr };
+        T value{};
+    };
+
+    std::atomic<Node*> head;    // Last pushed node (producers)
+    Node* tail;                 // Stub before the next node to pop (consumer)
+};
+
+// MessagePort whose peer may live on another thread or event loop. postMessage() enqueues on
+// the peer without running any handler; the owner runs its handler for queued messages by
+// calling drain() on its own thread. The wakeup hook tells the owner that drain() is due: it runs
+// on the posting thread, once per batch of messages posted while no drain was pending, and should
+// only schedule (e.g. uWS::Loop::defer, notify a condition variable, write an eventfd).
+class AsyncMessagePort
+{
+public:
+    using Handler = std::function<void(const std::string&)>;
+    using Wakeup = std::function<void()>;
+
+    void setPeer(AsyncMessagePort* p) { peer = p; }
+
+    // Set before messages can arrive; neither is synchronized with postMessage().
+    void setHandler(Handler h) { handler = std::move(h); }
+    void setWakeup(Wakeup w) { wakeup = std::move(w); }
+
+    void postMessage(std::string message)
+    {
+        if (peer) peer->enqueue(std::move(message));
+    }
+
+    // Run the handler for every queued message; returns how many ran. Owner thread only.
+    std::size_t drain()
+    {
+        // Cleared before popping so a message posted during the drain schedules another one.
+        scheduled.store(false, std::memory_order_seq_cst);
+        std::size_t count = 0;
+        std::string message;
+        while (inbox.pop(message))
+        {
+            ++count;
+            if (handler) handler(message);
+        }
+        return count;
+    }
+
+private:
+    AsyncMessagePort* peer = nullptr;
+    Handler handler;
+    Wakeup wakeup;
+    MpscQueue<std::string> inbox;
+    std::atomic<bool> scheduled{ false };
+
+    void enqueue(std::string message)
+    {
+        inbox.push(std::move(message));
+        if (!scheduled.exchange(true, std::memory_order_seq_cst) && wakeup)
+            wakeup();
+    }
+};
+
+// A pair of connected AsyncMessagePorts.
+struct AsyncMessageChannel
+{
+    AsyncMessageChannel()
+    {
+        port1.setPeer(&port2);
+        port2.setPeer(&port1);
+    }
+
+    AsyncMessagePort port1;
+    AsyncMessagePort port2;
+};
+
+// RpcTransport adapter that posts to an AsyncMessagePort. Rvalue frames are moved into the queue.
+class AsyncMessagePortTransport : public RpcTransport
+{
+public:
+    explicit AsyncMessagePortTransport(AsyncMessagePort* port) : port(port) {}
+
+    void send(const std::string& message) override
+    {
+        if (port) port->postMessage(message);
+    }
+
+    void send(std::string&& message) override
+    {
+        if (port) port->postMessage(std::move(message));
+    }
+
+    void abort(const std::string& /*reason*/) override {}
+
+private:
+    AsyncMessagePort* port;
+};
+
+} // namespace capnwebcpp
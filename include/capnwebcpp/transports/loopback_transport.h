@@ -0,0 +1,219 @@
+#pragma once
+
+// In-process loopback between a C++ client and an RpcSession that passes protocol::Message values
+// instead of text: nothing is serialized or parsed in either direction.
+
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+
+#include "capnwebcpp/client_api.h"
+#include "capnwebcpp/rpc_session.h"
+#include "capnwebcpp/stub_hook.h"
+#include "capnwebcpp/transport.h"
+
+namespace capnwebcpp
+{
+
+// Server-side transport of a LoopbackClient. Outbound messages are queued as values for the client.
+class LoopbackTransport : public RpcTransport
+{
+public:
+    using RpcTransport::send;
+
+    // Text frames (e.g. an endpoint's pre-built abort) are parsed once into values.
+    void send(const std::string& message) override
+    {
+        protocol::Message m;
+        if (protocol::parse(message, m))
+            sendMessage(std::move(m));
+    }
+
+    void sendMessage(protocol::Message&& message) override
+    {
+        Metrics::instance().recordOutbound(message.type, 0);
+        queue.push_back(std::move(message));
+    }
+
+    void abort(const std::string& /*reason*/) override
+    {
+        closed = true;
+    }
+
+    // Messages sent to the client, in order.
+    std::deque<protocol::Message> queue;
+    bool closed = false;
+};
+
+// Client owning an RpcSession for `target` in the same process. Calls follow the wire protocol
+// (push, pull, resolve/reject, release) with the same ID allocation, pipelining and refcounting,
+// but messages are handed over as values. Single-threaded: each call runs the server to completion.
+class LoopbackClient
+{
+public:
+    explicit LoopbackClient(std::shared_ptr<RpcTarget> target)
+        : session(target), transport(std::make_shared<LoopbackTransport>())
+    {
+        data.target = target;
+        data.localTargetHook = makeLocalTargetHook(target);
+        data.transport = transport;
+        session.onOpen(&data);
+    }
+
+    LoopbackClient(const LoopbackClient&) = delete;
+    LoopbackClient& operator=(const LoopbackClient&) = delete;
+
+    ~LoopbackClient()
+    {
+        session.onClose(&data);
+    }
+
+    // Push an expression (e.g. ["pipeline", importId, path, args]); returns its import ID. The
+    // ID may be referenced by later pushes before it resolves.
+    int push(json expression)
+    {
+        int importId = nextImportId++;
+        protocol::Message m;
+        m.type = protocol::MessageType::Push;
+        m.params = json::array({ std::move(expression) });
+        deliver(m);
+        return importId;
+    }
+
+    void pull(int importId)
+    {
+        protocol::Message m;
+        m.type = protocol::MessageType::Pull;
+        m.params = json::array({ importId });
+        deliver(m);
+    }
+
+    void release(int importId, int refcount = 1)
+    {
+        protocol::Message m;
+        m.type = protocol::MessageType::Release;
+        m.params = json::array({ importId, refcount });
+        deliver(m);
+    }
+
+    // Take the resolution of a pulled import: the decoded value (see RpcClient::decodeResult), or
+    // std::runtime_error for a rejection.
+    json await(int importId)
+    {
+        for (auto it = transport->queue.begin(); it != transport->queue.end(); ++it)
+        {
+            bool settles = it->type == protocol::MessageType::Resolve || it->type == protocol::MessageType::Reject;
+            if (!settles || it->params.empty() || it->params[0] != importId)
+                continue;
+            protocol::Message m = std::move(*it);
+            transport->queue.erase(it);
+            json value = m.params.size() >= 2 ? std::move(m.params[1]) : json();
+            if (m.type == protocol::MessageType::Reject)
+                throw std::runtime_error(errorText(value));
+            return RpcClient::decodeResult(value);
+        }
+        throwIfAborted();
+        throw std::runtime_error("No resolution for importId");
+    }
+
+    // Call a method on the main target.
+    json callMethod(const std::string& method, const json& argsArray)
+    {
+        return call(json::array({ "pipeline", 0, json::array({ method }), argsOrEmpty(argsArray) }));
+    }
+
+    // Call a method on a previously-returned stub ({"$stub": exportId}).
+    json callStubMethod(const json& stub, const std::string& method, const json& argsArray)
+    {
+        int exportId = RpcClient::getStubId(stub);
+        if (exportId == 0) throw std::runtime_error("callStubMethod: not a stub");
+        return call(json::array({ "pipeline", exportId, json::array({ method }), argsOrEmpty(argsArray) }));
+    }
+
+    // Get a property path from a previously-returned stub.
+    json getStubProperty(const json& stub, const json& path)
+    {
+        int exportId = RpcClient::getStubId(stub);
+        if (exportId == 0) throw std::runtime_error("getStubProperty: not a stub");
+        return call(json::array({ "pipeline", exportId, path }));
+    }
+
+    RpcSession& serverSession() { return session; }
+    RpcSessionData& serverData() { return data; }
+
+private:
+    RpcSession session;
+    RpcSessionData data;
+    std::shared_ptr<LoopbackTransport> transport;
+    int nextImportId = 1;
+
+    void deliver(const protocol::Message& m)
+    {
+        throwIfAborted();
+        Metrics::instance().recordInbound(m.type, 0);
+        pumpMessage(session, &data, *transport, m);
+        session.processTasks();
+        dropReleases();
+    }
+
+    // Push, pull, take the result and release the import, as a one-shot call would.
+    json call(json expression)
+    {
+        int importId = push(std::move(expression));
+        pull(importId);
+        json value;
+        try
+        {
+            value = await(importId);
+        }
+        catch (...)
+        {
+            if (!session.isAborted(&data)) release(importId);
+            throw;
+        }
+        release(importId);
+        return value;
+    }
+
+    // The client exports nothing, so releases addressed to it need no bookkeeping.
+    void dropReleases()
+    {
+        std::erase_if(transport->queue, [](const protocol::Message& m)
+        {
+            return m.type == protocol::MessageType::Release;
+        });
+    }
+
+    void throwIfAborted()
+    {
+        for (const auto& m : transport->queue)
+        {
+            if (m.type == protocol::MessageType::Abort)
+                throw std::runtime_error("session aborted: " + errorText(m.params.empty() ? json() : m.params[0]));
+        }
+        if (session.isAborted(&data))
+            throw std::runtime_error("session aborted");
+    }
+
+    static json argsOrEmpty(const json& argsArray)
+    {
+        return argsArray.is_null() ? json::array() : argsArray;
+    }
+
+    static std::string errorText(const json& err)
+    {
+        if (err.is_array() && err.size() >= 3)
+        {
+            std::string name = err[1].is_string() ? err[1].get<std::string>() : std::string("Error");
+            std::string message = err[2].is_string() ? err[2].get<std::string>() : std::string("rejected");
+            return name + ": " + message;
+        }
+        return "RPC rejected";
+    }
+};
+
+} // namespace capnwebcpp
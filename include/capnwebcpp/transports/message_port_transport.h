@@ -59,6 +59,8 @@ class MessagePortTransport : public RpcTransport
 public:
     explicit MessagePortTransport(MessagePort* port) : port(port) {}
 
+    using RpcTransport::send;
+
     void send(const std::string& message) override
     {
         if (port) port->postMessage(message);
@@ -0,0 +1,433 @@
+#pragma once
+
+// Shared-memory transport for processes on the same host (Linux: memfd + eventfd).
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capnwebcpp/transport.h"
+
+namespace capnwebcpp
+{
+
+// --------------------------------------------------------------------------------------
+// Shared region layout
+//
+// One region holds two single-producer/single-consumer byte rings, one per direction. Each
+// frame is a 4-byte native-endian length followed by the frame bytes; frames wrap around the
+// end of the ring. Positions are free-running byte counters; the ring capacity is a power of
+// two. Each side owns an eventfd "doorbell" the peer rings when it makes data or space
+// available. A side about to sleep raises its waiting flag first, so the peer knows to ring.
+
+struct alignas(64) ShmRingIndex
+{
+    std::atomic<std::uint64_t> value{ 0 };
+};
+
+struct ShmRingControl
+{
+    ShmRingIndex head;                          // Consumer position
+    ShmRingIndex tail;                          // Producer position
+    alignas(64) std::atomic<std::uint32_t> writerWaiting{ 0 };
+    std::atomic<std::uint32_t> readerWaiting{ 0 };
+};
+
+struct ShmRingRegion
+{
+    static constexpr std::uint32_t kMagic = 0x43574252;    // "CWBR"
+
+    std::uint32_t magic = kMagic;
+    std::uint32_t capacity = 0;                 // Bytes per ring
+    std::atomic<std::uint32_t> closed{ 0 };
+    ShmRingControl rings[2];
+
+    // Ring data follows the header at this offset.
+    static constexpr std::size_t kDataOffset = 4096;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared-memory rings need lock-free 64-bit atomics");
+static_assert(sizeof(ShmRingRegion) <= ShmRingRegion::kDataOffset);
+
+// File descriptors that make up a shared-memory channel. Pass them to the peer process by
+// inheritance (fork/exec) or SCM_RIGHTS; both sides open a ShmRingEndpoint from them.
+struct ShmRingHandles
+{
+    int memFd = -1;
+    int firstEvent = -1;                        // Doorbell of the first side
+    int secondEvent = -1;                       // Doorbell of the second side
+
+    void close()
+    {
+        for (int* fd : { &memFd, &firstEvent, &secondEvent })
+        {
+            if (*fd >= 0) ::close(*fd);
+            *fd = -1;
+        }
+    }
+};
+
+// One side of a shared-memory channel. Not thread-safe; drive each endpoint from one thread.
+class ShmRingEndpoint
+{
+public:
+    enum class Side { First, Second };
+
+    // Create a channel with `capacity` bytes per direction (rounded up to a power of two).
+    static ShmRingHandles create(std::size_t capacity)
+    {
+        std::size_t cap = 4096;
+        while (cap < capacity) cap <<= 1;
+        if (cap > (std::size_t(1) << 31))
+            throw std::invalid_argument("shm ring capacity too large");
+
+        ShmRingHandles h;
+        h.memFd = ::memfd_create("capnweb-ring", MFD_CLOEXEC);
+        if (h.memFd < 0) throw std::system_error(errno, std::generic_category(), "memfd_create");
+        std::size_t size = ShmRingRegion::kDataOffset + 2 * cap;
+        if (::ftruncate(h.memFd, static_cast<off_t>(size)) != 0)
+        {
+            int err = errno; h.close();
+            throw std::system_error(err, std::generic_category(), "ftruncate");
+        }
+        void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, h.memFd, 0);
+        if (base == MAP_FAILED)
+        {
+            int err = errno; h.close();
+            throw std::system_error(err, std::generic_category(), "mmap");
+        }
+        auto* region = new (base) ShmRingRegion();
+        region->capacity = static_cast<std::uint32_t>(cap);
+        ::munmap(base, size);
+
+        h.firstEvent = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        h.secondEvent = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (h.firstEvent < 0 || h.secondEvent < 0)
+        {
+            int err = errno; h.close();
+            throw std::system_error(err, std::generic_category(), "eventfd");
+        }
+        return h;
+    }
+
+    // Open `side` of the channel. The handles stay owned by the caller; the endpoint keeps
+    // duplicates of the descriptors it needs.
+    ShmRingEndpoint(const ShmRingHandles& handles, Side side)
+    {
+        struct stat st{};
+        if (::fstat(handles.memFd, &st) != 0)
+            throw std::system_error(errno, std::generic_category(), "fstat");
+        if (st.st_size < static_cast<off_t>(ShmRingRegion::kDataOffset))
+            throw std::invalid_argument("shm ring: region too small");
+        mappedSize = static_cast<std::size_t>(st.st_size);
+        base = ::mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, handles.memFd, 0);
+        if (base == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        region = static_cast<ShmRingRegion*>(base);
+        // Read once: the region is shared with the peer. Ring offsets mask with capacity - 1.
+        std::size_t regionCapacity = region->capacity;
+        if (region->magic != ShmRingRegion::kMagic
+            || regionCapacity <= sizeof(std::uint32_t) || (regionCapacity & (regionCapacity - 1)) != 0
+            || ShmRingRegion::kDataOffset + 2 * regionCapacity > mappedSize)
+        {
+            ::munmap(base, mappedSize);
+            throw std::invalid_argument("shm ring: bad region");
+        }
+
+        capacity = regionCapacity;
+        int outIndex = side == Side::First ? 0 : 1;
+        auto* data = static_cast<char*>(base) + ShmRingRegion::kDataOffset;
+        out = { &region->rings[outIndex], data + outIndex * capacity };
+        in = { &region->rings[1 - outIndex], data + (1 - outIndex) * capacity };
+        localEvent = ::dup(side == Side::First ? handles.firstEvent : handles.secondEvent);
+        peerEvent = ::dup(side == Side::First ? handles.secondEvent : handles.firstEvent);
+    }
+
+    ShmRingEndpoint(const ShmRingEndpoint&) = delete;
+    ShmRingEndpoint& operator=(const ShmRingEndpoint&) = delete;
+
+    ~ShmRingEndpoint()
+    {
+        if (localEvent >= 0) ::close(localEvent);
+        if (peerEvent >= 0) ::close(peerEvent);
+        ::munmap(base, mappedSize);
+    }
+
+    // Largest frame the ring can carry.
+    std::size_t maxFrameSize() const { return capacity - sizeof(std::uint32_t); }
+
+    // Write a frame, or queue it locally while the ring is full (see flush()).
+    void send(std::string_view frame)
+    {
+        if (frame.size() > maxFrameSize())
+            throw std::length_error("shm ring: frame larger than ring");
+        if (pending.empty() && tryWrite(frame))
+            return;
+        pendingBytes += frame.size();
+        pending.emplace_back(frame);
+        waitForSpace();
+    }
+
+    void send(std::string&& frame)
+    {
+        if (frame.size() > maxFrameSize())
+            throw std::length_error("shm ring: frame larger than ring");
+        if (pending.empty() && tryWrite(frame))
+            return;
+        pendingBytes += frame.size();
+        pending.push_back(std::move(frame));
+        waitForSpace();
+    }
+
+    // Move locally queued frames into the ring as space allows.
+    void flush()
+    {
+        while (!pending.empty() && tryWrite(pending.front()))
+        {
+            pendingBytes -= pending.front().size();
+            pending.pop_front();
+        }
+        if (!pending.empty()) waitForSpace();
+    }
+
+    // Bytes queued locally because the ring was full.
+    std::size_t queuedBytes() const { return pendingBytes; }
+
+    // Read the next inbound frame into `frame`; false when none is available. Positions and
+    // lengths come from the peer: if they do not describe a frame within the ring, the channel
+    // is closed and nothing more is read from it.
+    bool receive(std::string& frame)
+    {
+        if (broken)
+            return false;
+        std::uint64_t head = in.control->head.value.load(std::memory_order_relaxed);
+        std::uint64_t tail = in.control->tail.value.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+
+        std::uint64_t available = tail - head;
+        std::uint32_t length = 0;
+        if (available >= sizeof(length) && available <= capacity)
+            copyOut(in, head, &length, sizeof(length));
+        if (available < sizeof(length) || available > capacity
+            || length > available - sizeof(length) || length > maxFrameSize())
+        {
+            std::cerr << "shm ring: corrupt frame header, closing channel" << std::endl;
+            broken = true;
+            close();
+            return false;
+        }
+        frame.resize(length);
+        copyOut(in, head + sizeof(length), frame.data(), length);
+        in.control->head.value.store(head + sizeof(length) + length, std::memory_order_release);
+
+        // The producer asked to be woken once space frees up. Pairs with the fence in
+        // waitForSpace(): either we see the flag or the producer sees the new head.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (in.control->writerWaiting.exchange(0, std::memory_order_acq_rel))
+            ring(peerEvent);
+        return true;
+    }
+
+    // Descriptor that becomes readable when the peer wrote frames, freed space or closed.
+    // Before polling it for frames, call armDoorbell() and skip the poll when it returns false.
+    int fd() const { return localEvent; }
+
+    // Ask the peer to ring for its next frame, then re-check to avoid a lost wakeup. Pairs with
+    // the fence in tryWrite(): either the writer sees the flag or we see its frame. Returns
+    // false (and withdraws the request) when a frame is already waiting.
+    bool armDoorbell()
+    {
+        in.control->readerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!broken && in.control->tail.value.load(std::memory_order_acquire) != in.control->head.value.load(std::memory_order_relaxed))
+        {
+            in.control->readerWaiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Block up to `timeoutMs` (-1: indefinitely) for the doorbell; returns true if woken, or at
+    // once when a frame is already waiting. With `forFrames` false (while deliberately not
+    // reading) only space freed by the peer or a close wakes it.
+    bool wait(int timeoutMs, bool forFrames = true)
+    {
+        if (forFrames && !armDoorbell())
+            return true;
+        pollfd p{ localEvent, POLLIN, 0 };
+        int r = ::poll(&p, 1, timeoutMs);
+        if (r <= 0) return false;
+        std::uint64_t count = 0;
+        (void)::read(localEvent, &count, sizeof(count));
+        return true;
+    }
+
+    // Mark the channel closed and wake the peer.
+    void close()
+    {
+        region->closed.store(1, std::memory_order_release);
+        ring(peerEvent);
+    }
+
+    bool isClosed() const { return region->closed.load(std::memory_order_acquire) != 0; }
+
+private:
+    struct Ring
+    {
+        ShmRingControl* control = nullptr;
+        char* data = nullptr;
+    };
+
+    void* base = nullptr;
+    std::size_t mappedSize = 0;
+    ShmRingRegion* region = nullptr;
+    std::size_t capacity = 0;
+    Ring out;
+    Ring in;
+    int localEvent = -1;
+    int peerEvent = -1;
+    std::deque<std::string> pending;
+    std::size_t pendingBytes = 0;
+    bool broken = false;                        // The peer corrupted the inbound ring
+
+    bool tryWrite(std::string_view frame)
+    {
+        std::uint64_t tail = out.control->tail.value.load(std::memory_order_relaxed);
+        std::uint64_t head = out.control->head.value.load(std::memory_order_acquire);
+        std::size_t need = sizeof(std::uint32_t) + frame.size();
+        if (capacity - (tail - head) < need)
+            return false;
+
+        auto length = static_cast<std::uint32_t>(frame.size());
+        copyIn(out, tail, &length, sizeof(length));
+        copyIn(out, tail + sizeof(length), frame.data(), frame.size());
+        out.control->tail.value.store(tail + need, std::memory_order_release);
+
+        // Ring for the first frame of an empty ring (readers polling fd()), and whenever the
+        // consumer asked for it; the fence pairs with armDoorbell().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (out.control->readerWaiting.exchange(0, std::memory_order_acq_rel) || head == tail)
+            ring(peerEvent);
+        return true;
+    }
+
+    // Ask the consumer for a doorbell when it frees space, then re-check to avoid a lost wakeup.
+    void waitForSpace()
+    {
+        out.control->writerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!pending.empty() && tryWrite(pending.front()))
+        {
+            pendingBytes -= pending.front().size();
+            pending.pop_front();
+        }
+    }
+
+    void copyIn(Ring& r, std::uint64_t pos, const void* src, std::size_t n)
+    {
+        std::size_t offset = static_cast<std::size_t>(pos & (capacity - 1));
+        std::size_t first = std::min(n, capacity - offset);
+        std::memcpy(r.data + offset, src, first);
+        std::memcpy(r.data, static_cast<const char*>(src) + first, n - first);
+    }
+
+    void copyOut(const Ring& r, std::uint64_t pos, void* dst, std::size_t n) const
+    {
+        std::size_t offset = static_cast<std::size_t>(pos & (capacity - 1));
+        std::size_t first = std::min(n, capacity - offset);
+        std::memcpy(dst, r.data + offset, first);
+        std::memcpy(static_cast<char*>(dst) + first, r.data, n - first);
+    }
+
+    static void ring(int fd)
+    {
+        std::uint64_t one = 1;
+        (void)::write(fd, &one, sizeof(one));
+    }
+};
+
+// RpcTransport over a ShmRingEndpoint. Frames that do not fit the ring are queued locally and
+// reported through bufferedAmount(), so pumpInbound() backpressure applies as for WebSockets.
+class ShmRingTransport : public RpcTransport
+{
+public:
+    explicit ShmRingTransport(ShmRingEndpoint* endpoint) : endpoint(endpoint) {}
+
+    using RpcTransport::send;
+
+    void send(const std::string& message) override
+    {
+        endpoint->send(std::string_view(message));
+    }
+
+    void send(std::string&& message) override
+    {
+        endpoint->send(std::move(message));
+    }
+
+    void abort(const std::string& /*reason*/) override
+    {
+        endpoint->close();
+    }
+
+    std::size_t bufferedAmount() const override
+    {
+        return endpoint->queuedBytes();
+    }
+
+private:
+    ShmRingEndpoint* endpoint;
+};
+
+// Serve one round of a shared-memory connection: wait up to `timeoutMs` for the doorbell unless
+// a frame is already waiting, flush queued output, then run inbound frames. While outbound
+// backpressure pauses the session, frames stay in the ring so the peer's writer sees a full
+// ring. Returns false once the channel is closed or the session aborted.
+inline bool pumpShmRing(RpcSession& session,
+                        RpcSessionData* sessionData,
+                        ShmRingEndpoint& endpoint,
+                        RpcTransport& transport,
+                        std::size_t highWaterMark,
+                        int timeoutMs)
+{
+    std::string frame;
+    bool paused = sessionData && sessionData->inbound.paused;
+    bool haveFrame = !paused && endpoint.receive(frame);
+    if (!haveFrame)
+        endpoint.wait(timeoutMs, !paused);
+    endpoint.flush();
+    if (paused)
+        resumeInbound(session, sessionData, transport, highWaterMark);
+
+    if (haveFrame && !session.isAborted(sessionData))
+        pumpInbound(session, sessionData, transport, frame, highWaterMark);
+    while (!session.isAborted(sessionData) && !(sessionData && sessionData->inbound.paused) && endpoint.receive(frame))
+        pumpInbound(session, sessionData, transport, frame, highWaterMark);
+    // One set of release frames per wakeup.
+    flushReleases(sessionData, transport);
+
+    return !endpoint.isClosed() && !session.isAborted(sessionData);
+}
+
+} // namespace capnwebcpp
+
+#endif // defined(__linux__)
@@ -0,0 +1,212 @@
+#pragma once
+
+// Client side of the length-prefixed socket endpoint (POSIX sockets).
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "capnwebcpp/client_api.h"
+#include "capnwebcpp/framing.h"
+
+namespace capnwebcpp
+{
+
+// Blocking client transport for setupRpcSocketEndpoint() / setupRpcUnixSocketEndpoint().
+// As a ClientBatchTransport it keeps one connection (and so one server session) open across
+// batches: each batch is written in one gather write, then frames are read until every pull
+// in the batch has been answered.
+class SocketClientTransport : public ClientBatchTransport
+{
+public:
+    // Take ownership of a connected stream socket.
+    explicit SocketClientTransport(int fd, std::size_t maxFrameSize = 16 * 1024 * 1024)
+        : fd(fd), decoder(maxFrameSize) {}
+
+    SocketClientTransport(const SocketClientTransport&) = delete;
+    SocketClientTransport& operator=(const SocketClientTransport&) = delete;
+
+    ~SocketClientTransport()
+    {
+        if (fd >= 0) ::close(fd);
+    }
+
+    static std::shared_ptr<SocketClientTransport> connectTcp(const std::string& host, int port)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* results = nullptr;
+        std::string service = std::to_string(port);
+        int rc = ::getaddrinfo(host.c_str(), service.c_str(), &hints, &results);
+        if (rc != 0)
+            throw std::runtime_error(std::string("getaddrinfo: ") + ::gai_strerror(rc));
+
+        int fd = -1;
+        for (addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next)
+        {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0) continue;
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(results);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "connect " + host + ":" + service);
+
+        // Frames are written whole; don't delay small ones.
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return std::make_shared<SocketClientTransport>(fd);
+    }
+
+    static std::shared_ptr<SocketClientTransport> connectUnix(const std::string& path)
+    {
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path))
+            throw std::invalid_argument("unix socket path too long");
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "socket");
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "connect " + path);
+        }
+        return std::make_shared<SocketClientTransport>(fd);
+    }
+
+    bool persistent() const override { return true; }
+
+    std::vector<std::string> sendBatch(const std::vector<std::string>& lines) override
+    {
+        std::size_t pulls = 0;
+        for (const auto& line : lines)
+            if (line.rfind("[\"pull\"", 0) == 0) ++pulls;
+        sendFrames(lines);
+
+        std::vector<std::string> responses;
+        std::string frame;
+        while (pulls > 0 && readFrame(frame))
+        {
+            if (frame.rfind("[\"resolve\"", 0) == 0 || frame.rfind("[\"reject\"", 0) == 0)
+                --pulls;
+            else if (frame.rfind("[\"abort\"", 0) == 0)
+                pulls = 0;
+            responses.push_back(std::move(frame));
+        }
+        return responses;
+    }
+
+    // Write frames with one gather write per group of frames.
+    void sendFrames(const std::vector<std::string>& frames)
+    {
+        constexpr std::size_t kFramesPerWrite = 256;
+        std::vector<std::array<char, kFrameHeaderSize>> headers;
+        std::vector<iovec> iov;
+        for (std::size_t begin = 0; begin < frames.size(); begin += kFramesPerWrite)
+        {
+            std::size_t end = std::min(frames.size(), begin + kFramesPerWrite);
+            headers.clear();
+            iov.clear();
+            for (std::size_t i = begin; i < end; ++i)
+                headers.push_back(encodeFrameHeader(frames[i].size()));
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                iov.push_back({ headers[i - begin].data(), kFrameHeaderSize });
+                iov.push_back({ const_cast<char*>(frames[i].data()), frames[i].size() });
+            }
+            writeAll(iov);
+        }
+    }
+
+    void sendFrame(std::string_view frame)
+    {
+        auto header = encodeFrameHeader(frame.size());
+        std::vector<iovec> iov = {
+            { header.data(), kFrameHeaderSize },
+            { const_cast<char*>(frame.data()), frame.size() },
+        };
+        writeAll(iov);
+    }
+
+    // Block for the next frame; false when the peer closed the connection.
+    bool readFrame(std::string& frame)
+    {
+        while (received.empty())
+        {
+            ssize_t n = ::recv(fd, buffer.data(), buffer.size(), 0);
+            if (n == 0) return false;
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "recv");
+            }
+            decoder.feed(std::string_view(buffer.data(), static_cast<std::size_t>(n)),
+                         [this](std::string_view f) { received.emplace_back(f); });
+        }
+        frame = std::move(received.front());
+        received.pop_front();
+        return true;
+    }
+
+private:
+    int fd;
+    FrameDecoder decoder;
+    std::array<char, 64 * 1024> buffer;
+    std::deque<std::string> received;
+
+    void writeAll(std::vector<iovec>& iov)
+    {
+        std::size_t index = 0;
+        while (index < iov.size())
+        {
+            msghdr msg{};
+            msg.msg_iov = iov.data() + index;
+            msg.msg_iovlen = iov.size() - index;
+            ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "sendmsg");
+            }
+            auto left = static_cast<std::size_t>(n);
+            while (index < iov.size() && left >= iov[index].iov_len)
+                left -= iov[index++].iov_len;
+            if (index < iov.size())
+            {
+                iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + left;
+                iov[index].iov_len -= left;
+            }
+        }
+    }
+};
+
+} // namespace capnwebcpp
+
+#endif // !defined(_WIN32)
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <App.h>
+#include <libusockets.h>
+
+namespace capnwebcpp
+{
+
+// One event loop thread hosting client connections. A keep-alive timer holds the loop open while
+// it has no sockets, so connections can come and go.
+class UwsLoopThread
+{
+public:
+    UwsLoopThread()
+    {
+        std::promise<void> started;
+        auto ready = started.get_future();
+        worker = std::thread([this, started = std::move(started)]() mutable
+        {
+            auto app = std::make_unique<uWS::App>();
+            this->app = app.get();
+            loop = uWS::Loop::get();
+            keepAlive = us_create_timer(reinterpret_cast<us_loop_t*>(loop), 0, 0);
+            started.set_value();
+            app->run();
+            this->app = nullptr;
+        });
+        ready.wait();
+    }
+
+    UwsLoopThread(const UwsLoopThread&) = delete;
+    UwsLoopThread& operator=(const UwsLoopThread&) = delete;
+
+    // Connections hosted here must be closed first.
+    ~UwsLoopThread()
+    {
+        post([this](uWS::App&) { us_timer_close(keepAlive); });
+        if (worker.joinable()) worker.join();
+    }
+
+    // Run `fn` on the loop thread. Any thread may post.
+    void post(std::function<void(uWS::App&)> fn)
+    {
+        loop->defer([this, fn = std::move(fn)]() { fn(*app); });
+    }
+
+    // Run `fn` on the loop thread and wait for it. Must not be called from the loop thread.
+    void call(std::function<void(uWS::App&)> fn)
+    {
+        if (std::this_thread::get_id() == worker.get_id())
+            throw std::logic_error("UwsLoopThread::call from its own loop thread");
+        std::promise<void> done;
+        auto finished = done.get_future();
+        post([&](uWS::App& a)
+        {
+            fn(a);
+            done.set_value();
+        });
+        finished.wait();
+    }
+
+    uWS::Loop* getLoop() const { return loop; }
+
+private:
+    std::thread worker;
+    uWS::App* app = nullptr;
+    uWS::Loop* loop = nullptr;
+    us_timer_t* keepAlive = nullptr;
+};
+
+// A few loop threads shared by many client connections (see UwsWebSocketClient and RpcWsClient
+// constructors taking a loop), instead of one thread per connection. Connections are spread
+// across the threads round robin; each stays on its thread for its lifetime. Clients keep the
+// loop alive, so it is destroyed after the last of them.
+class UwsClientLoop
+{
+public:
+    explicit UwsClientLoop(std::size_t threads = 1)
+    {
+        if (threads == 0) threads = 1;
+        loops.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i)
+            loops.push_back(std::make_unique<UwsLoopThread>());
+    }
+
+    std::size_t threads() const { return loops.size(); }
+
+    // Thread to host the next connection.
+    UwsLoopThread& next()
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        UwsLoopThread& t = *loops[nextIndex];
+        nextIndex = (nextIndex + 1) % loops.size();
+        return t;
+    }
+
+private:
+    std::mutex mu;
+    std::vector<std::unique_ptr<UwsLoopThread>> loops;
+    std::size_t nextIndex = 0;
+};
+
+} // namespace capnwebcpp
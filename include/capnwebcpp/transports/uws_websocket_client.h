@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <functional>
@@ -9,27 +10,45 @@
 #include <thread>
 
 #include <App.h>
+#include <libusockets.h>
+
+#include "capnwebcpp/transports/async_message_port.h"
+#include "capnwebcpp/transports/uws_client_loop.h"
 
 namespace capnwebcpp
 {
 
 // Minimal uWebSockets-based WebSocket client helper for persistent sessions.
 // - Connects to a ws:// URL.
-// - Provides send() to enqueue text frames on the uWS loop thread.
+// - Provides send() to enqueue text frames on the uWS loop thread. Any thread may send: frames go
+//   through a lock-free queue, and one deferred callback per loop wakeup writes everything queued
+//   under a single cork.
 // - Invokes onMessage for each received text message.
+// - Runs on its own loop thread, or on a UwsClientLoop shared with other connections.
 class UwsWebSocketClient
 {
 public:
     UwsWebSocketClient() = default;
+    explicit UwsWebSocketClient(std::shared_ptr<UwsClientLoop> sharedLoop) : sharedLoop(std::move(sharedLoop)) {}
     ~UwsWebSocketClient() { close(); }
 
-    // Connect to a WebSocket URL (ws://). Starts a background thread running the uWS loop.
+    // Connect to a WebSocket URL (ws://). Starts a background thread running the uWS loop, or
+    // opens the connection on the shared loop. Must not be called from a shared loop thread.
     void connect(const std::string& url)
     {
         std::unique_lock<std::mutex> lock(mu);
         if (running) return;
         running = true;
-        worker = std::thread([this, url]() { this->runLoop(url); });
+        if (sharedLoop)
+        {
+            host = &sharedLoop->next();
+            loop = host->getLoop();
+            host->post([this, url](uWS::App& app) { this->attach(app, url); });
+        }
+        else
+        {
+            worker = std::thread([this, url]() { this->runLoop(url); });
+        }
         // Wait until open or error/close flagged
         openedCv.wait(lock, [this]() { return this->opened || this->closed; });
         if (!opened)
@@ -42,29 +61,68 @@ public:
         onMessage = std::move(cb);
     }
 
-    void send(const std::string& message)
+    // Called on the loop thread when the connection closes.
+    void setOnClose(std::function<void()> cb)
     {
-        std::function<void(const std::string&)> sendFnCopy;
+        std::lock_guard<std::mutex> lock(mu);
+        onClose = std::move(cb);
+    }
+
+    // Called on the loop thread when the timer armed by armTimer() fires.
+    void setOnTimer(std::function<void()> cb)
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        onTimer = std::move(cb);
+    }
+
+    // Fire the timer handler on the loop thread in about `delayMs` (at least 1 ms: a zero timeout
+    // disarms the timer). Any thread may arm it; arming while it is pending does nothing. A
+    // pending timer is dropped when the connection closes.
+    void armTimer(int delayMs)
+    {
+        if (!open.load(std::memory_order_acquire) || timerArmed.exchange(true))
+            return;
+        delayMs = std::max(delayMs, 1);
+        std::lock_guard<std::mutex> lock(mu);
+        if (!loop)
+            return;
+        loop->defer([this, delayMs]()
         {
-            std::lock_guard<std::mutex> lock(mu);
-            sendFnCopy = scheduleSend;
-        }
-        if (!sendFnCopy)
+            if (timer)
+                us_timer_set(timer, [](us_timer_t* t) { (*static_cast<UwsWebSocketClient**>(us_timer_ext(t)))->fireTimer(); }, delayMs, 0);
+        });
+    }
+
+    void send(const std::string& message)
+    {
+        send(std::string(message));
+    }
+
+    void send(std::string&& message)
+    {
+        if (!open.load(std::memory_order_acquire))
             throw std::runtime_error("WebSocket not open");
-        sendFnCopy(message);
+        outbound.push(std::move(message));
+        // Only the sender that finds no flush pending schedules one.
+        if (!flushScheduled.exchange(true, std::memory_order_seq_cst))
+            scheduleFlush();
     }
 
+    // Must not be called from a shared loop thread.
     void close()
     {
         std::thread t;
+        UwsLoopThread* shared = nullptr;
         {
             std::lock_guard<std::mutex> lock(mu);
             if (!running) return;
             running = false;
             if (stopLoop) stopLoop();
             t = std::move(worker);
+            shared = host;
         }
         if (t.joinable()) t.join();
+        if (shared) detach(*shared);
     }
 
 private:
@@ -75,36 +133,118 @@ private:
     bool closed = false;
     std::condition_variable openedCv;
     std::function<void(const std::string&)> onMessage;
-    std::function<void(const std::string&)> scheduleSend;
+    std::function<void()> onClose;
+    std::function<void()> onTimer;
     std::function<void()> stopLoop;
+    std::shared_ptr<UwsClientLoop> sharedLoop;
+    UwsLoopThread* host = nullptr;             // Thread of sharedLoop hosting this connection
+    std::function<void()> endSocket;           // Loop thread only
+    us_timer_t* timer = nullptr;               // Loop thread only; lives while the socket is open
+    std::atomic<bool> timerArmed{ false };
 
-    void runLoop(const std::string& url)
+    // Outbound frames. `loop` is set and cleared under `mu`; writeQueued is only touched on the
+    // loop thread (set on open, cleared on close).
+    MpscQueue<std::string> outbound;
+    std::atomic<bool> open{ false };
+    std::atomic<bool> flushScheduled{ false };
+    uWS::Loop* loop = nullptr;
+    std::function<void()> writeQueued;
+
+    // Once per wakeup, not per frame.
+    void scheduleFlush()
     {
-        // Per-socket data type
-        struct PerSocketData { };
+        std::lock_guard<std::mutex> lock(mu);
+        if (loop)
+            loop->defer([this]() { flush(); });
+    }
 
+    void fireTimer()
+    {
+        timerArmed.store(false, std::memory_order_seq_cst);
+        std::function<void()> cb;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            cb = onTimer;
+        }
+        if (cb) cb();
+    }
+
+    // Loop thread: write every queued frame under one cork.
+    void flush()
+    {
+        // Cleared before popping so a frame queued during the flush schedules another one.
+        flushScheduled.store(false, std::memory_order_seq_cst);
+        if (writeQueued)
+        {
+            writeQueued();
+            return;
+        }
+        std::string discard;
+        while (outbound.pop(discard)) {}
+    }
+
+    // Shared loop: close the socket on its thread, wait for the close, then let flushes deferred
+    // before that run so none touches this client afterwards.
+    void detach(UwsLoopThread& shared)
+    {
+        shared.call([this](uWS::App&) { if (endSocket) endSocket(); });
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            openedCv.wait(lock, [this]() { return this->closed || !this->opened; });
+            open.store(false, std::memory_order_release);
+            loop = nullptr;
+        }
+        shared.call([](uWS::App&) {});
+    }
+
+    void runLoop(const std::string& url)
+    {
         // We'll allocate the app on the heap to control its lifetime explicitly.
         auto app = std::make_unique<uWS::App>();
         uWS::Loop* loop = uWS::Loop::get();
 
         {
             std::lock_guard<std::mutex> lock(mu);
+            this->loop = loop;
             stopLoop = [loop]() { loop->defer([loop]() { loop->close(); }); };
         }
 
-        app->connect(url,
+        attach(*app, url);
+
+        app->run();
+        // clean up
         {
-            .open = [this, loop](auto* ws)
+            std::lock_guard<std::mutex> lock(mu);
+            open.store(false, std::memory_order_release);
+            this->loop = nullptr;
+        }
+        writeQueued = nullptr;
+        endSocket = nullptr;
+    }
+
+    // Open the connection on `app`'s loop (the calling thread).
+    void attach(uWS::App& app, const std::string& url)
+    {
+        app.connect(url,
+        {
+            .open = [this](auto* ws)
             {
+                endSocket = [ws]() { ws->close(); };
+                timer = us_create_timer(reinterpret_cast<us_loop_t*>(uWS::Loop::get()), 1, sizeof(UwsWebSocketClient*));
+                *static_cast<UwsWebSocketClient**>(us_timer_ext(timer)) = this;
+                writeQueued = [this, ws]()
+                {
+                    ws->cork([this, ws]()
+                    {
+                        std::string frame;
+                        while (outbound.pop(frame))
+                            ws->send(frame, uWS::TEXT);
+                    });
+                };
                 {
                     std::lock_guard<std::mutex> lock(mu);
                     opened = true;
-                    // Arrange to schedule sends onto the loop thread safely.
-                    scheduleSend = [loop, ws](const std::string& m)
-                    {
-                        // Copy message for deferred send
-                        loop->defer([ws, m]() { ws->send(m, uWS::TEXT); });
-                    };
+                    open.store(true, std::memory_order_release);
                 }
                 openedCv.notify_all();
             },
@@ -119,20 +259,25 @@ private:
             },
             .close = [this](auto* /*ws*/, int /*code*/, std::string_view /*msg*/)
             {
+                std::function<void()> cb;
                 {
                     std::lock_guard<std::mutex> lock(mu);
                     closed = true;
+                    // No sends after close; the socket is gone.
+                    open.store(false, std::memory_order_release);
+                    cb = onClose;
+                }
+                writeQueued = nullptr;
+                endSocket = nullptr;
+                if (timer)
+                {
+                    us_timer_close(timer);
+                    timer = nullptr;
                 }
                 openedCv.notify_all();
+                if (cb) cb();
             }
         });
-
-        app->run();
-        // clean up
-        {
-            std::lock_guard<std::mutex> lock(mu);
-            scheduleSend = nullptr;
-        }
     }
 };
 
@@ -1,33 +1,100 @@
 #pragma once
 
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <App.h>
 
+#include "capnwebcpp/memory_accounting.h"
 #include "capnwebcpp/transport.h"
 
 namespace capnwebcpp
 {
 
 // RpcTransport adapter for uWebSockets WebSocket instances.
+// If `memory` is given, the socket's buffered amount is tracked as outbound memory. A frame
+// dropped by uWS (backpressure limit exceeded) breaks the message stream, so later sends are
+// skipped and the socket must be closed. Neither that nor abort() closes it here: uWS runs the
+// close handler synchronously, which would tear down the session under the handler still using
+// it. The owner closes once its handler has unwound (see closeRequest()).
+// Frames of at least `compressMinBytes` are sent compressed when the connection negotiated
+// permessage-deflate.
 template<typename WebSocketPtr>
 class UwsWebSocketTransport : public RpcTransport
 {
 public:
-    explicit UwsWebSocketTransport(WebSocketPtr socket) : socket(socket) {}
+    static constexpr std::size_t kNoCompression = std::numeric_limits<std::size_t>::max();
+
+    enum class CloseRequest { None, Dropped, Aborted };
+
+    explicit UwsWebSocketTransport(WebSocketPtr socket, MemoryAccount* memory = nullptr,
+                                   std::size_t compressMinBytes = kNoCompression)
+        : socket(socket), memory(memory), compressMinBytes(compressMinBytes) {}
+
+    using RpcTransport::send;
 
     void send(const std::string& message) override
     {
-        socket->send(message, uWS::TEXT);
+        if (closeRequested == CloseRequest::Dropped) return;
+        afterSend(socket->send(message, uWS::TEXT, message.size() >= compressMinBytes));
+    }
+
+    // Fragments go out as one fragmented WebSocket message (uncompressed), so the payload is
+    // never copied into a joined frame.
+    void sendv(std::span<const std::string_view> fragments) override
+    {
+        if (closeRequested == CloseRequest::Dropped) return;
+        if (fragments.size() <= 1)
+        {
+            std::string_view only = fragments.empty() ? std::string_view() : fragments.front();
+            afterSend(socket->send(only, uWS::TEXT, only.size() >= compressMinBytes));
+            return;
+        }
+        if (!afterSend(socket->sendFirstFragment(fragments.front(), uWS::TEXT)))
+            return;
+        for (std::size_t i = 1; i + 1 < fragments.size(); ++i)
+        {
+            if (!afterSend(socket->sendFragment(fragments[i])))
+                return;
+        }
+        afterSend(socket->sendLastFragment(fragments.back()));
+    }
+
+    std::size_t bufferedAmount() const override
+    {
+        return socket->getBufferedAmount();
     }
 
     void abort(const std::string& /*reason*/) override
     {
-        // Attempt to close the socket.
-        try { socket->close(); } catch (...) {}
+        if (closeRequested == CloseRequest::None)
+            closeRequested = CloseRequest::Aborted;
     }
 
+    // How the socket should be closed once the current handler unwinds.
+    CloseRequest closeRequest() const { return closeRequested; }
+
 private:
+    // False if the frame was dropped.
+    template<typename Status>
+    bool afterSend(Status status)
+    {
+        if (memory) memory->set(MemoryCategory::Outbound, socket->getBufferedAmount());
+        if (status != std::remove_pointer_t<WebSocketPtr>::SendStatus::DROPPED)
+            return true;
+        std::cerr << "WebSocket send dropped: backpressure limit exceeded" << std::endl;
+        closeRequested = CloseRequest::Dropped;
+        return false;
+    }
+
     WebSocketPtr socket;
+    MemoryAccount* memory;
+    std::size_t compressMinBytes;
+    CloseRequest closeRequested = CloseRequest::None;
 };
 
 } // namespace capnwebcpp
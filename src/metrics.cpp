@@ -0,0 +1,175 @@
+#include "capnwebcpp/metrics.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+namespace capnwebcpp
+{
+
+struct Metrics::ThreadMethodCounters
+{
+    std::unordered_map<std::string, MethodCounters*> local;
+    MethodCounters* other = nullptr;
+    std::vector<MethodCounters*> owned;
+
+    ~ThreadMethodCounters()
+    {
+        if (!owned.empty())
+            Metrics::instance().retireMethodCounters(owned);
+    }
+};
+
+void Metrics::retireMethodCounters(const std::vector<MethodCounters*>& counters)
+{
+    std::lock_guard<std::mutex> lock(mu);
+    for (MethodCounters* c : counters)
+    {
+        auto& t = retiredMethods[c->method];
+        t.calls += c->calls.load(std::memory_order_relaxed);
+        t.errors += c->errors.load(std::memory_order_relaxed);
+        t.nanos += c->nanos.load(std::memory_order_relaxed);
+    }
+    methodShards.erase(std::remove_if(methodShards.begin(), methodShards.end(), [&counters](const auto& c)
+    {
+        return std::find(counters.begin(), counters.end(), c.get()) != counters.end();
+    }), methodShards.end());
+}
+
+MethodCounters& Metrics::methodCounters(const std::string& method)
+{
+    // Names folded into "_other" share one per-thread entry and are not cached individually,
+    // so unbounded peer-chosen names cannot grow the per-thread map.
+    thread_local ThreadMethodCounters thread;
+    auto& local = thread.local;
+    auto& other = thread.other;
+    auto it = local.find(method);
+    if (it != local.end())
+        return *it->second;
+
+    // A full label set is never modified again, so it can be read without the lock.
+    if (other && methodNamesFull.load(std::memory_order_acquire) && methodNames.count(method) == 0)
+        return *other;
+
+    std::lock_guard<std::mutex> lock(mu);
+    std::string label = method;
+    if (methodNames.count(label) == 0)
+    {
+        if (methodNames.size() >= kMaxMethodLabels)
+            label = "_other";
+        else
+            methodNames.insert(label);
+        if (methodNames.size() >= kMaxMethodLabels)
+            methodNamesFull.store(true, std::memory_order_release);
+    }
+    if (label != method && other)
+        return *other;
+    methodShards.push_back(std::make_unique<MethodCounters>(label));
+    MethodCounters* counters = methodShards.back().get();
+    thread.owned.push_back(counters);
+    if (label == method)
+        local.emplace(label, counters);
+    else
+        other = counters;
+    return *counters;
+}
+
+static std::string escapeLabel(const std::string& value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value)
+    {
+        if (c == '\\') out += "\\\\";
+        else if (c == '"') out += "\\\"";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+static void writeHeader(std::ostringstream& out, const char* name, const char* type, const char* help)
+{
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << ' ' << type << '\n';
+}
+
+std::string Metrics::renderPrometheus() const
+{
+    std::ostringstream out;
+
+    auto writeByType = [&out](const char* name, const std::array<ShardedCounter, kMessageTypes>& counters)
+    {
+        for (std::size_t i = 0; i < kMessageTypes; ++i)
+        {
+            out << name << "{type=\"" << protocol::toString(static_cast<protocol::MessageType>(i)) << "\"} "
+                << counters[i].value() << '\n';
+        }
+    };
+
+    writeHeader(out, "capnweb_messages_in_total", "counter", "Inbound protocol messages by type.");
+    writeByType("capnweb_messages_in_total", messagesIn);
+    writeHeader(out, "capnweb_messages_out_total", "counter", "Outbound protocol messages by type.");
+    writeByType("capnweb_messages_out_total", messagesOut);
+
+    writeHeader(out, "capnweb_bytes_in_total", "counter", "Inbound protocol bytes.");
+    out << "capnweb_bytes_in_total " << bytesIn.value() << '\n';
+    writeHeader(out, "capnweb_bytes_out_total", "counter", "Outbound protocol bytes.");
+    out << "capnweb_bytes_out_total " << bytesOut.value() << '\n';
+
+    writeHeader(out, "capnweb_pull_latency_seconds", "histogram", "Time to answer a pull.");
+    std::int64_t cumulative = 0;
+    for (std::size_t i = 0; i < pullLatency.buckets.size(); ++i)
+    {
+        cumulative += pullLatency.buckets[i].value();
+        out << "capnweb_pull_latency_seconds_bucket{le=\"";
+        if (i < LatencyHistogram::kBoundsMicros.size())
+            out << static_cast<double>(LatencyHistogram::kBoundsMicros[i]) / 1e6;
+        else
+            out << "+Inf";
+        out << "\"} " << cumulative << '\n';
+    }
+    out << "capnweb_pull_latency_seconds_sum " << static_cast<double>(pullLatency.sumNanos.value()) / 1e9 << '\n';
+    out << "capnweb_pull_latency_seconds_count " << cumulative << '\n';
+
+    // Per-method totals, summed over the per-thread counters and those of exited threads.
+    std::map<std::string, MethodTotals> methods;
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        methods.insert(retiredMethods.begin(), retiredMethods.end());
+        for (const auto& c : methodShards)
+        {
+            auto& t = methods[c->method];
+            t.calls += c->calls.load(std::memory_order_relaxed);
+            t.errors += c->errors.load(std::memory_order_relaxed);
+            t.nanos += c->nanos.load(std::memory_order_relaxed);
+        }
+    }
+    writeHeader(out, "capnweb_method_seconds", "summary", "Handler time per method.");
+    for (const auto& kv : methods)
+    {
+        std::string label = escapeLabel(kv.first);
+        out << "capnweb_method_seconds_sum{method=\"" << label << "\"} "
+            << static_cast<double>(kv.second.nanos) / 1e9 << '\n';
+        out << "capnweb_method_seconds_count{method=\"" << label << "\"} " << kv.second.calls << '\n';
+    }
+    writeHeader(out, "capnweb_method_errors_total", "counter", "Handler calls that threw, per method.");
+    for (const auto& kv : methods)
+    {
+        out << "capnweb_method_errors_total{method=\"" << escapeLabel(kv.first) << "\"} "
+            << kv.second.errors << '\n';
+    }
+
+    writeHeader(out, "capnweb_microtask_queue_depth", "gauge", "Queued microtasks across sessions.");
+    out << "capnweb_microtask_queue_depth " << microtaskQueueDepth.value() << '\n';
+    writeHeader(out, "capnweb_sessions", "gauge", "Live sessions (WebSocket connections and in-flight batches).");
+    out << "capnweb_sessions " << liveSessions.value() << '\n';
+    writeHeader(out, "capnweb_exports", "gauge", "Live export table entries across sessions.");
+    out << "capnweb_exports " << liveExports.value() << '\n';
+    writeHeader(out, "capnweb_imports", "gauge", "Live import table entries across sessions.");
+    out << "capnweb_imports " << liveImports.value() << '\n';
+
+    return out.str();
+}
+
+} // namespace capnwebcpp
@@ -37,7 +37,7 @@ MessageType fromString(const std::string& type)
     return MessageType::Unknown;
 }
 
-bool parse(const std::string& text, Message& out)
+bool parse(std::string_view text, Message& out)
 {
     try
     {
@@ -45,10 +45,11 @@ bool parse(const std::string& text, Message& out)
         if (!msg.is_array() || msg.empty() || !msg[0].is_string())
             return false;
 
-        out.type = fromString(msg[0]);
-        out.params = json::array();
-        for (size_t i = 1; i < msg.size(); ++i)
-            out.params.push_back(msg[i]);
+        out.type = fromString(msg[0].get_ref<const std::string&>());
+        // Reuse the parsed array as params: drop the type tag and move the tree over.
+        auto& elements = msg.get_ref<json::array_t&>();
+        elements.erase(elements.begin());
+        out.params = std::move(msg);
         return true;
     }
     catch (...) {
@@ -58,19 +59,27 @@ bool parse(const std::string& text, Message& out)
 
 std::string serialize(const Message& msg)
 {
-    json arr = json::array();
-    arr.push_back(toString(msg.type));
+    // Frame the params directly instead of copying them into a new array first.
+    std::string out = "[\"";
+    out += toString(msg.type);
+    out += '"';
+    auto append = [&out](const json& p)
+    {
+        out += ',';
+        out += p.dump();
+    };
     if (msg.params.is_array())
     {
         for (const auto& p : msg.params)
-            arr.push_back(p);
+            append(p);
     }
     else if (!msg.params.is_null())
     {
         // Backwards-compatible: treat non-array params as a single parameter.
-        arr.push_back(msg.params);
+        append(msg.params);
     }
-    return arr.dump();
+    out += ']';
+    return out;
 }
 
 } // namespace protocol
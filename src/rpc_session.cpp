@@ -4,12 +4,41 @@
 #include "capnwebcpp/serialize.h"
 #include "capnwebcpp/logging.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
 namespace capnwebcpp
 {
 
+// Serialize an outbound frame and record it in the process-wide metrics.
+static std::string outboundFrame(const protocol::Message& msg)
+{
+    std::string frame = protocol::serialize(msg);
+    Metrics::instance().recordOutbound(msg.type, frame.size());
+    return frame;
+}
+
+// Send a message built from `type` and `params` over `transport`.
+static void sendMessage(RpcTransport& transport, protocol::MessageType type, json params)
+{
+    protocol::Message msg;
+    msg.type = type;
+    msg.params = std::move(params);
+    transport.sendMessage(std::move(msg));
+}
+
+// Build [id, value] frame params, moving `value` into place.
+static json idParams(int id, json value)
+{
+    json params = json::array();
+    auto& elements = params.get_ref<json::array_t&>();
+    elements.reserve(2);
+    elements.emplace_back(id);
+    elements.emplace_back(std::move(value));
+    return params;
+}
+
 void RpcSession::onOpen(RpcSessionData* sessionData)
 {
     std::cout << "WebSocket connection opened" << std::endl;
@@ -17,13 +46,47 @@ void RpcSession::onOpen(RpcSessionData* sessionData)
     sessionData->importer.reset();
     sessionData->targetExportId.clear();
     sessionData->targetRegistry.clear();
+    sessionData->syncTableGauges();
+    sessionData->aborted = false;
     pullCount = 0;
     aborted = false;
+    Metrics::instance().liveSessions.add();
 }
 
-void RpcSession::onClose(RpcSessionData*)
+void RpcSession::reset(std::shared_ptr<RpcTarget> newTarget)
+{
+    target = std::move(newTarget);
+    pullCount = 0;
+    aborted = false;
+    connectionAborted = false;
+    onBrokenCallbacks.clear();
+    onSendError = nullptr;
+    memoryLimits = MemoryLimits();
+    idlePolicy = ExportIdlePolicy();
+    mapperScope = serialize::Evaluator::MapperScope::LegacySessionRefs;
+    clearMicrotasks();
+}
+
+void RpcSession::onClose(RpcSessionData* sessionData)
 {
     std::cout << "WebSocket connection closed" << std::endl;
+    // Queued work must not outlive the connection it refers to.
+    clearMicrotasks(sessionData);
+    Metrics::instance().liveSessions.sub();
+}
+
+void RpcSession::clearMicrotasks()
+{
+    Metrics::instance().microtaskQueueDepth.sub(static_cast<std::int64_t>(microtasks.size()));
+    microtasks.clear();
+    pendingMicrotasks = 0;
+}
+
+void RpcSession::clearMicrotasks(RpcSessionData* owner)
+{
+    auto dropped = std::erase_if(microtasks, [owner](const Microtask& task) { return task.owner == owner; });
+    Metrics::instance().microtaskQueueDepth.sub(static_cast<std::int64_t>(dropped));
+    pendingMicrotasks = std::max(0, pendingMicrotasks - static_cast<int>(dropped));
 }
 
 void RpcSession::emitPendingReleases(RpcSessionData* sessionData, RpcTransport& transport)
@@ -31,30 +94,49 @@ void RpcSession::emitPendingReleases(RpcSessionData* sessionData, RpcTransport&
     if (!sessionData) return;
     for (auto& kv : sessionData->exporter.table)
     {
-        int exportId = kv.first;
         ExportEntry& e = kv.second;
-        (void)exportId;
-        for (const auto& imp : e.importedClientIds)
-        {
-            int importId = imp.first;
-            int count = imp.second;
-            if (count <= 0) continue;
-            protocol::Message rel;
-            rel.type = protocol::MessageType::Release;
-            rel.params = json::array({ importId, count });
-            try { transport.send(protocol::serialize(rel)); } catch (...) {}
-        }
-        e.importedClientIds.clear();
+        if (!e.cold) continue;
+        for (const auto& imp : e.cold->importedClientIds)
+            sessionData->releases.add(imp.first, imp.second);
+        e.cold->importedClientIds.clear();
     }
+    try { flushReleases(sessionData, transport); } catch (...) {}
 }
 
-std::string RpcSession::handleMessage(RpcSessionData* sessionData, const std::string& message)
+std::string RpcSession::handleMessage(RpcSessionData* sessionData, std::string_view message)
 {
-    if (aborted)
+    if (isAborted(sessionData))
         return "";
     protocol::Message m;
     if (!protocol::parse(message, m))
         return "";
+    Metrics::instance().recordInbound(m.type, message.size());
+    return handleMessage(sessionData, m);
+}
+
+std::string RpcSession::handleMessage(RpcSessionData* sessionData, const protocol::Message& m)
+{
+    protocol::Message response = handleMessageValue(sessionData, m);
+    if (response.type == protocol::MessageType::Unknown)
+        return "";
+    return outboundFrame(response);
+}
+
+protocol::Message RpcSession::handleMessageValue(RpcSessionData* sessionData, const protocol::Message& m)
+{
+    if (isAborted(sessionData))
+        return {};
+    protocol::Message response = dispatchMessage(sessionData, m);
+    if (sessionData) sessionData->syncTableGauges();
+    return response;
+}
+
+protocol::Message RpcSession::dispatchMessage(RpcSessionData* sessionData, const protocol::Message& m)
+{
+    protocol::Message abortMessage = enforceHardMemoryLimit(sessionData);
+    if (abortMessage.type != protocol::MessageType::Unknown)
+        return abortMessage;
+    maybeReclaimIdleExports(sessionData);
 
     switch (m.type)
     {
@@ -62,20 +144,23 @@ std::string RpcSession::handleMessage(RpcSessionData* sessionData, const std::st
         {
             if (m.params.size() >= 1)
                 handlePush(sessionData, m.params[0]);
-            return "";
+            return enforceHardMemoryLimit(sessionData);
         }
         case protocol::MessageType::Pull:
         {
             if (m.params.size() >= 1 && m.params[0].is_number())
             {
                 ++pullCount;
+                auto started = std::chrono::steady_clock::now();
                 auto out = handlePull(sessionData, m.params[0]);
                 if (pullCount > 0) --pullCount;
-                auto s = protocol::serialize(out);
-                debugLog(std::string("pull response: ") + s);
-                return s;
+                if (Metrics::enabled())
+                    Metrics::instance().pullLatency.record(std::chrono::steady_clock::now() - started);
+                if (debugEnabled())
+                    debugLog(std::string("pull response: ") + protocol::serialize(out));
+                return out;
             }
-            return "";
+            return {};
         }
         case protocol::MessageType::Resolve:
         case protocol::MessageType::Reject:
@@ -85,7 +170,7 @@ std::string RpcSession::handleMessage(RpcSessionData* sessionData, const std::st
             {
                 int importId = m.params[0];
                 // Parity: after import resolves/rejects, send release for remote refs.
-                int releaseCount = sessionData->importer.recordResolutionAndGetReleaseCount(importId, m.params[1]);
+                int releaseCount = sessionData->importer.recordResolutionAndGetReleaseCount(importId);
                 protocol::Message rel;
                 rel.type = protocol::MessageType::Release;
                 rel.params = json::array({ importId, releaseCount });
@@ -102,12 +187,12 @@ std::string RpcSession::handleMessage(RpcSessionData* sessionData, const std::st
                             ? protocol::MessageType::Resolve
                             : protocol::MessageType::Reject;
                         fwd.params = json::array({ promiseExportId, m.params[1] });
-                        try { sessionData->transport->send(protocol::serialize(fwd)); } catch (...) {}
+                        try { sessionData->transport->sendMessage(std::move(fwd)); } catch (...) {}
                     }
                 }
-                return protocol::serialize(rel);
+                return rel;
             }
-            return "";
+            return {};
         }
         case protocol::MessageType::Release:
         {
@@ -121,22 +206,27 @@ std::string RpcSession::handleMessage(RpcSessionData* sessionData, const std::st
                 // local refs to avoid leaks in case the peer sends such releases.
                 sessionData->importer.releaseLocal(id, count);
             }
-            return "";
+            return {};
         }
         case protocol::MessageType::Abort:
         {
             if (m.params.size() >= 1)
                 handleAbort(sessionData, m.params[0]);
-            return "";
+            return {};
         }
         default:
-            return "";
+            return {};
     }
 
-    return "";
+    return {};
 }
 
 std::string RpcSession::buildAbort(const json& errorPayload)
+{
+    return outboundFrame(buildAbortMessage(errorPayload));
+}
+
+protocol::Message RpcSession::buildAbortMessage(const json& errorPayload)
 {
     protocol::Message msg;
     msg.type = protocol::MessageType::Abort;
@@ -147,7 +237,21 @@ std::string RpcSession::buildAbort(const json& errorPayload)
         payload = redactError(payload);
     }
     msg.params = json::array({ payload });
-    return protocol::serialize(msg);
+    return msg;
+}
+
+protocol::Message RpcSession::enforceHardMemoryLimit(RpcSessionData* sessionData)
+{
+    if (!sessionData || memoryLimits.hardLimit == 0)
+        return {};
+    std::size_t total = sessionData->memory.total();
+    if (total <= memoryLimits.hardLimit)
+        return {};
+    std::string reason = "session memory limit exceeded (" + std::to_string(total) + " bytes)";
+    std::cerr << "Aborting session: " << reason << std::endl;
+    protocol::Message abortMessage = buildAbortMessage(serialize::makeError("ResourceExhausted", reason));
+    markAborted(sessionData, reason);
+    return abortMessage;
 }
 
 void RpcSession::markAborted(const std::string& reason)
@@ -161,19 +265,29 @@ void RpcSession::markAborted(const std::string& reason)
 
 void RpcSession::markAborted(RpcSessionData* sessionData, const std::string& reason)
 {
-    // Mark aborted and notify listeners.
-    markAborted(reason);
-    // Clear microtasks and reset counters.
-    microtasks.clear();
-    pendingMicrotasks = 0;
-    // Best-effort cleanup of session tables and maps.
-    if (sessionData)
+    if (!sessionData)
     {
+        markAborted(reason);
+        clearMicrotasks();
+        return;
+    }
+    // Mark the connection aborted and notify listeners.
+    sessionData->aborted = true;
+    connectionAborted = true;
+    for (auto& cb : onBrokenCallbacks)
+    {
+        try { cb(reason); } catch (...) {}
+    }
+    clearMicrotasks(sessionData);
+    // Best-effort cleanup of the connection's tables and maps.
+    {
+        sessionData->memory.clear(MemoryCategory::Microtasks);
         sessionData->exporter.reset();
         sessionData->importer.reset();
         sessionData->targetExportId.clear();
         sessionData->targetRegistry.clear();
         sessionData->importToPromiseExport.clear();
+        sessionData->syncTableGauges();
     }
 }
 
@@ -184,24 +298,41 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
 
     int exportId = sessionData->exporter.allocateForPush();
 
+    if (overSoftMemoryLimit(sessionData))
+    {
+        // Keep the ID aligned with the peer's push order; the pull observes the rejection.
+        ExportEntry entry;
+        entry.hasResult = true;
+        entry.payload().result = serialize::makeError("ResourceExhausted", "Session memory limit exceeded");
+        sessionData->exporter.put(exportId, std::move(entry));
+        return;
+    }
+
     if (pushData[0] == "pipeline" && pushData.size() >= 3)
     {
         int importId = pushData[1];
-        auto methodArray = pushData[2];
-        auto argsArray = pushData.size() >= 4 ? pushData[3] : json::array();
+        const json& methodArray = pushData[2];
+        json argsArray = pushData.size() >= 4 ? pushData[3] : json::array();
 
-        if (methodArray.is_array() && !methodArray.empty())
+        if (methodArray.is_array() && !methodArray.empty() && methodArray.back().is_string())
         {
-            std::string method = methodArray[0];
-
-            // Determine the hook to dispatch the call on.
-            std::shared_ptr<StubHook> callHook = makeLocalTargetHook(sessionData->target);
-            if (importId != 0)
+            // The method is the last element; anything before it is a property path.
+            std::string method = methodArray.back();
+            json path = methodArray;
+            path.erase(path.size() - 1);
+
+            // The main target and stubs are bound now. A call on another push's result is bound
+            // when it runs, to the stub that result holds at `path`.
+            std::shared_ptr<StubHook> callHook;
+            auto* src = importId != 0 ? sessionData->exporter.find(importId) : nullptr;
+            if (src)
+                src->lastUsed = std::chrono::steady_clock::now();
+            if (path.empty())
             {
-                if (auto* src = sessionData->exporter.find(importId))
-                {
-                    if (src->callHook) callHook = src->callHook;
-                }
+                if (importId == 0)
+                    callHook = mainTargetHook(sessionData);
+                else if (src && !src->hasOperation && !src->hasResult && src->cold && src->cold->callHook)
+                    callHook = src->cold->callHook;
             }
 
             sessionData->exporter.setOperation(exportId, method, argsArray, callHook);
@@ -210,6 +341,7 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
             auto* entry = sessionData->exporter.find(exportId);
             if (entry)
             {
+                auto& imported = entry->payload().importedClientIds;
                 std::function<void(const json&)> scan = [&](const json& v)
                 {
                     if (v.is_array())
@@ -220,7 +352,7 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
                             if (tag == "export" || tag == "promise")
                             {
                                 int id = v[1].get<int>();
-                                entry->importedClientIds[id] += 1;
+                                imported[id] += 1;
                                 return;
                             }
                         }
@@ -237,23 +369,26 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
             // Defer evaluation to microtask queue; transmit still waits for pull.
             int queuedExportId = exportId;
             json queuedArgs = argsArray;
-            enqueueTask([this, sessionData, queuedExportId, method, queuedArgs, callHook]() mutable
+            std::size_t queuedBytes = method.capacity() + estimateJsonBytes(queuedArgs);
+            sessionData->memory.add(MemoryCategory::Microtasks, queuedBytes);
+            enqueueTask(sessionData, [this, sessionData, queuedExportId, importId, path, method, queuedArgs, callHook, queuedBytes]() mutable
             {
-                auto* it = sessionData->exporter.find(queuedExportId);
-                if (!it) return;
+                sessionData->memory.sub(MemoryCategory::Microtasks, queuedBytes);
+                auto* queued = sessionData->exporter.find(queuedExportId);
+                // A remap evaluated at push time may already have computed and cached the result.
+                if (!queued || queued->hasResult) return;
                 try
                 {
+                    if (!callHook)
+                        callHook = pipelinedCallHook(sessionData, importId, path);
                     json resolvedArgs = resolvePipelineReferences(sessionData, queuedArgs);
+                    ScopedMethodTimer timer(method);
                     json result = callHook->call(method, resolvedArgs);
-                    it->hasOperation = false;
-                    it->hasResult = true;
-                    it->result = result;
+                    sessionData->exporter.setResult(queuedExportId, result);
                 }
                 catch (const std::exception& e)
                 {
-                    it->hasOperation = false;
-                    it->hasResult = true;
-                    it->result = serialize::makeError("MethodError", std::string(e.what()));
+                    sessionData->exporter.setResult(queuedExportId, serialize::makeError("MethodError", std::string(e.what())));
                 }
             });
         }
@@ -268,13 +403,7 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
         {
             auto getResult = [sessionData](int id, json& out) -> bool
             {
-                json r;
-                if (sessionData->exporter.getResult(id, r))
-                {
-                    out = r;
-                    return true;
-                }
-                return false;
+                return sessionData->exporter.getResult(id, out);
             };
             auto getOperation = [sessionData](int id, std::string& method, json& args) -> bool
             {
@@ -282,6 +411,7 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
             };
             auto dispatch = [this, sessionData](const std::string& method, const json& args) -> json
             {
+                ScopedMethodTimer timer(method);
                 return sessionData->target->dispatch(method, args);
             };
             auto cache = [sessionData](int id, const json& result)
@@ -302,12 +432,10 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
                 {
                     inner.push_back(args);
                 }
-                json pushExpr = json::array({ "push", inner });
-                sessionData->transport->send(pushExpr.dump());
+                sendMessage(*sessionData->transport, protocol::MessageType::Push, json::array({ std::move(inner) }));
 
                 // Send pull for our newly allocated import ID so the peer will deliver resolution.
-                json pullExpr = json::array({ "pull", callImportId });
-                sessionData->transport->send(pullExpr.dump());
+                sendMessage(*sessionData->transport, protocol::MessageType::Pull, json::array({ callImportId }));
 
                 // Allocate a negative export ID to represent a promise we export to the peer.
                 int promiseExportId = allocateNegativeExportId(sessionData);
@@ -333,21 +461,21 @@ void RpcSession::handlePush(RpcSessionData* sessionData, const json& pushData)
                         if (tag == "export")
                         {
                             int id = cap[1].get<int>();
-                            entry.importedClientIds[id] += 1;
+                            entry.payload().importedClientIds[id] += 1;
                         }
                     }
                 }
             }
 
             entry.hasResult = true;
-            entry.result = serialize::Evaluator::evaluateValueWithCaller(pushData, getResult, getOperation, dispatch, cache, callExport);
+            entry.payload().result = serialize::Evaluator::evaluateValueWithCaller(pushData, getResult, getOperation, dispatch, cache, callExport, mapperScope);
         }
         catch (const std::exception& e)
         {
             entry.hasResult = true;
-            entry.result = serialize::makeError("MethodError", std::string(e.what()));
+            entry.payload().result = serialize::makeError("MethodError", std::string(e.what()));
         }
-        sessionData->exporter.put(exportId, entry);
+        sessionData->exporter.put(exportId, std::move(entry));
     }
 }
 
@@ -358,6 +486,12 @@ RpcSession::RpcStats RpcSession::getStats(const RpcSessionData* sessionData) con
     {
         s.imports = static_cast<int>(sessionData->importer.table.size());
         s.exports = static_cast<int>(sessionData->exporter.table.size());
+        const MemoryAccount& mem = sessionData->memory;
+        s.resultBytes = mem.bytes(MemoryCategory::Results);
+        s.pendingArgBytes = mem.bytes(MemoryCategory::PendingArgs);
+        s.microtaskBytes = mem.bytes(MemoryCategory::Microtasks);
+        s.outboundBytes = mem.bytes(MemoryCategory::Outbound);
+        s.totalBytes = mem.total();
     }
     return s;
 }
@@ -376,12 +510,10 @@ int RpcSession::callClient(RpcSessionData* sessionData, int exportId, const json
     {
         inner.push_back(args);
     }
-    json pushExpr = json::array({ "push", inner });
-    sessionData->transport->send(pushExpr.dump());
+    sendMessage(*sessionData->transport, protocol::MessageType::Push, json::array({ std::move(inner) }));
 
     // Trigger pull so the peer will send resolve/reject for this import.
-    json pullExpr = json::array({ "pull", callImportId });
-    sessionData->transport->send(pullExpr.dump());
+    sendMessage(*sessionData->transport, protocol::MessageType::Pull, json::array({ callImportId }));
 
     // Create promise export for the peer; link import -> promise for forwarding.
     int promiseExportId = allocateNegativeExportId(sessionData);
@@ -408,17 +540,23 @@ int RpcSession::awaitClientPromise(RpcSessionData* sessionData, int importId)
     return promiseExportId;
 }
 
+json RpcSession::exportLocalTarget(RpcSessionData* sessionData, std::shared_ptr<RpcTarget> target)
+{
+    if (!sessionData || !target)
+        throw std::runtime_error("exportLocalTarget: sessionData or target is null");
+    std::uintptr_t key = reinterpret_cast<std::uintptr_t>(target.get());
+    RegisteredTarget& registered = sessionData->targetRegistry[key];
+    registered.target = std::move(target);
+    ++registered.markers;
+    int exportId = exportForResult(sessionData, false, json{ {"$export_target_ptr", key} });
+    return json::array({ "export", exportId });
+}
+
 json RpcSession::resolvePipelineReferences(RpcSessionData* sessionData, const json& value)
 {
     auto getResult = [sessionData](int exportId, json& out) -> bool
     {
-        json r;
-        if (sessionData->exporter.getResult(exportId, r))
-        {
-            out = r;
-            return true;
-        }
-        return false;
+        return sessionData->exporter.getResult(exportId, out);
     };
 
     auto getOperation = [sessionData](int exportId, std::string& method, json& args) -> bool
@@ -428,6 +566,7 @@ json RpcSession::resolvePipelineReferences(RpcSessionData* sessionData, const js
 
     auto dispatch = [this, sessionData](const std::string& method, const json& args) -> json
     {
+        ScopedMethodTimer timer(method);
         return sessionData->target->dispatch(method, args);
     };
 
@@ -436,7 +575,159 @@ json RpcSession::resolvePipelineReferences(RpcSessionData* sessionData, const js
         sessionData->exporter.cacheResult(exportId, result);
     };
 
-    return serialize::Evaluator::evaluateValue(value, getResult, getOperation, dispatch, cache);
+    return serialize::Evaluator::evaluateValue(value, getResult, getOperation, dispatch, cache, mapperScope);
+}
+
+std::shared_ptr<StubHook> RpcSession::mainTargetHook(RpcSessionData* sessionData)
+{
+    if (!sessionData->localTargetHook)
+        sessionData->localTargetHook = makeLocalTargetHook(sessionData->target);
+    return sessionData->localTargetHook;
+}
+
+int RpcSession::exportForResult(RpcSessionData* sessionData, bool isPromise, const json& payload)
+{
+    if (isPromise)
+    {
+        int id = allocateNegativeExportId(sessionData);
+        ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false;
+        e.hasResult = true;
+        e.payload().result = payload; // Promise resolves to this payload when pulled
+        e.payload().callHook = mainTargetHook(sessionData);
+        sessionData->exporter.put(id, std::move(e));
+        return id;
+    }
+
+    // Per-target export identity when provided via payload meta; otherwise the main target,
+    // dispatched through the canonical local hook.
+    std::shared_ptr<StubHook> hook;
+    std::shared_ptr<RpcTarget> markedTarget;
+    std::uintptr_t tptr = 0;
+    if (payload.is_object() && payload.contains("$export_target_ptr") &&
+        (payload["$export_target_ptr"].is_number_integer() || payload["$export_target_ptr"].is_number_unsigned()))
+    {
+        tptr = payload["$export_target_ptr"].get<std::uintptr_t>();
+        // Each marker is consumed once, as it becomes an export.
+        auto itT = sessionData->targetRegistry.find(tptr);
+        if (itT == sessionData->targetRegistry.end() || !itT->second.target)
+            throw std::runtime_error("exported target is no longer registered");
+        markedTarget = itT->second.target;
+        if (itT->second.markers > 0) --itT->second.markers;
+    }
+    else
+    {
+        hook = mainTargetHook(sessionData);
+        tptr = reinterpret_cast<std::uintptr_t>(sessionData->target.get());
+    }
+
+    // Reuse the existing negative ID if this target is already exported.
+    auto itId = sessionData->targetExportId.find(tptr);
+    if (itId != sessionData->targetExportId.end())
+    {
+        int existingId = itId->second;
+        if (auto* entry = sessionData->exporter.find(existingId))
+        {
+            entry->remoteRefcount += 1;
+            entry->lastUsed = std::chrono::steady_clock::now();
+        }
+        return existingId;
+    }
+
+    if (!hook)
+        hook = makeLocalTargetHook(markedTarget);
+    int id = allocateNegativeExportId(sessionData);
+    ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false; e.hasResult = false;
+    e.payload().callHook = hook;
+    e.payload().targetKey = tptr;
+    sessionData->exporter.put(id, std::move(e));
+    sessionData->targetExportId[tptr] = id;
+    return id;
+}
+
+std::shared_ptr<StubHook> RpcSession::pipelinedCallHook(RpcSessionData* sessionData, int importId, const json& path)
+{
+    auto* src = sessionData->exporter.find(importId);
+    if (importId == 0 || (src && !src->hasOperation && !src->hasResult))
+        throw std::runtime_error("cannot call through a property path of a stub");
+    if (!src)
+        throw std::runtime_error("Pipeline reference to non-existent export: " + std::to_string(importId));
+
+    json source;
+    if (sessionData->exporter.getResult(importId, source) && source.is_array() && source.size() >= 3 && source[0] == "error")
+        throw std::runtime_error(source[2].is_string() ? source[2].get<std::string>() : "pipelined call target was rejected");
+
+    json value = resolvePipelineReferences(sessionData, json::array({ "pipeline", importId, path }));
+    if (value.is_object() && value.contains("$export_target_ptr") &&
+        (value["$export_target_ptr"].is_number_integer() || value["$export_target_ptr"].is_number_unsigned()))
+    {
+        auto itT = sessionData->targetRegistry.find(value["$export_target_ptr"].get<std::uintptr_t>());
+        if (itT == sessionData->targetRegistry.end() || !itT->second.target)
+            throw std::runtime_error("exported target is no longer registered");
+        return makeLocalTargetHook(itT->second.target);
+    }
+    throw std::runtime_error("pipelined call target is not a stub");
+}
+
+void RpcSession::unregisterTarget(RpcSessionData* sessionData, std::uintptr_t targetKey, int exportId)
+{
+    if (targetKey == 0) return;
+    auto itId = sessionData->targetExportId.find(targetKey);
+    if (itId == sessionData->targetExportId.end() || itId->second != exportId) return;
+    sessionData->targetExportId.erase(itId);
+    // Markers still waiting in unpulled results keep the target registered.
+    auto itT = sessionData->targetRegistry.find(targetKey);
+    if (itT != sessionData->targetRegistry.end() && itT->second.markers == 0)
+        sessionData->targetRegistry.erase(itT);
+}
+
+std::size_t RpcSession::reclaimIdleExports(RpcSessionData* sessionData, std::chrono::steady_clock::time_point now)
+{
+    if (!sessionData || !idlePolicy.enabled()) return 0;
+    sessionData->lastIdleSweep = now;
+    auto ids = sessionData->exporter.collectIdle(idlePolicy, now);
+    if (ids.empty()) return 0;
+
+    // Client references captured by reclaimed exports are released back in aggregate.
+    std::unordered_map<int, int> clientReleases;
+    for (int id : ids)
+    {
+        auto* e = sessionData->exporter.find(id);
+        if (!e) continue;
+        std::uintptr_t targetKey = 0;
+        if (e->cold)
+        {
+            targetKey = e->cold->targetKey;
+            for (const auto& imp : e->cold->importedClientIds)
+            {
+                if (imp.second > 0) clientReleases[imp.first] += imp.second;
+            }
+        }
+        sessionData->exporter.remove(id);
+        unregisterTarget(sessionData, targetKey, id);
+    }
+    if (sessionData->transport)
+    {
+        for (const auto& kv : clientReleases)
+        {
+            protocol::Message rel;
+            rel.type = protocol::MessageType::Release;
+            rel.params = json::array({ kv.first, kv.second });
+            try { sessionData->transport->sendMessage(std::move(rel)); } catch (...) {}
+        }
+    }
+    debugLog("reclaimed " + std::to_string(ids.size()) + " idle export(s)");
+    return ids.size();
+}
+
+void RpcSession::maybeReclaimIdleExports(RpcSessionData* sessionData)
+{
+    if (!sessionData || !idlePolicy.enabled()) return;
+    // Sweep at a fraction of the shortest TTL so reclamation lags by at most ~25%.
+    auto ttl = idlePolicy.pulledTtl.count() > 0 ? idlePolicy.pulledTtl : idlePolicy.idleTtl;
+    if (idlePolicy.idleTtl.count() > 0 && idlePolicy.idleTtl < ttl) ttl = idlePolicy.idleTtl;
+    auto now = std::chrono::steady_clock::now();
+    if (now - sessionData->lastIdleSweep < ttl / 4) return;
+    reclaimIdleExports(sessionData, now);
 }
 
 protocol::Message RpcSession::handlePull(RpcSessionData* sessionData, int exportId)
@@ -444,184 +735,88 @@ protocol::Message RpcSession::handlePull(RpcSessionData* sessionData, int export
     // Before responding, process any queued microtasks so results are ready.
     processTasks();
     auto* itExp = sessionData->exporter.find(exportId);
+    if (itExp)
+    {
+        itExp->pulled = true;
+        itExp->lastUsed = std::chrono::steady_clock::now();
+    }
     if (itExp && itExp->hasResult)
     {
-        json& result = itExp->result;
+        json& result = itExp->payload().result;
         protocol::Message msg;
         if (result.is_array() && result.size() >= 2 && result[0] == "error")
         {
             msg.type = protocol::MessageType::Reject;
             json err = redactError(result);
-            msg.params = json::array({ exportId, err });
+            msg.params = idParams(exportId, std::move(err));
         }
         else
         {
-            msg.type = protocol::MessageType::Resolve;
-            // Devaluate result for exports/promises; then wrap arrays unless special expression.
-            json deval = serialize::devaluateForResult(result, [this, sessionData](bool isPromise, const json& payload) {
-                if (!isPromise)
+            try
+            {
+                // Devaluate result for exports/promises; then wrap arrays unless special expression.
+                json deval = serialize::devaluateForResult(result, [this, sessionData](bool isPromise, const json& payload)
                 {
-                    // Handle per-target export identity when provided via payload meta.
-                    if (payload.is_object() && payload.contains("$export_target_ptr") &&
-                        (payload["$export_target_ptr"].is_number_integer() || payload["$export_target_ptr"].is_number_unsigned()))
-                    {
-                        std::uintptr_t tptr = payload["$export_target_ptr"].get<std::uintptr_t>();
-                        // Reuse existing negative ID if present.
-                        auto itId = sessionData->targetExportId.find(tptr);
-                        if (itId != sessionData->targetExportId.end())
-                        {
-                            int existingId = itId->second;
-                            if (auto* entry = sessionData->exporter.find(existingId))
-                            {
-                                entry->remoteRefcount += 1;
-                            }
-                            return existingId;
-                        }
-                        // Allocate new negative ID and bind to this target's hook.
-                        int id = allocateNegativeExportId(sessionData);
-                        ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false; e.hasResult = false;
-                        std::shared_ptr<RpcTarget> tgt;
-                        auto itT = sessionData->targetRegistry.find(tptr);
-                        if (itT != sessionData->targetRegistry.end()) tgt = itT->second;
-                        if (!tgt) tgt = sessionData->target; // fallback to main target
-                        e.callHook = makeLocalTargetHook(tgt);
-                        sessionData->exporter.put(id, e);
-                        sessionData->targetExportId[tptr] = id;
-                        return id;
-                    }
-                    // Default: use canonical main target hook and reuse across exports of main.
-                    auto hook = sessionData->localTargetHook ? sessionData->localTargetHook
-                                                             : makeLocalTargetHook(sessionData->target);
-                    if (!sessionData->localTargetHook) sessionData->localTargetHook = hook;
-                    std::uintptr_t tptr = reinterpret_cast<std::uintptr_t>(sessionData->target.get());
-                    auto itId = sessionData->targetExportId.find(tptr);
-                    if (itId != sessionData->targetExportId.end())
-                    {
-                        int existingId = itId->second;
-                        if (auto* entry = sessionData->exporter.find(existingId)) entry->remoteRefcount += 1;
-                        return existingId;
-                    }
-                    int id = allocateNegativeExportId(sessionData);
-                    ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false; e.hasResult = false;
-                    e.callHook = hook;
-                    sessionData->exporter.put(id, e);
-                    sessionData->targetExportId[tptr] = id;
-                    return id;
-                }
+                    return exportForResult(sessionData, isPromise, payload);
+                });
+                msg.type = protocol::MessageType::Resolve;
+                if (deval.is_array() && serialize::isSpecialArray(deval))
+                    msg.params = idParams(exportId, std::move(deval));
                 else
-                {
-                    int id = allocateNegativeExportId(sessionData);
-                    ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false;
-                    e.hasResult = true;
-                    e.result = payload; // Promise resolves to this payload when pulled
-                    e.callHook = sessionData->localTargetHook ? sessionData->localTargetHook
-                                                              : makeLocalTargetHook(sessionData->target);
-                    if (!sessionData->localTargetHook) sessionData->localTargetHook = e.callHook;
-                    sessionData->exporter.put(id, e);
-                    return id;
-                }
-            });
-            if (deval.is_array() && serialize::isSpecialArray(deval))
-                msg.params = json::array({ exportId, deval });
-            else
-                msg.params = json::array({ exportId, serialize::wrapArrayIfNeeded(deval) });
+                    msg.params = idParams(exportId, serialize::wrapArrayIfNeeded(std::move(deval)));
+            }
+            catch (const std::exception& e)
+            {
+                msg.type = protocol::MessageType::Reject;
+                json err = redactError(serialize::makeError("MethodError", std::string(e.what())));
+                msg.params = idParams(exportId, std::move(err));
+            }
         }
-        // Clear result after sending; keep entry for refcount tracking if needed.
-        itExp->hasResult = false;
-        itExp->result = json();
+        // The result stays until the peer releases the export, so later pushes can still
+        // reference it.
         return msg;
     }
     else if (itExp && itExp->hasOperation)
     {
-        std::string method = itExp->method;
-        json args = itExp->args;
+        std::string method = itExp->cold->method;
+        json args = itExp->cold->args;
 
         try
         {
             json resolvedArgs = resolvePipelineReferences(sessionData, args);
 
-            std::shared_ptr<StubHook> callHook = itExp->callHook ? itExp->callHook : makeLocalTargetHook(sessionData->target);
-            json result = callHook->call(method, resolvedArgs);
-            itExp->hasOperation = false;
-            itExp->method.clear();
-            itExp->args = json();
-            itExp->hasResult = true;
-            itExp->result = result;
+            // Only calls on the main target or a stub are bound at push time; the rest are
+            // evaluated by their microtask before any pull.
+            std::shared_ptr<StubHook> callHook = itExp->cold->callHook;
+            if (!callHook)
+                throw std::runtime_error("pipelined call was not evaluated");
+            json result;
+            {
+                ScopedMethodTimer timer(method);
+                result = callHook->call(method, resolvedArgs);
+            }
+            sessionData->exporter.setResult(exportId, result);
 
             protocol::Message msg;
             msg.type = protocol::MessageType::Resolve;
-            json deval = serialize::devaluateForResult(result, [this, sessionData](bool isPromise, const json& payload) {
-                if (!isPromise)
-                {
-                    if (payload.is_object() && payload.contains("$export_target_ptr") &&
-                        (payload["$export_target_ptr"].is_number_integer() || payload["$export_target_ptr"].is_number_unsigned()))
-                    {
-                        std::uintptr_t tptr = payload["$export_target_ptr"].get<std::uintptr_t>();
-                        auto itId = sessionData->targetExportId.find(tptr);
-                        if (itId != sessionData->targetExportId.end())
-                        {
-                            int existingId = itId->second;
-                            if (auto* entry = sessionData->exporter.find(existingId)) entry->remoteRefcount += 1;
-                            return existingId;
-                        }
-                        int id = allocateNegativeExportId(sessionData);
-                        ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false; e.hasResult = false;
-                        std::shared_ptr<RpcTarget> tgt;
-                        auto itT = sessionData->targetRegistry.find(tptr);
-                        if (itT != sessionData->targetRegistry.end()) tgt = itT->second;
-                        if (!tgt) tgt = sessionData->target;
-                        e.callHook = makeLocalTargetHook(tgt);
-                        sessionData->exporter.put(id, e);
-                        sessionData->targetExportId[tptr] = id;
-                        return id;
-                    }
-                    auto hook = sessionData->localTargetHook ? sessionData->localTargetHook
-                                                             : makeLocalTargetHook(sessionData->target);
-                    if (!sessionData->localTargetHook) sessionData->localTargetHook = hook;
-                    std::uintptr_t tptr = reinterpret_cast<std::uintptr_t>(sessionData->target.get());
-                    auto itId = sessionData->targetExportId.find(tptr);
-                    if (itId != sessionData->targetExportId.end())
-                    {
-                        int existingId = itId->second;
-                        if (auto* entry = sessionData->exporter.find(existingId)) entry->remoteRefcount += 1;
-                        return existingId;
-                    }
-                    int id = allocateNegativeExportId(sessionData);
-                    ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false; e.hasResult = false;
-                    e.callHook = hook;
-                    sessionData->exporter.put(id, e);
-                    sessionData->targetExportId[tptr] = id;
-                    return id;
-                }
-                else
-                {
-                    int id = allocateNegativeExportId(sessionData);
-                    ExportEntry e; e.remoteRefcount = 1; e.hasOperation = false;
-                    e.hasResult = true;
-                    e.result = payload;
-                    e.callHook = sessionData->localTargetHook ? sessionData->localTargetHook
-                                                              : makeLocalTargetHook(sessionData->target);
-                    if (!sessionData->localTargetHook) sessionData->localTargetHook = e.callHook;
-                    sessionData->exporter.put(id, e);
-                    return id;
-                }
+            json deval = serialize::devaluateForResult(result, [this, sessionData](bool isPromise, const json& payload)
+            {
+                return exportForResult(sessionData, isPromise, payload);
             });
             if (deval.is_array() && serialize::isSpecialArray(deval))
-                msg.params = json::array({ exportId, deval });
+                msg.params = idParams(exportId, std::move(deval));
             else
-                msg.params = json::array({ exportId, serialize::wrapArrayIfNeeded(deval) });
+                msg.params = idParams(exportId, serialize::wrapArrayIfNeeded(std::move(deval)));
             return msg;
         }
         catch (const std::exception& e)
         {
             // Clear operation on error as well.
-            itExp->hasOperation = false;
-            itExp->method.clear();
-            itExp->args = json();
+            sessionData->exporter.clearPayload(exportId);
             protocol::Message msg;
             msg.type = protocol::MessageType::Reject;
             json err = redactError(serialize::makeError("MethodError", std::string(e.what())));
-            msg.params = json::array({ exportId, err });
+            msg.params = idParams(exportId, std::move(err));
             return msg;
         }
     }
@@ -631,7 +826,7 @@ protocol::Message RpcSession::handlePull(RpcSessionData* sessionData, int export
         msg.type = protocol::MessageType::Reject;
         {
             json err = redactError(serialize::makeError("ExportNotFound", "Export ID not found"));
-            msg.params = json::array({ exportId, err });
+            msg.params = idParams(exportId, std::move(err));
         }
         return msg;
     }
@@ -645,7 +840,9 @@ void RpcSession::handleRelease(RpcSessionData* sessionData, int exportId, int re
         std::cout << "Release for unknown exportId " << exportId << std::endl;
         return;
     }
-    sessionData->exporter.release(exportId, refcount);
+    std::uintptr_t targetKey = it->cold ? it->cold->targetKey : 0;
+    if (sessionData->exporter.release(exportId, refcount))
+        unregisterTarget(sessionData, targetKey, exportId);
 }
 
 void RpcSession::handleAbort(RpcSessionData* sessionData, const json& errorData)
@@ -25,6 +25,15 @@ json wrapArrayIfNeeded(const json& value)
     return value;
 }
 
+json wrapArrayIfNeeded(json&& value)
+{
+    if (!value.is_array())
+        return std::move(value);
+    json out = json::array();
+    out.get_ref<json::array_t&>().push_back(std::move(value));
+    return out;
+}
+
 json makeError(const std::string& name, const std::string& message)
 {
     return json::array({ "error", name, message });
@@ -180,23 +189,248 @@ static json traversePath(json result, const json& path)
         return result;
     for (const auto& key : path)
     {
+        // Move the child out of the (owned) parent rather than copying the subtree.
         if (key.is_string() && result.is_object())
         {
-            result = result[key.get<std::string>()];
+            json child = std::move(result[key.get_ref<const std::string&>()]);
+            result = std::move(child);
         }
         else if (key.is_number() && result.is_array())
         {
-            result = result[key.get<int>()];
+            json child = std::move(result[key.get<int>()]);
+            result = std::move(child);
         }
     }
     return result;
 }
 
+// Hooks through which runRemap() reaches the evaluator that found the remap expression.
+struct RemapHooks
+{
+    // Evaluate an expression in the enclosing scope (base input and import captures).
+    std::function<json(const json&)> evalOuter;
+    // Evaluate an expression whose pipeline references resolve through `scope`.
+    std::function<json(const json&, const Evaluator::ResultGetter&)> evalScoped;
+    const Evaluator::Dispatcher& dispatch;
+    // Calls back to the peer for export captures; null where those are unsupported.
+    const Evaluator::ExportCaller* callExport;
+    Evaluator::MapperScope scope;
+};
+
+// Evaluate ["remap", exportId, path, captures, instructions]. Inside the mapper, subject and
+// pipeline IDs n >= 0 name variable n (0 = the element, k = result of instruction k) and
+// n < 0 names capture -n-1; session exports are reachable only through import captures unless
+// hooks.scope is LegacySessionRefs.
+static json runRemap(const json& value, const RemapHooks& hooks)
+{
+    if (value.size() != 5 || !value[1].is_number() || !value[2].is_array() ||
+        !value[3].is_array() || !value[4].is_array())
+    {
+        throw std::runtime_error("invalid remap expression");
+    }
+
+    int baseExportId = value[1];
+    const json& basePath = value[2];
+    const json& captures = value[3];
+    const json& instructions = value[4];
+
+    // Build capture vector of export IDs from sender's perspective (our exports table).
+    struct Cap { bool isImport; int id; };
+    std::vector<Cap> capturesVec;
+    for (const auto& cap : captures)
+    {
+        if (!cap.is_array() || cap.size() != 2 || !cap[0].is_string() || !cap[1].is_number())
+            throw std::runtime_error("invalid remap capture");
+        std::string capTag = cap[0];
+        int id = cap[1];
+        if (capTag != "import" && capTag != "export")
+            throw std::runtime_error("unknown remap capture tag");
+        capturesVec.push_back(Cap{capTag == "import", id});
+    }
+
+    auto capture = [&](int subjectIdx) -> const Cap&
+    {
+        int capIndex = -subjectIdx - 1;
+        if (capIndex < 0 || capIndex >= (int)capturesVec.size())
+            throw std::runtime_error("remap capture index out of range");
+        return capturesVec[capIndex];
+    };
+
+    // Resolve the base input value from the export + path using pipeline evaluation.
+    json input;
+    try {
+        input = hooks.evalOuter(json::array({ "pipeline", baseExportId, basePath }));
+    } catch (...) {
+        // If base reference is not meaningful in this context, treat input as null.
+        input = json();
+    }
+
+    // The mapper runs once per element when the input is an array, else once on the input.
+    auto runMapper = [&](const json& element) -> json
+    {
+        std::vector<json> variables;
+        variables.push_back(element);
+
+        auto variable = [&](int subjectIdx) -> const json&
+        {
+            if (subjectIdx >= (int)variables.size())
+                throw std::runtime_error("remap variable index out of range");
+            return variables[subjectIdx];
+        };
+        Evaluator::ResultGetter scopedResult = [&](int id, json& out) -> bool
+        {
+            if (id >= 0)
+            {
+                if (id >= (int)variables.size() && hooks.scope == Evaluator::MapperScope::LegacySessionRefs)
+                    out = hooks.evalOuter(json::array({ "pipeline", id }));
+                else
+                    out = variable(id);
+                return true;
+            }
+            const Cap& c = capture(id);
+            if (!c.isImport)
+                throw std::runtime_error("remap reference to export capture not supported");
+            out = hooks.evalOuter(json::array({ "pipeline", c.id }));
+            return true;
+        };
+        auto evalScoped = [&](const json& expr) -> json
+        {
+            return hooks.evalScoped(expr, scopedResult);
+        };
+
+        for (const auto& instr : instructions)
+        {
+            if (!instr.is_array() || instr.empty() || !instr[0].is_string())
+                throw std::runtime_error("invalid remap instruction");
+            std::string itag = instr[0].get<std::string>();
+            if (itag == "pipeline")
+            {
+                if (instr.size() < 3 || !instr[1].is_number() || !instr[2].is_array())
+                    throw std::runtime_error("invalid pipeline instruction");
+                int subjectIdx = instr[1];
+                const json& path = instr[2];
+                bool hasArgs = instr.size() >= 4;
+
+                json resultVal;
+                if (subjectIdx < 0)
+                {
+                    const Cap& c = capture(subjectIdx);
+                    json resolvedArgs = hasArgs ? evalScoped(instr[3]) : json::array();
+                    if (c.isImport)
+                    {
+                        // Import capture: treat as local dispatch on our main/target.
+                        if (!path.is_array() || path.empty() || !path[0].is_string())
+                            throw std::runtime_error("remap pipeline invalid method path");
+                        resultVal = hooks.dispatch(path[0].get<std::string>(), resolvedArgs);
+                    }
+                    else if (hooks.callExport)
+                    {
+                        // Export capture: call back to the peer using client-call path.
+                        resultVal = (*hooks.callExport)(c.id, path, resolvedArgs);
+                    }
+                    else
+                    {
+                        throw std::runtime_error("remap pipeline on export capture not supported");
+                    }
+                }
+                else
+                {
+                    // For local JSON values, only support property get (ignore args).
+                    resultVal = traversePath(variable(subjectIdx), path);
+                }
+                variables.push_back(std::move(resultVal));
+            }
+            else if (itag == "value")
+            {
+                // Push a literal value (evaluate recursively to allow expressions).
+                if (instr.size() != 2)
+                    throw std::runtime_error("invalid value instruction");
+                variables.push_back(evalScoped(instr[1]));
+            }
+            else if (itag == "get")
+            {
+                // Read a property path from a subject (local var or capture).
+                if (instr.size() != 3 || !instr[1].is_number() || !instr[2].is_array())
+                    throw std::runtime_error("invalid get instruction");
+                int subjectIdx = instr[1];
+                const json& path = instr[2];
+                json resultVal;
+                if (subjectIdx < 0)
+                {
+                    const Cap& c = capture(subjectIdx);
+                    if (c.isImport)
+                        resultVal = hooks.evalOuter(json::array({ "pipeline", c.id, path }));
+                    else if (hooks.callExport)
+                        resultVal = (*hooks.callExport)(c.id, path, json());
+                    else
+                        throw std::runtime_error("remap get on export capture not supported");
+                }
+                else
+                {
+                    resultVal = traversePath(variable(subjectIdx), path);
+                }
+                variables.push_back(std::move(resultVal));
+            }
+            else if (itag == "array")
+            {
+                if (instr.size() != 2 || !instr[1].is_array())
+                    throw std::runtime_error("invalid array instruction");
+                json out = json::array();
+                for (const auto& elem : instr[1])
+                {
+                    if (elem.is_array() && elem.size() == 2 && elem[0].is_string() && elem[0] == "value")
+                        out.push_back(evalScoped(elem[1]));
+                    else
+                        out.push_back(evalScoped(elem));
+                }
+                variables.push_back(std::move(out));
+            }
+            else if (itag == "object")
+            {
+                if (instr.size() != 2 || !instr[1].is_array())
+                    throw std::runtime_error("invalid object instruction");
+                json out = json::object();
+                for (const auto& kv : instr[1])
+                {
+                    if (!kv.is_array() || kv.size() != 2 || !kv[0].is_string())
+                        throw std::runtime_error("invalid object entry");
+                    std::string key = kv[0].get<std::string>();
+                    const auto& vexpr = kv[1];
+                    if (vexpr.is_array() && vexpr.size() == 2 && vexpr[0].is_string() && vexpr[0] == "value")
+                        out[key] = evalScoped(vexpr[1]);
+                    else
+                        out[key] = evalScoped(vexpr);
+                }
+                variables.push_back(std::move(out));
+            }
+            else if (itag == "remap")
+            {
+                // Support nested remap by evaluating the full expression.
+                variables.push_back(evalScoped(instr));
+            }
+            else
+            {
+                throw std::runtime_error("unsupported remap instruction tag");
+            }
+        }
+
+        return variables.back();
+    };
+
+    if (!input.is_array())
+        return runMapper(input);
+    json mapped = json::array();
+    for (const auto& element : input)
+        mapped.push_back(runMapper(element));
+    return mapped;
+}
+
 json Evaluator::evaluateValue(const json& value,
                               const ResultGetter& getResult,
                               const OperationGetter& getOperation,
                               const Dispatcher& dispatch,
-                              const Cacher& cache)
+                              const Cacher& cache,
+                              MapperScope scope)
 {
     // Depth pre-scan to avoid excessive nesting
     std::function<int(const json&, int)> depthOf = [&](const json& v, int d) -> int
@@ -228,194 +462,20 @@ json Evaluator::evaluateValue(const json& value,
             if (tag == "remap")
             {
                 // ["remap", exportId, path, captures, instructions]
-                if (value.size() != 5 || !value[1].is_number() || !value[2].is_array() ||
-                    !value[3].is_array() || !value[4].is_array())
-                {
-                    throw std::runtime_error("invalid remap expression");
-                }
-
-                int baseExportId = value[1];
-                const json& basePath = value[2];
-                const json& captures = value[3];
-                const json& instructions = value[4];
-
-                // Build capture vector of export IDs from sender's perspective (our exports table).
-                struct Cap { bool isImport; int id; };
-                std::vector<Cap> capturesVec;
-                for (const auto& cap : captures)
-                {
-                    if (!cap.is_array() || cap.size() != 2 || !cap[0].is_string() || !cap[1].is_number())
-                        throw std::runtime_error("invalid remap capture");
-                    std::string capTag = cap[0];
-                    int id = cap[1];
-                    if (capTag != "import" && capTag != "export")
-                        throw std::runtime_error("unknown remap capture tag");
-                    capturesVec.push_back(Cap{capTag == "import", id});
-                }
-
-                // Resolve the base input value from the export + path using pipeline evaluation.
-                json basePipeline = json::array({ "pipeline", baseExportId, basePath });
-                json input;
-                try {
-                    input = evaluateValue(basePipeline, getResult, getOperation, dispatch, cache);
-                } catch (...) {
-                    // If base reference is not meaningful in this context, treat input as null.
-                    input = json();
-                }
-
-                std::vector<json> variables;
-                variables.push_back(input);
-
-                auto applyPathGet = [](json subject, const json& path) -> json
-                {
-                    if (!path.is_array()) return subject;
-                    for (const auto& key : path)
-                    {
-                        if (key.is_string() && subject.is_object())
-                            subject = subject[key.get<std::string>()];
-                        else if (key.is_number() && subject.is_array())
-                            subject = subject[key.get<int>()];
-                    }
-                    return subject;
-                };
-
-                for (const auto& instr : instructions)
-                {
-                    if (!instr.is_array() || instr.empty() || !instr[0].is_string())
-                        throw std::runtime_error("invalid remap instruction");
-                    std::string itag = instr[0].get<std::string>();
-                    if (itag == "pipeline")
-                    {
-                        if (instr.size() < 3 || !instr[1].is_number() || !instr[2].is_array())
-                            throw std::runtime_error("invalid pipeline instruction");
-                        int subjectIdx = instr[1];
-                        const json& path = instr[2];
-                        bool hasArgs = instr.size() >= 4;
-                        json args = hasArgs ? instr[3] : json::array();
-
-                        json resultVal;
-                        if (subjectIdx < 0)
-                        {
-                            int capIndex = -subjectIdx - 1;
-                            if (capIndex < 0 || capIndex >= (int)capturesVec.size())
-                                throw std::runtime_error("remap capture index out of range");
-                            const Cap& c = capturesVec[capIndex];
-                            if (!c.isImport)
-                                throw std::runtime_error("remap pipeline on export capture not supported");
-                            // Without a caller hook here, remap with captured calls must be evaluated in
-                            // evaluateValueWithCaller(), not this path.
-                            json resolvedArgs = hasArgs ? evaluateValue(args, getResult, getOperation, dispatch, cache) : json::array();
-                            if (!path.is_array() || path.empty() || !path[0].is_string())
-                                throw std::runtime_error("remap pipeline invalid method path");
-                            std::string method = path[0];
-                            // Treat like a local dispatch of the captured import's method name.
-                            resultVal = dispatch(method, resolvedArgs);
-                        }
-                        else
-                        {
-                            if (subjectIdx >= (int)variables.size())
-                                throw std::runtime_error("remap variable index out of range");
-                            json subj = variables[subjectIdx];
-                            // For local JSON values, only support property get (ignore args).
-                            resultVal = applyPathGet(subj, path);
-                        }
-
-                        variables.push_back(resultVal);
-                    }
-                    else if (itag == "value")
-                    {
-                        // Push a literal value (evaluate recursively to allow expressions).
-                        if (instr.size() != 2)
-                            throw std::runtime_error("invalid value instruction");
-                        variables.push_back(evaluateValue(instr[1], getResult, getOperation, dispatch, cache));
-                    }
-                    else if (itag == "get")
-                    {
-                        // Read a property path from a subject (local var or capture).
-                        if (instr.size() != 3 || !instr[1].is_number() || !instr[2].is_array())
-                            throw std::runtime_error("invalid get instruction");
-                        int subjectIdx = instr[1];
-                        const json& path = instr[2];
-                        json resultVal;
-                        if (subjectIdx < 0)
-                        {
-                            int capIndex = -subjectIdx - 1;
-                            if (capIndex < 0 || capIndex >= (int)capturesVec.size())
-                                throw std::runtime_error("remap capture index out of range");
-                            const Cap& c = capturesVec[capIndex];
-                            if (!c.isImport)
-                                throw std::runtime_error("remap get on export capture not supported");
-                            int expId = c.id;
-                            json expr = json::array({ "pipeline", expId, path });
-                            resultVal = evaluateValue(expr, getResult, getOperation, dispatch, cache);
-                        }
-                        else
-                        {
-                            if (subjectIdx >= (int)variables.size())
-                                throw std::runtime_error("remap variable index out of range");
-                            resultVal = applyPathGet(variables[subjectIdx], path);
-                        }
-                        variables.push_back(resultVal);
-                    }
-                    else if (itag == "array")
-                    {
-                        if (instr.size() != 2 || !instr[1].is_array())
-                            throw std::runtime_error("invalid array instruction");
-                        json out = json::array();
-                        for (const auto& elem : instr[1])
-                        {
-                            if (elem.is_array() && elem.size() == 2 && elem[0].is_string() && elem[0] == "value")
-                            {
-                                out.push_back(evaluateValue(elem[1], getResult, getOperation, dispatch, cache));
-                            }
-                            else
-                            {
-                                out.push_back(evaluateValue(elem, getResult, getOperation, dispatch, cache));
-                            }
-                        }
-                        variables.push_back(out);
-                    }
-                    else if (itag == "object")
-                    {
-                        if (instr.size() != 2 || !instr[1].is_array())
-                            throw std::runtime_error("invalid object instruction");
-                        json out = json::object();
-                        for (const auto& kv : instr[1])
-                        {
-                            if (!kv.is_array() || kv.size() != 2 || !kv[0].is_string())
-                                throw std::runtime_error("invalid object entry");
-                            std::string key = kv[0].get<std::string>();
-                            const auto& vexpr = kv[1];
-                            if (vexpr.is_array() && vexpr.size() == 2 && vexpr[0].is_string() && vexpr[0] == "value")
-                                out[key] = evaluateValue(vexpr[1], getResult, getOperation, dispatch, cache);
-                            else
-                                out[key] = evaluateValue(vexpr, getResult, getOperation, dispatch, cache);
-                        }
-                        variables.push_back(out);
-                    }
-                    else if (itag == "remap")
-                    {
-                        // Support nested remap by evaluating the full expression.
-                        json nested = evaluateValue(instr, getResult, getOperation, dispatch, cache);
-                        variables.push_back(nested);
-                    }
-                    else
-                    {
-                        throw std::runtime_error("unsupported remap instruction tag");
-                    }
-                }
-
-                if (variables.empty())
-                    return json();
-                else
-                    return variables.back();
+                RemapHooks hooks{
+                    [&](const json& expr) { return evaluateValue(expr, getResult, getOperation, dispatch, cache, scope); },
+                    [&](const json& expr, const ResultGetter& vars) { return evaluateValue(expr, vars, getOperation, dispatch, cache, scope); },
+                    dispatch,
+                    nullptr,
+                    scope };
+                return runRemap(value, hooks);
             }
             else if (tag == "value")
             {
                 // Expression wrapper: evaluate and return the inner value.
                 if (value.size() != 2)
                     throw std::runtime_error("invalid value expression");
-                return evaluateValue(value[1], getResult, getOperation, dispatch, cache);
+                return evaluateValue(value[1], getResult, getOperation, dispatch, cache, scope);
             }
             if (tag == "bigint")
             {
@@ -473,7 +533,7 @@ json Evaluator::evaluateValue(const json& value,
                 {
                     if (!isValidPath(value[2]))
                         throw std::runtime_error("invalid pipeline path");
-                    result = traversePath(result, value[2]);
+                    result = traversePath(std::move(result), value[2]);
                 }
                 return result;
             }
@@ -487,7 +547,7 @@ json Evaluator::evaluateValue(const json& value,
                 }
 
                 // Resolve arguments (may contain pipeline references as well).
-                json resolvedArgs = evaluateValue(args, getResult, getOperation, dispatch, cache);
+                json resolvedArgs = evaluateValue(args, getResult, getOperation, dispatch, cache, scope);
 
                 json computed = dispatch(method, resolvedArgs);
                 cache(exportId, computed);
@@ -496,7 +556,7 @@ json Evaluator::evaluateValue(const json& value,
                 {
                     if (!isValidPath(value[2]))
                         throw std::runtime_error("invalid pipeline path");
-                    computed = traversePath(computed, value[2]);
+                    computed = traversePath(std::move(computed), value[2]);
                 }
                 return computed;
             }
@@ -506,7 +566,7 @@ json Evaluator::evaluateValue(const json& value,
             json resolved = json::array();
             for (const auto& elem : value)
             {
-                resolved.push_back(evaluateValue(elem, getResult, getOperation, dispatch, cache));
+                resolved.push_back(evaluateValue(elem, getResult, getOperation, dispatch, cache, scope));
             }
             return resolved;
         }
@@ -518,10 +578,10 @@ json Evaluator::evaluateValue(const json& value,
         {
             if (key == "__proto__" || key == "toJSON")
             {
-                (void)evaluateValue(val, getResult, getOperation, dispatch, cache);
+                (void)evaluateValue(val, getResult, getOperation, dispatch, cache, scope);
                 continue;
             }
-            resolved[key] = evaluateValue(val, getResult, getOperation, dispatch, cache);
+            resolved[key] = evaluateValue(val, getResult, getOperation, dispatch, cache, scope);
         }
         return resolved;
     }
@@ -536,7 +596,8 @@ json Evaluator::evaluateValueWithCaller(const json& value,
                               const OperationGetter& getOperation,
                               const Dispatcher& dispatch,
                               const Cacher& cache,
-                              const ExportCaller& callExport)
+                              const ExportCaller& callExport,
+                              MapperScope scope)
 {
     // Local recursive evaluator that routes captured pipelines via callExport.
     std::function<json(const json&)> eval = [&](const json& v) -> json
@@ -548,178 +609,13 @@ json Evaluator::evaluateValueWithCaller(const json& value,
                 const std::string tag = v[0];
                 if (tag == "remap")
                 {
-                    if (v.size() != 5 || !v[1].is_number() || !v[2].is_array() ||
-                        !v[3].is_array() || !v[4].is_array())
-                        throw std::runtime_error("invalid remap expression");
-
-                    int baseExportId = v[1];
-                    const json& basePath = v[2];
-                    const json& captures = v[3];
-                    const json& instructions = v[4];
-
-                    struct Cap { bool isImport; int id; };
-                    std::vector<Cap> capturesVec;
-                    for (const auto& cap : captures)
-                    {
-                        if (!cap.is_array() || cap.size() != 2 || !cap[0].is_string() || !cap[1].is_number())
-                            throw std::runtime_error("invalid remap capture");
-                        std::string capTag = cap[0];
-                        int id = cap[1];
-                        if (capTag != "import" && capTag != "export")
-                            throw std::runtime_error("unknown remap capture tag");
-                        capturesVec.push_back(Cap{capTag == "import", id});
-                    }
-
-                    json input;
-                    try {
-                        input = eval(json::array({"pipeline", baseExportId, basePath}));
-                    } catch (...) { input = json(); }
-
-                    std::vector<json> variables;
-                    variables.push_back(input);
-
-                    auto applyPathGet = [](json subject, const json& path) -> json
-                    {
-                        if (!path.is_array()) return subject;
-                        for (const auto& key : path)
-                        {
-                            if (key.is_string() && subject.is_object())
-                                subject = subject[key.get<std::string>()];
-                            else if (key.is_number() && subject.is_array())
-                                subject = subject[key.get<int>()];
-                        }
-                        return subject;
-                    };
-
-                    for (const auto& instr : instructions)
-                    {
-                        if (!instr.is_array() || instr.empty() || !instr[0].is_string())
-                            throw std::runtime_error("invalid remap instruction");
-                        std::string itag = instr[0];
-                        if (itag == "pipeline")
-                        {
-                            if (instr.size() < 3 || !instr[1].is_number() || !instr[2].is_array())
-                                throw std::runtime_error("invalid pipeline instruction");
-                            int subjectIdx = instr[1];
-                            const json& path = instr[2];
-                            bool hasArgs = instr.size() >= 4;
-                            json args = hasArgs ? instr[3] : json::array();
-
-                            json resultVal;
-                            if (subjectIdx < 0)
-                            {
-                                int capIndex = -subjectIdx - 1;
-                                if (capIndex < 0 || capIndex >= (int)capturesVec.size())
-                                    throw std::runtime_error("remap capture index out of range");
-                                const Cap& c = capturesVec[capIndex];
-                                if (c.isImport)
-                                {
-                                    // Import capture: treat as local dispatch on our main/target.
-                                    json resolvedArgs = hasArgs ? eval(args) : json::array();
-                                    if (!path.is_array() || path.empty() || !path[0].is_string())
-                                        throw std::runtime_error("remap pipeline invalid method path");
-                                    std::string method = path[0].get<std::string>();
-                                    resultVal = dispatch(method, resolvedArgs);
-                                }
-                                else
-                                {
-                                    // Export capture: call back to the peer using client-call path.
-                                    json resolvedArgs = hasArgs ? eval(args) : json::array();
-                                    resultVal = callExport(c.id, path, resolvedArgs);
-                                }
-                            }
-                            else
-                            {
-                                if (subjectIdx >= (int)variables.size())
-                                    throw std::runtime_error("remap variable index out of range");
-                                json subj = variables[subjectIdx];
-                                resultVal = applyPathGet(subj, path);
-                            }
-                            variables.push_back(resultVal);
-                        }
-                        else if (itag == "value")
-                        {
-                            if (instr.size() != 2)
-                                throw std::runtime_error("invalid value instruction");
-                            variables.push_back(eval(instr[1]));
-                        }
-                        else if (itag == "get")
-                        {
-                            if (instr.size() != 3 || !instr[1].is_number() || !instr[2].is_array())
-                                throw std::runtime_error("invalid get instruction");
-                            int subjectIdx = instr[1];
-                            const json& path = instr[2];
-                            json resultVal;
-                            if (subjectIdx < 0)
-                            {
-                                int capIndex = -subjectIdx - 1;
-                                if (capIndex < 0 || capIndex >= (int)capturesVec.size())
-                                    throw std::runtime_error("remap capture index out of range");
-                                const Cap& c = capturesVec[capIndex];
-                                if (c.isImport)
-                                {
-                                    resultVal = eval(json::array({"pipeline", c.id, path}));
-                                }
-                                else
-                                {
-                                    // Export capture: perform property get via client-call path.
-                                    resultVal = callExport(c.id, path, json());
-                                }
-                            }
-                            else
-                            {
-                                if (subjectIdx >= (int)variables.size())
-                                    throw std::runtime_error("remap variable index out of range");
-                                resultVal = applyPathGet(variables[subjectIdx], path);
-                            }
-                            variables.push_back(resultVal);
-                        }
-                        else if (itag == "array")
-                        {
-                            if (instr.size() != 2 || !instr[1].is_array())
-                                throw std::runtime_error("invalid array instruction");
-                            json out = json::array();
-                            for (const auto& elem : instr[1])
-                            {
-                                if (elem.is_array() && elem.size() == 2 && elem[0].is_string() && elem[0] == "value")
-                                    out.push_back(eval(elem[1]));
-                                else
-                                    out.push_back(eval(elem));
-                            }
-                            variables.push_back(out);
-                        }
-                        else if (itag == "object")
-                        {
-                            if (instr.size() != 2 || !instr[1].is_array())
-                                throw std::runtime_error("invalid object instruction");
-                            json out = json::object();
-                            for (const auto& kv : instr[1])
-                            {
-                                if (!kv.is_array() || kv.size() != 2 || !kv[0].is_string())
-                                    throw std::runtime_error("invalid object entry");
-                                std::string key = kv[0].get<std::string>();
-                                const auto& vexpr = kv[1];
-                                if (vexpr.is_array() && vexpr.size() == 2 && vexpr[0].is_string() && vexpr[0] == "value")
-                                    out[key] = eval(vexpr[1]);
-                                else
-                                    out[key] = eval(vexpr);
-                            }
-                            variables.push_back(out);
-                        }
-                        else if (itag == "remap")
-                        {
-                            variables.push_back(eval(instr));
-                        }
-                        else
-                        {
-                            throw std::runtime_error("unsupported remap instruction tag");
-                        }
-                    }
-
-                    if (variables.empty())
-                        return json();
-                    else
-                        return variables.back();
+                    RemapHooks hooks{
+                        eval,
+                        [&](const json& expr, const ResultGetter& vars) { return evaluateValueWithCaller(expr, vars, getOperation, dispatch, cache, callExport, scope); },
+                        dispatch,
+                        &callExport,
+                        scope };
+                    return runRemap(v, hooks);
                 }
                 else if (tag == "value")
                 {
@@ -758,7 +654,7 @@ json Evaluator::evaluateValueWithCaller(const json& value,
                 json res;
                 if (getResult(exportId, res))
                 {
-                    if (v.size() >= 3) res = traversePath(res, v[2]);
+                    if (v.size() >= 3) res = traversePath(std::move(res), v[2]);
                     return res;
                 }
                 else
@@ -768,7 +664,7 @@ json Evaluator::evaluateValueWithCaller(const json& value,
                     json resolvedArgs = eval(args);
                     json computed = dispatch(method, resolvedArgs);
                     cache(exportId, computed);
-                    if (v.size() >= 3) computed = traversePath(computed, v[2]);
+                    if (v.size() >= 3) computed = traversePath(std::move(computed), v[2]);
                     return computed;
                 }
             }
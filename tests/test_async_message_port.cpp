@@ -0,0 +1,165 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/transports/async_message_port.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Wakeup hook target for a thread that sleeps until its port has messages.
+struct Doorbell
+{
+    std::mutex m;
+    std::condition_variable cv;
+    bool rung = false;
+
+    void ring()
+    {
+        { std::lock_guard<std::mutex> lock(m); rung = true; }
+        cv.notify_one();
+    }
+
+    bool wait(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        bool ok = cv.wait_for(lock, timeout, [this] { return rung; });
+        rung = false;
+        return ok;
+    }
+};
+
+struct TestTarget : public RpcTarget
+{
+    std::thread::id callerThread;
+
+    TestTarget()
+    {
+        method("square", [this](const json& args)
+        {
+            callerThread = std::this_thread::get_id();
+            int v = args[0].get<int>();
+            return json(v * v);
+        });
+    }
+};
+
+static bool testMultipleProducers()
+{
+    AsyncMessagePort consumer;
+    std::vector<AsyncMessagePort> producers(4);
+    std::atomic<int> wakeups{ 0 };
+    consumer.setWakeup([&] { wakeups++; });
+    std::vector<std::string> got;
+    consumer.setHandler([&](const std::string& m) { got.push_back(m); });
+    for (auto& p : producers) p.setPeer(&consumer);
+
+    const int perProducer = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&, t]
+        {
+            for (int i = 0; i < perProducer; ++i)
+                producers[t].postMessage(std::to_string(t) + ":" + std::to_string(i));
+        });
+    }
+    // Drain concurrently with the producers.
+    while (got.size() < 4u * perProducer) consumer.drain();
+    for (auto& t : threads) t.join();
+    consumer.drain();
+
+    bool ok = require(got.size() == 4u * perProducer, "mpsc: every message delivered once");
+    std::vector<int> next(4, 0);
+    for (const auto& m : got)
+    {
+        int t = m[0] - '0';
+        ok &= require(std::stoi(m.substr(2)) == next[t]++, "mpsc: per-producer order kept");
+        if (!ok) break;
+    }
+    ok &= require(wakeups.load() >= 1 && wakeups.load() < 4 * perProducer, "mpsc: wakeups coalesced");
+    return ok;
+}
+
+static bool testSessionOnAnotherThread()
+{
+    AsyncMessageChannel channel;
+    auto target = std::make_shared<TestTarget>();
+    Doorbell serverBell, clientBell;
+    std::atomic<bool> stop{ false };
+    channel.port1.setWakeup([&] { serverBell.ring(); });
+    channel.port2.setWakeup([&] { clientBell.ring(); });
+
+    std::thread server([&]
+    {
+        RpcSession session(target);
+        RpcSessionData data; data.target = target;
+        AsyncMessagePortTransport transport(&channel.port1);
+        channel.port1.setHandler([&](const std::string& message)
+        {
+            pumpMessage(session, &data, transport, message);
+            session.processTasks();
+        });
+        while (!stop.load())
+        {
+            serverBell.wait(std::chrono::milliseconds(50));
+            channel.port1.drain();
+        }
+    });
+
+    std::vector<json> responses;
+    channel.port2.setHandler([&](const std::string& m) { responses.push_back(json::parse(m)); });
+
+    const int calls = 100;
+    for (int i = 1; i <= calls; ++i)
+    {
+        channel.port2.postMessage(json::array({ "push", json::array({ "pipeline", 0, json::array({ "square" }), json::array({ i }) }) }).dump());
+        channel.port2.postMessage(json::array({ "pull", i }).dump());
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (static_cast<int>(responses.size()) < calls && std::chrono::steady_clock::now() < deadline)
+    {
+        clientBell.wait(std::chrono::milliseconds(50));
+        channel.port2.drain();
+    }
+    stop = true;
+    server.join();
+
+    bool ok = require(static_cast<int>(responses.size()) == calls, "async port: all calls answered");
+    for (int i = 0; ok && i < calls; ++i)
+        ok &= require(responses[i] == json::array({ "resolve", i + 1, (i + 1) * (i + 1) }), "async port: resolve in order");
+    ok &= require(target->callerThread != std::this_thread::get_id(), "async port: handler ran on server thread");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testMultipleProducers()) failures++;
+    if (!testSessionOnAnotherThread()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All async message port tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " async message port test(s) failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Transport whose undelivered byte count is controlled by the test.
+struct SlowTransport : public RpcTransport
+{
+    std::vector<std::string> sent;
+    std::size_t buffered = 0;
+
+    void send(const std::string& message) override
+    {
+        sent.push_back(message);
+        buffered += message.size();
+    }
+    void abort(const std::string&) override {}
+    std::size_t bufferedAmount() const override { return buffered; }
+};
+
+struct TestTarget : public RpcTarget
+{
+    int calls = 0;
+
+    TestTarget()
+    {
+        method("echo", [this](const json& args){ ++calls; return args.is_array() && !args.empty() ? args[0] : json(); });
+    }
+};
+
+static std::string push(const std::string& method, const json& args = json::array())
+{
+    return json::array({ "push", json::array({ "pipeline", 0, json::array({ method }), args }) }).dump();
+}
+
+static std::string pull(int id)
+{
+    return json::array({ "pull", id }).dump();
+}
+
+static bool testPauseAndResume()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    SlowTransport transport;
+    const std::size_t mark = 64;
+    bool ok = true;
+
+    std::string big(100, 'x');
+    pumpInbound(session, &data, transport, push("echo", json::array({ big })), mark);
+    pumpInbound(session, &data, transport, pull(1), mark);
+    ok &= require(transport.sent.size() == 1, "first resolve sent");
+    ok &= require(data.inbound.paused, "paused above high-water mark");
+
+    // Further frames are deferred, not executed.
+    pumpInbound(session, &data, transport, push("echo", json::array({ 2 })), mark);
+    pumpInbound(session, &data, transport, pull(2), mark);
+    ok &= require(data.inbound.frames.size() == 2, "frames deferred");
+    ok &= require(target->calls == 1, "deferred push not executed");
+    ok &= require(data.memory.bytes(MemoryCategory::PendingArgs) > 0, "deferred frames accounted");
+
+    // Still above the mark: nothing runs.
+    resumeInbound(session, &data, transport, mark);
+    ok &= require(data.inbound.frames.size() == 2 && data.inbound.paused, "still paused");
+
+    // Drained: backlog runs in order.
+    transport.buffered = 0;
+    resumeInbound(session, &data, transport, mark);
+    ok &= require(data.inbound.frames.empty(), "backlog drained");
+    ok &= require(!data.inbound.paused, "resumed");
+    ok &= require(target->calls == 2, "deferred push executed");
+    ok &= require(transport.sent.size() == 2 && transport.sent[1] == json::array({ "resolve", 2, 2 }).dump(),
+                  "deferred pull answered");
+    ok &= require(data.memory.bytes(MemoryCategory::PendingArgs) == 0, "deferred bytes released");
+    return ok;
+}
+
+static bool testResumeStopsAtMark()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    SlowTransport transport;
+    const std::size_t mark = 64;
+    bool ok = true;
+
+    data.inbound.paused = true;
+    std::string big(100, 'y');
+    for (int id = 1; id <= 2; ++id)
+    {
+        pumpInbound(session, &data, transport, push("echo", json::array({ big })), mark);
+        pumpInbound(session, &data, transport, pull(id), mark);
+    }
+    ok &= require(data.inbound.frames.size() == 4, "all deferred");
+
+    // The first pull pushes the transport over the mark again; the rest stays queued.
+    resumeInbound(session, &data, transport, mark);
+    ok &= require(transport.sent.size() == 1, "one response before pausing again");
+    ok &= require(data.inbound.paused && data.inbound.frames.size() == 2, "re-paused with remaining frames");
+    return ok;
+}
+
+static bool testDisabled()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    SlowTransport transport;
+    transport.buffered = 1 << 20;
+
+    pumpInbound(session, &data, transport, push("echo", json::array({ 1 })), 0);
+    pumpInbound(session, &data, transport, pull(1), 0);
+    return require(transport.sent.size() == 1 && !data.inbound.paused, "zero mark never defers");
+}
+
+static bool testBacklogHitsHardLimit()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    session.setMemoryLimits(MemoryLimits{ 0, 4096 });
+    RpcSessionData data; data.target = target;
+    SlowTransport transport;
+    const std::size_t mark = 64;
+    bool ok = true;
+
+    // A peer that never reads keeps pipelining while the connection is paused.
+    data.inbound.paused = true;
+    std::string big(500, 'z');
+    int id = 1;
+    for (; id <= 100 && !session.isAborted(); ++id)
+    {
+        pumpInbound(session, &data, transport, push("echo", json::array({ big })), mark);
+        pumpInbound(session, &data, transport, pull(id), mark);
+    }
+    ok &= require(session.isAborted(), "aborted at the hard limit");
+    ok &= require(id < 20, "aborted early");
+    ok &= require(target->calls == 0, "deferred frames never ran");
+    ok &= require(data.inbound.frames.empty() && !data.inbound.paused, "backlog dropped");
+    ok &= require(data.memory.bytes(MemoryCategory::PendingArgs) == 0, "backlog memory returned");
+    ok &= require(!transport.sent.empty() && json::parse(transport.sent.back())[0] == "abort", "abort sent");
+
+    // Later frames are ignored.
+    std::size_t sent = transport.sent.size();
+    pumpInbound(session, &data, transport, push("echo", json::array({ big })), mark);
+    pumpInbound(session, &data, transport, pull(id), mark);
+    ok &= require(target->calls == 0 && transport.sent.size() == sent && data.inbound.frames.empty(), "nothing after abort");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testPauseAndResume()) failures++;
+    if (!testResumeStopsAtMark()) failures++;
+    if (!testDisabled()) failures++;
+    if (!testBacklogHitsHardLimit()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All backpressure tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " backpressure test(s) failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,172 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/batch.h>
+#include <capnwebcpp/client_api.h>
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/rpc_target.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct LookupTarget : public RpcTarget
+{
+    LookupTarget()
+    {
+        method("getUserProfile", [this](const json& args)
+        {
+            ++calls;
+            if (args[0] == "missing") throw std::runtime_error("no such user");
+            return json{ {"id", args[0]}, {"version", calls.load()} };
+        });
+        method("getConfig", [this](const json& args)
+        {
+            ++calls;
+            return args[0];
+        });
+    }
+
+    std::atomic<int> calls{ 0 };
+};
+
+static std::shared_ptr<FuncBatchTransport> httpTransport(std::shared_ptr<LookupTarget> target, std::atomic<int>& batches,
+                                                         std::chrono::milliseconds delay = std::chrono::milliseconds(0))
+{
+    return std::make_shared<FuncBatchTransport>([target, &batches, delay](const std::vector<std::string>& lines)
+    {
+        ++batches;
+        if (delay.count() > 0) std::this_thread::sleep_for(delay);
+        RpcSession session(target);
+        RpcSessionData data; data.target = target;
+        std::string body;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (i > 0) body += "\n";
+            body += lines[i];
+        }
+        return processBatch(session, &data, body);
+    });
+}
+
+static bool testHitsSkipTheRoundTrip()
+{
+    auto target = std::make_shared<LookupTarget>();
+    std::atomic<int> batches{ 0 };
+    RpcClient client(httpTransport(target, batches));
+    client.setCachePolicy("getUserProfile", ClientCachePolicy{ std::chrono::milliseconds(60000), 16, 1 << 20 });
+
+    json a = client.callMethod("getUserProfile", json::array({ "u_1" }));
+    json b = client.callMethod("getUserProfile", json::array({ "u_1" }));
+    bool ok = require(a == b && batches == 1, "cache: identical call served locally");
+    client.callMethod("getUserProfile", json::array({ "u_2" }));
+    ok &= require(batches == 2, "cache: different args miss");
+
+    // Object keys are canonicalized, so key order does not matter.
+    client.setCachePolicy("getConfig", ClientCachePolicy{});
+    client.callMethod("getConfig", json::array({ json::parse(R"({"b":1,"a":2})") }));
+    client.callMethod("getConfig", json::array({ json::parse(R"({"a":2,"b":1})") }));
+    ok &= require(batches == 3, "cache: canonical args");
+
+    // Methods without a policy always go to the server.
+    int before = batches;
+    RpcClient plain(httpTransport(target, batches));
+    plain.callMethod("getConfig", json::array({ 1 }));
+    plain.callMethod("getConfig", json::array({ 1 }));
+    ok &= require(batches == before + 2, "cache: opt-in only");
+
+    // Rejections are not cached.
+    for (int i = 0; i < 2; ++i)
+    {
+        bool threw = false;
+        try { client.callMethod("getUserProfile", json::array({ "missing" })); }
+        catch (const std::runtime_error& e) { threw = std::string(e.what()).find("no such user") != std::string::npos; }
+        ok &= require(threw, "cache: rejection reaches the caller");
+    }
+    ok &= require(batches == before + 4, "cache: rejection retried");
+
+    client.invalidateCache("getUserProfile");
+    client.callMethod("getUserProfile", json::array({ "u_1" }));
+    ok &= require(batches == before + 5, "cache: invalidate drops entries");
+    return ok;
+}
+
+static bool testTtlAndLimits()
+{
+    auto target = std::make_shared<LookupTarget>();
+    std::atomic<int> batches{ 0 };
+    RpcClient client(httpTransport(target, batches));
+    client.setCachePolicy("getUserProfile", ClientCachePolicy{ std::chrono::milliseconds(30), 2, 1 << 20 });
+
+    client.callMethod("getUserProfile", json::array({ "u_1" }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    client.callMethod("getUserProfile", json::array({ "u_1" }));
+    bool ok = require(batches == 2, "ttl: expired entry refetched");
+
+    // Two entries at most: the least recently used goes.
+    client.setCachePolicy("getUserProfile", ClientCachePolicy{ std::chrono::milliseconds(60000), 2, 1 << 20 });
+    client.callMethod("getUserProfile", json::array({ "a" }));
+    client.callMethod("getUserProfile", json::array({ "b" }));
+    client.callMethod("getUserProfile", json::array({ "a" }));
+    client.callMethod("getUserProfile", json::array({ "c" }));
+    ok &= require(client.cacheStats().entries == 2, "limits: maxEntries");
+    int before = batches;
+    client.callMethod("getUserProfile", json::array({ "a" }));
+    ok &= require(batches == before, "limits: recently used entry kept");
+    client.callMethod("getUserProfile", json::array({ "b" }));
+    ok &= require(batches == before + 1, "limits: least recently used evicted");
+
+    // Results larger than maxBytes are not kept.
+    client.setCachePolicy("getConfig", ClientCachePolicy{ std::chrono::milliseconds(60000), 16, 64 });
+    client.callMethod("getConfig", json::array({ std::string(1000, 'x') }));
+    ok &= require(client.cacheStats().entries <= 2, "limits: maxBytes");
+    return ok;
+}
+
+static bool testConcurrentCallsShareOneRequest()
+{
+    auto target = std::make_shared<LookupTarget>();
+    std::atomic<int> batches{ 0 };
+    RpcClient client(httpTransport(target, batches, std::chrono::milliseconds(50)));
+    client.setCachePolicy("getUserProfile", ClientCachePolicy{});
+
+    std::vector<std::future<json>> results;
+    for (int i = 0; i < 8; ++i)
+        results.push_back(std::async(std::launch::async, [&]() { return client.callMethod("getUserProfile", json::array({ "u_1" })); }));
+    bool ok = true;
+    for (auto& r : results)
+        ok &= require(r.get()["id"] == "u_1", "shared: every caller gets the value");
+    ok &= require(batches == 1 && target->calls == 1, "shared: one request for identical concurrent calls");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testHitsSkipTheRoundTrip()) failures++;
+    if (!testTtlAndLimits()) failures++;
+    if (!testConcurrentCallsShareOneRequest()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All client cache tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " client cache test(s) failed" << std::endl;
+    return 1;
+}
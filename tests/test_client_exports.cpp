@@ -0,0 +1,171 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/client_exports.h>
+#include <capnwebcpp/export_id.h>
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/transport.h>
+#include <capnwebcpp/transports/accum_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Client-side listener receiving server pushes.
+class Listener : public RpcTarget
+{
+public:
+    Listener()
+    {
+        method("notify", [this](const json& args)
+        {
+            received.push_back(args.at(0));
+            return json("ack");
+        });
+    }
+
+    std::vector<json> received;
+};
+
+// Server keeping subscribers and calling them back on publish().
+class Notifier : public RpcTarget
+{
+public:
+    Notifier()
+    {
+        method("subscribe", [this](const json& args)
+        {
+            auto id = extractExportId(args.at(0));
+            if (id) subscribers.push_back(*id);
+            return json(static_cast<int>(subscribers.size()));
+        });
+        method("publish", [this](const json& args)
+        {
+            for (int id : subscribers)
+                session->callClientMethod(data, id, "notify", json::array({ args.at(0) }));
+            return json(true);
+        });
+    }
+
+    RpcSession* session = nullptr;
+    RpcSessionData* data = nullptr;
+    std::vector<int> subscribers;
+};
+
+// A server session and a client's exports, wired back to back.
+struct Wire
+{
+    std::vector<std::string> toClient;
+    std::vector<std::string> toServer;
+    std::shared_ptr<Notifier> notifier = std::make_shared<Notifier>();
+    std::shared_ptr<AccumTransport> serverTransport = std::make_shared<AccumTransport>(toClient);
+    RpcSession server{ notifier };
+    RpcSessionData serverData;
+    ClientExports exports{ [this](std::string frame) { toServer.push_back(std::move(frame)); } };
+    std::vector<json> clientResults;
+
+    Wire()
+    {
+        serverData.target = notifier;
+        serverData.transport = serverTransport;
+        notifier->session = &server;
+        notifier->data = &serverData;
+    }
+
+    // Deliver frames both ways until neither side has anything left to say.
+    void run()
+    {
+        while (!toClient.empty() || !toServer.empty())
+        {
+            auto client = std::move(toClient);
+            toClient.clear();
+            for (const auto& frame : client)
+            {
+                if (!exports.handle(frame))
+                    clientResults.push_back(json::parse(frame));
+            }
+            auto server = std::move(toServer);
+            toServer.clear();
+            for (const auto& frame : server)
+            {
+                pumpMessage(this->server, &serverData, *serverTransport, frame);
+                this->server.processTasks();
+            }
+        }
+    }
+
+    void call(int importId, const std::string& method, const json& args)
+    {
+        toServer.push_back(json::array({ "push", json::array({ "pipeline", 0, json::array({ method }), args }) }).dump());
+        toServer.push_back(json::array({ "pull", importId }).dump());
+        run();
+    }
+};
+
+static bool testServerCallsBackExportedTarget()
+{
+    Wire w;
+    auto listener = std::make_shared<Listener>();
+    json ref = w.exports.exportTarget(listener);
+    bool ok = true;
+    ok &= require(ref.is_array() && ref[0] == "export" && ref[1].get<int>() < 0, "export expression");
+    json again = w.exports.exportTarget(listener);
+    ok &= require(again == ref, "stable export ID");
+
+    // Each expression sent carries a reference the server releases after the call.
+    w.call(1, "subscribe", json::array({ ref, again }));
+    ok &= require(!w.clientResults.empty() && w.clientResults.back()[0] == "resolve" &&
+                  w.clientResults.back()[1] == 1 && w.clientResults.back()[2] == 1, "subscribe resolved");
+    // The server released its copies after the call; the client's own reference remains.
+    ok &= require(w.exports.exports() == 1, "export survives the call carrying it");
+
+    w.call(2, "publish", json::array({ "hello" }));
+    w.call(3, "publish", json::array({ "again" }));
+    ok &= require(listener->received == std::vector<json>({ "hello", "again" }), "listener notified");
+
+    ok &= require(w.exports.unexport(listener), "unexport");
+    ok &= require(w.exports.exports() == 0, "export dropped");
+    ok &= require(!w.exports.unexport(listener), "unexport twice");
+
+    // Calls on a dropped export are rejected rather than dispatched.
+    w.call(4, "publish", json::array({ "late" }));
+    ok &= require(listener->received.size() == 2, "no call after unexport");
+    return ok;
+}
+
+static bool testOtherFramesAreNotConsumed()
+{
+    ClientExports exports([](std::string) {});
+    bool ok = true;
+    ok &= require(!exports.handle(R"(["resolve",1,"x"])"), "resolve passes through");
+    ok &= require(!exports.handle(R"(["reject",1,["error","Error","x"]])"), "reject passes through");
+    ok &= require(!exports.handle(R"(["abort",["error","Error","x"]])"), "abort passes through");
+    ok &= require(exports.handle(R"(["release",-1,1])"), "release handled");
+    return ok;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += !testServerCallsBackExportedTarget();
+    failed += !testOtherFramesAreNotConsumed();
+    if (failed == 0)
+    {
+        std::cout << "All client export tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failed << " client export test(s) failed" << std::endl;
+    return 1;
+}
@@ -8,6 +8,7 @@
 #include <capnwebcpp/rpc_session.h>
 #include <capnwebcpp/batch.h>
 #include <capnwebcpp/client_api.h>
+#include <capnwebcpp/export_target.h>
 
 using json = nlohmann::json;
 using namespace capnwebcpp;
@@ -22,6 +23,27 @@ static bool require(bool cond, const std::string& msg)
     return true;
 }
 
+// Each batch runs on a fresh server session, as over HTTP. Counts batches and keeps the last one
+// when asked to.
+static std::shared_ptr<FuncBatchTransport> makeSessionTransport(std::shared_ptr<RpcTarget> target, int* batches = nullptr,
+                                                               std::vector<std::string>* lastBatch = nullptr)
+{
+    return std::make_shared<FuncBatchTransport>([target, batches, lastBatch](const std::vector<std::string>& lines)
+    {
+        if (batches) ++*batches;
+        if (lastBatch) *lastBatch = lines;
+        RpcSession session(target);
+        RpcSessionData data; data.target = target;
+        std::string body;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (i > 0) body += "\n";
+            body += lines[i];
+        }
+        return processBatch(session, &data, body);
+    });
+}
+
 struct HelloTarget : public RpcTarget
 {
     HelloTarget()
@@ -37,11 +59,137 @@ struct HelloTarget : public RpcTarget
 static bool testClientCallsHello()
 {
     auto target = std::make_shared<HelloTarget>();
+    RpcClient client(makeSessionTransport(target));
+    json result = client.callMethod("hello", json::array({"World"}));
+    return require(result.is_string() && result.get<std::string>() == "Hello, World!", "client hello");
+}
 
-    auto transport = std::make_shared<FuncBatchTransport>([target](const std::vector<std::string>& lines)
+struct UserTarget : public RpcTarget
+{
+    UserTarget()
+    {
+        method("authenticate", [](const json& args)
+        {
+            if (args[0] != "cookie-123") throw std::runtime_error("Invalid session");
+            return json{ {"id", "u_1"}, {"name", "Ada"} };
+        });
+        method("getUserProfile", [](const json& args) { return json{ {"id", args[0]}, {"bio", "Mathematician"} }; });
+        method("getNotifications", [](const json& args) { return json::array({ "hi " + args[0].get<std::string>() }); });
+        method("listUsers", [this](const json&)
+        {
+            ++listCalls;
+            return json::array({ json{ {"id", "u_1"}, {"name", "Ada"} }, json{ {"id", "u_2"}, {"name", "Alan"} } });
+        });
+    }
+
+    int listCalls = 0;
+};
+
+static bool testPipelineChainIsOneBatch()
+{
+    auto target = std::make_shared<UserTarget>();
+    int batches = 0;
+    std::vector<std::string> lastBatch;
+    auto transport = makeSessionTransport(target, &batches, &lastBatch);
+
+    RpcClient client(transport);
+    auto p = client.pipeline();
+    auto user = p.call("authenticate", json::array({ "cookie-123" }));
+    auto profile = p.call("getUserProfile", json::array({ user["id"] }));
+    auto notes = p.call("getNotifications", json::array({ user["id"] }));
+    auto results = p.await({ profile, notes, user.get("name") });
+
+    bool ok = require(batches == 1, "pipeline: chain sent as one batch");
+    ok &= require(json::parse(lastBatch[1]) == json::array({ "push", json::array({ "pipeline", 0, json::array({ "getUserProfile" }),
+                  json::array({ json::array({ "pipeline", 1, json::array({ "id" }) }) }) }) }), "pipeline: argument references import 1");
+    ok &= require(results.size() == 3 && results[0]["bio"] == "Mathematician", "pipeline: profile resolved");
+    ok &= require(results.size() == 3 && results[1] == json::array({ "hi u_1" }), "pipeline: notifications resolved");
+    ok &= require(results.size() == 3 && results[2] == "Ada", "pipeline: narrowed promise fetched by property get");
+
+    // A rejected dependency surfaces from await().
+    RpcClient client2(transport);
+    auto p2 = client2.pipeline();
+    auto bad = p2.call("authenticate", json::array({ "nope" }));
+    auto dependent = p2.call("getNotifications", json::array({ bad["id"] }));
+    bool threw = false;
+    try { p2.await(dependent); } catch (const std::runtime_error&) { threw = true; }
+    ok &= require(threw, "pipeline: failure of a dependency rejects the dependent call");
+    return ok;
+}
+
+static bool testBatchResolvesEveryHandle()
+{
+    auto target = std::make_shared<UserTarget>();
+    int batches = 0;
+    auto transport = makeSessionTransport(target, &batches);
+
+    RpcClient client(transport);
+    auto b = client.batch();
+    std::vector<RpcPromise> notes;
+    for (int i = 0; i < 20; ++i)
+        notes.push_back(b.call("getNotifications", json::array({ "u_" + std::to_string(i) })));
+    auto bad = b.call("authenticate", json::array({ "nope" }));
+    auto user = b.call("authenticate", json::array({ "cookie-123" }));
+    b.send();
+
+    bool ok = require(batches == 1, "batch: 22 calls sent as one batch");
+    for (int i = 0; i < 20; ++i)
+        ok &= require(b.result(notes[i]) == json::array({ "hi u_" + std::to_string(i) }), "batch: handle resolved");
+    ok &= require(b.result(user["name"]) == "Ada", "batch: narrowed handle resolved");
+    ok &= require(b.error(user).empty(), "batch: resolved handle has no error");
+    ok &= require(b.error(bad) == "MethodError: Invalid session", "batch: rejection kept per handle");
+    bool threw = false;
+    try { b.result(bad); } catch (const std::runtime_error&) { threw = true; }
+    ok &= require(threw, "batch: result() of a rejected handle throws");
+
+    // Each HTTP batch is a new server session, so one-shot calls keep working after the first.
+    ok &= require(client.callMethod("getNotifications", json::array({ "a" })) == json::array({ "hi a" }), "one-shot call 1");
+    ok &= require(client.callMethod("getNotifications", json::array({ "b" })) == json::array({ "hi b" }), "one-shot call 2");
+    return ok;
+}
+
+static bool testMapRunsServerSide()
+{
+    auto target = std::make_shared<UserTarget>();
+    int batches = 0;
+    std::vector<std::string> lastBatch;
+    auto transport = makeSessionTransport(target, &batches, &lastBatch);
+
+    RpcClient client(transport);
+    auto b = client.batch();
+    auto users = b.call("listUsers", json::array());
+    auto names = b.map(users, [](RpcMapper&, const RpcPromise& user) { return user["name"]; });
+    auto cards = b.map(users, [](RpcMapper& m, const RpcPromise& user)
+    {
+        auto profile = m.call("getUserProfile", json::array({ user["id"] }));
+        return json{ {"name", user["name"]}, {"bio", profile["bio"]} };
+    });
+    b.send();
+
+    bool ok = require(batches == 1, "map: one batch");
+    ok &= require(json::parse(lastBatch[2]) == json::array({ "push", json::array({ "remap", 1, json::array(),
+                  json::array({ json::array({ "import", 0 }) }),
+                  json::array({ json::array({ "pipeline", -1, json::array({ "getUserProfile" }), json::array({ json::array({ "pipeline", 0, json::array({ "id" }) }) }) }),
+                                json::array({ "value", json{ {"name", json::array({ "pipeline", 0, json::array({ "name" }) })},
+                                                             {"bio", json::array({ "pipeline", 1, json::array({ "bio" }) })} } }) }) }) }),
+                  "map: mapper recorded as captures and instructions");
+    ok &= require(b.result(names) == json::array({ "Ada", "Alan" }), "map: property of each element");
+    ok &= require(b.result(cards) == json::array({ json{ {"name", "Ada"}, {"bio", "Mathematician"} },
+                                                   json{ {"name", "Alan"}, {"bio", "Mathematician"} } }), "map: call per element");
+    ok &= require(target->listCalls == 1, "map: source call runs once");
+    return ok;
+}
+
+// One server session kept across batches, like SocketClientTransport.
+struct PersistentSessionTransport : public ClientBatchTransport
+{
+    explicit PersistentSessionTransport(std::shared_ptr<RpcTarget> target) : session(target)
+    {
+        data.target = target;
+    }
+
+    std::vector<std::string> sendBatch(const std::vector<std::string>& lines) override
     {
-        RpcSession session(target);
-        RpcSessionData data; data.target = target;
         std::string body;
         for (size_t i = 0; i < lines.size(); ++i)
         {
@@ -49,17 +197,125 @@ static bool testClientCallsHello()
             body += lines[i];
         }
         return processBatch(session, &data, body);
-    });
+    }
+
+    bool persistent() const override { return true; }
+
+    int exports() const { return session.getStats(&data).exports; }
 
+    RpcSession session;
+    RpcSessionData data;
+};
+
+static bool testPersistentTransportReleasesImports()
+{
+    auto target = std::make_shared<UserTarget>();
+    auto transport = std::make_shared<PersistentSessionTransport>(target);
     RpcClient client(transport);
-    json result = client.callMethod("hello", json::array({"World"}));
-    return require(result.is_string() && result.get<std::string>() == "Hello, World!", "client hello");
+    int baseline = transport->exports();
+    bool ok = true;
+
+    for (int i = 0; i < 50; ++i)
+        client.callMethod("getNotifications", json::array({ "u" }));
+    // Each call's release rides along with the next one.
+    ok &= require(transport->exports() <= baseline + 1, "persistent: one-shot calls do not accumulate exports");
+
+    {
+        auto b = client.batch();
+        auto user = b.call("authenticate", json::array({ "cookie-123" }));
+        auto notes = b.call("getNotifications", json::array({ user["id"] }));
+        ok &= require(b.await(notes) == json::array({ "hi u_1" }), "persistent: pipelined call");
+        // `user` was never pulled; it is released when the batch goes away.
+    }
+    {
+        auto b = client.batch();
+        auto bad = b.call("authenticate", json::array({ "nope" }));
+        b.send();
+        ok &= require(!b.error(bad).empty(), "persistent: rejected imports are released too");
+    }
+
+    client.flushReleases();
+    ok &= require(transport->exports() == baseline, "persistent: exports back to baseline");
+    return ok;
+}
+
+// A resolved import stays usable as an argument in later sends of the same batch.
+static bool testPersistentResolvedPromiseAsArgument()
+{
+    auto target = std::make_shared<UserTarget>();
+    auto transport = std::make_shared<PersistentSessionTransport>(target);
+    RpcClient client(transport);
+    client.callMethod("getNotifications", json::array({ "warm-up" }));
+    int baseline = transport->exports();
+    bool ok = true;
+    {
+        auto b = client.batch();
+        auto user = b.call("authenticate", json::array({ "cookie-123" }));
+        b.send();
+        ok &= require(b.result(user["id"]) == "u_1", "persistent: first send resolved");
+        auto notes = b.call("getNotifications", json::array({ user["id"] }));
+        json got;
+        try { got = b.await(notes); } catch (const std::exception& e) { got = e.what(); }
+        ok &= require(got == json::array({ "hi u_1" }), "persistent: resolved promise still usable: " + got.dump());
+    }
+    client.flushReleases();
+    ok &= require(transport->exports() == baseline - 1, "persistent: batch imports released after it is gone");
+    return ok;
+}
+
+struct ProfileTarget : public RpcTarget
+{
+    ProfileTarget() { method("bio", [](const json&) { return json("Mathematician"); }); }
+};
+
+// Returns an account holding a profile stub. Its own "bio" tells a call that fell through to the
+// main target apart from one on the stub.
+struct AccountTarget : public RpcTarget
+{
+    AccountTarget()
+    {
+        method("openAccount", [this](const json&)
+        {
+            return json{ {"id", "a_1"}, {"profile", exportTarget(data, profile)} };
+        });
+        method("bio", [](const json&) { return json("MAIN"); });
+    }
+
+    RpcSessionData* data = nullptr;
+    std::shared_ptr<ProfileTarget> profile = std::make_shared<ProfileTarget>();
+};
+
+// A call on a promise goes to the stub at the promise's path, or is rejected when there is none.
+static bool testCallOnPipelinedResult()
+{
+    auto target = std::make_shared<AccountTarget>();
+    auto transport = std::make_shared<PersistentSessionTransport>(target);
+    target->data = &transport->data;
+    RpcClient client(transport);
+    bool ok = true;
+
+    auto b = client.batch();
+    auto account = b.call("openAccount", json::array());
+    auto viaPath = b.call(account["profile"], "bio", json::array());
+    auto onValue = b.call(account["id"], "bio", json::array());
+    auto onObject = b.call(account, "bio", json::array());
+    b.send();
+    ok &= require(b.error(viaPath).empty() && b.result(viaPath) == "Mathematician", "pipelined: call on a stub at a path");
+    ok &= require(!b.error(onValue).empty(), "pipelined: call on a plain value is rejected");
+    ok &= require(!b.error(onObject).empty(), "pipelined: call on an object without a stub is rejected");
+    return ok;
 }
 
 int main()
 {
     int failed = 0;
     failed += !testClientCallsHello();
+    failed += !testPipelineChainIsOneBatch();
+    failed += !testBatchResolvesEveryHandle();
+    failed += !testMapRunsServerSide();
+    failed += !testPersistentTransportReleasesImports();
+    failed += !testPersistentResolvedPromiseAsArgument();
+    failed += !testCallOnPipelinedResult();
     if (failed == 0)
     {
         std::cout << "All C++ client tests passed" << std::endl;
@@ -0,0 +1,117 @@
+#include <climits>
+#include <iostream>
+#include <set>
+#include <string>
+
+#include <capnwebcpp/id_table.h>
+#include <capnwebcpp/session_state.h>
+
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool testSequentialInsertErase()
+{
+    IdTable<int> t;
+    bool ok = true;
+    for (int i = 1; i <= 2000; ++i) t[i] = i * 10;
+    for (int i = -1; i >= -300; --i) t[i] = i;
+    ok &= require(t.size() == 2300, "seq: size after inserts");
+    ok &= require(t.get(1500) && *t.get(1500) == 15000, "seq: lookup positive");
+    ok &= require(t.get(-77) && *t.get(-77) == -77, "seq: lookup negative");
+    ok &= require(t.get(2001) == nullptr && t.get(-301) == nullptr, "seq: absent ids");
+
+    // Pointers stay valid while the table grows.
+    int* p = t.get(3);
+    for (int i = 2001; i <= 5000; ++i) t[i] = i;
+    ok &= require(p == t.get(3) && *p == 30, "seq: pointer stable across growth");
+
+    for (int i = 1; i <= 4990; ++i) t.erase(i);
+    ok &= require(t.size() == 310, "seq: size after erasing front");
+    ok &= require(t.get(4995) && *t.get(4995) == 4995, "seq: tail survives front trim");
+    ok &= require(t.find(10) == t.end(), "seq: erased id not found");
+
+    // Sequential allocation continues after trimming.
+    t[5001] = 1;
+    ok &= require(t.get(5001) != nullptr, "seq: insert after trim");
+    return ok;
+}
+
+static bool testOutliersSpill()
+{
+    IdTable<int> t;
+    bool ok = true;
+    t[1] = 1;
+    t[1000000000] = 2;
+    t[INT_MIN] = 3;
+    t[-INT_MAX] = 4;
+    ok &= require(t.size() == 4, "spill: size");
+    ok &= require(*t.get(1000000000) == 2, "spill: far positive");
+    ok &= require(*t.get(INT_MIN) == 3 && *t.get(-INT_MAX) == 4, "spill: INT_MIN distinct from -INT_MAX");
+    ok &= require(t.erase(INT_MIN) && t.get(INT_MIN) == nullptr && t.get(-INT_MAX), "spill: erase INT_MIN");
+    return ok;
+}
+
+static bool testIteration()
+{
+    IdTable<int> t;
+    std::set<int> expected = { 1, 2, 700, -1, -5, 123456789 };
+    for (int id : expected) t[id] = id;
+    std::set<int> seen;
+    for (auto& kv : t)
+    {
+        if (kv.first != kv.second) return require(false, "iter: key/value mismatch");
+        seen.insert(kv.first);
+    }
+    bool ok = require(seen == expected, "iter: all ids visited");
+    auto it = t.find(-5);
+    ok &= require(it != t.end() && it->second == -5, "iter: find negative");
+    t.erase(it);
+    ok &= require(t.find(-5) == t.end() && t.size() == expected.size() - 1, "iter: erase by iterator");
+    t.clear();
+    ok &= require(t.empty() && t.begin() == t.end(), "iter: clear");
+    return ok;
+}
+
+static bool testExportEntryPayload()
+{
+    Exporter exporter;
+    bool ok = true;
+    exporter.setOperation(1, "echo", json::array({ "x" }), nullptr);
+    std::string method;
+    json args;
+    ok &= require(exporter.getOperation(1, method, args) && method == "echo", "payload: operation stored");
+    exporter.setResult(1, json("done"));
+    json out;
+    ok &= require(exporter.getResult(1, out) && out == "done", "payload: result stored");
+    auto* e = exporter.find(1);
+    e->clearPayload();
+    ok &= require(!e->cold && !e->hasResult, "payload: cold block freed when empty");
+    exporter.release(1, 1);
+    ok &= require(exporter.find(1) == nullptr, "payload: released");
+    return ok;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += !testSequentialInsertErase();
+    failed += !testOutliersSpill();
+    failed += !testIteration();
+    failed += !testExportEntryPayload();
+    if (failed == 0)
+    {
+        std::cout << "All id table tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failed << " id table test(s) failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/export_target.h>
+#include <capnwebcpp/transports/accum_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+using namespace std::chrono_literals;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct Counter : public RpcTarget
+{
+    Counter()
+    {
+        method("get", [](const json&){ return json(42); });
+        method("whoami", [](const json&){ return json("counter"); });
+    }
+};
+
+struct TestTarget : public RpcTarget
+{
+    RpcSessionData* data = nullptr;
+    std::shared_ptr<Counter> counter = std::make_shared<Counter>();
+
+    TestTarget()
+    {
+        method("echo", [](const json& args){ return args.is_array() && !args.empty() ? args[0] : json(); });
+        method("makeCounter", [this](const json&){ return exportTarget(data, std::make_shared<Counter>()); });
+        method("getCounter", [this](const json&){ return exportTarget(data, counter); });
+        method("whoami", [](const json&){ return json("MAIN"); });
+    }
+};
+
+static std::string push(const std::string& method, const json& args = json::array())
+{
+    return json::array({ "push", json::array({ "pipeline", 0, json::array({ method }), args }) }).dump();
+}
+
+static bool testPulledResultReclaimed()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    session.setExportIdlePolicy({ 100ms, 0ms });
+    RpcSessionData data; data.target = target;
+    bool ok = true;
+
+    session.handleMessage(&data, push("echo", json::array({ "a" })));
+    session.handleMessage(&data, push("echo", json::array({ "b" })));
+    session.handleMessage(&data, json::array({ "pull", 1 }).dump());
+
+    auto now = std::chrono::steady_clock::now();
+    ok &= require(session.reclaimIdleExports(&data, now) == 0, "pulled: nothing reclaimed before ttl");
+    ok &= require(session.reclaimIdleExports(&data, now + 200ms) == 1, "pulled: pulled export reclaimed");
+    ok &= require(data.exports.find(1) == data.exports.end(), "pulled: export 1 gone");
+    ok &= require(data.exports.find(2) != data.exports.end(), "pulled: unpulled export kept");
+    return ok;
+}
+
+static bool testReleaseUnwindsTargetRegistration()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    target->data = &data;
+    bool ok = true;
+
+    session.handleMessage(&data, push("makeCounter"));
+    json msg = json::parse(session.handleMessage(&data, json::array({ "pull", 1 }).dump()));
+    ok &= require(msg[0] == "resolve" && msg[2][0] == "export", "unwind: counter exported");
+    int id = msg[2][1];
+    ok &= require(data.targetExportId.size() == 1 && data.targetRegistry.size() == 1, "unwind: target registered");
+
+    session.handleMessage(&data, json::array({ "release", id, 1 }).dump());
+    ok &= require(data.exports.find(id) == data.exports.end(), "unwind: stub export released");
+    ok &= require(data.targetExportId.empty() && data.targetRegistry.empty(), "unwind: registration removed");
+    return ok;
+}
+
+// A result still carrying a target's marker keeps the target registered after its export is
+// released, so pulling it later exports the same target again.
+static bool testUnpulledMarkerKeepsRegistration()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    target->data = &data;
+    bool ok = true;
+
+    session.handleMessage(&data, push("getCounter"));
+    session.handleMessage(&data, push("getCounter"));
+    json first = json::parse(session.handleMessage(&data, json::array({ "pull", 1 }).dump()));
+    int id = first[2][1];
+    session.handleMessage(&data, json::array({ "release", id, 1 }).dump());
+    ok &= require(data.targetRegistry.size() == 1, "marker: registration kept for the unpulled result");
+
+    json second = json::parse(session.handleMessage(&data, json::array({ "pull", 2 }).dump()));
+    ok &= require(second[0] == "resolve" && second[2][0] == "export", "marker: target exported again");
+    int again = second[2][1];
+    session.handleMessage(&data, json::array({ "push", json::array({ "pipeline", again, json::array({ "whoami" }) }) }).dump());
+    json who = json::parse(session.handleMessage(&data, json::array({ "pull", 3 }).dump()));
+    ok &= require(who == json::array({ "resolve", 3, "counter" }), "marker: calls reach the exported target");
+
+    session.handleMessage(&data, json::array({ "release", again, 1 }).dump());
+    ok &= require(data.targetRegistry.empty(), "marker: registration removed once every marker is used");
+
+    // A marker whose registration is gone is rejected rather than bound to the main target.
+    session.handleMessage(&data, push("getCounter"));
+    session.processTasks();
+    data.targetRegistry.clear();
+    json lost = json::parse(session.handleMessage(&data, json::array({ "pull", 4 }).dump()));
+    ok &= require(lost[0] == "reject", "marker: unregistered target rejected");
+    return ok;
+}
+
+static bool testIdleStubReclaimedAndCapturesReleased()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    session.setExportIdlePolicy({ 0ms, 1s });
+    RpcSessionData data; data.target = target;
+    target->data = &data;
+    std::vector<std::string> outbox;
+    data.transport = std::make_shared<AccumTransport>(outbox);
+    bool ok = true;
+
+    session.handleMessage(&data, push("makeCounter"));
+    session.handleMessage(&data, json::array({ "pull", 1 }).dump());
+    // A pending operation capturing a client export is never reclaimed.
+    session.handleMessage(&data, push("echo", json::array({ json::array({ "export", 7 }) })));
+    // A remap capturing a client export completes immediately and is reclaimable.
+    session.handleMessage(&data, json::array({ "push", json::array({ "remap", 0, json::array(),
+        json::array({ json::array({ "export", 9 }) }), json::array() }) }).dump());
+
+    ok &= require(session.reclaimIdleExports(&data, std::chrono::steady_clock::now() + 2s) == 3,
+                  "idle: stub, pulled result and remap reclaimed");
+    ok &= require(data.exports.size() == 1 && data.exports.find(2) != data.exports.end(),
+                  "idle: pending operation kept");
+    ok &= require(data.targetExportId.empty() && data.targetRegistry.empty(), "idle: registration removed");
+    ok &= require(outbox.size() == 1 && json::parse(outbox[0]) == json::array({ "release", 9, 1 }),
+                  "idle: captured client export released");
+    return ok;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += !testPulledResultReclaimed();
+    failed += !testReleaseUnwindsTargetRegistration();
+    failed += !testUnpulledMarkerKeepsRegistration();
+    failed += !testIdleStubReclaimedAndCapturesReleased();
+    if (failed == 0)
+    {
+        std::cout << "All idle reclaim tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failed << " idle reclaim test(s) failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/export_target.h>
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/transports/loopback_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct Counter : public RpcTarget
+{
+    int value = 0;
+
+    Counter()
+    {
+        method("increment", [this](const json& args)
+        {
+            value += args.empty() ? 1 : args[0].get<int>();
+            return json(value);
+        });
+    }
+};
+
+struct TestTarget : public RpcTarget
+{
+    std::shared_ptr<Counter> counter = std::make_shared<Counter>();
+    RpcSessionData* data = nullptr;
+
+    TestTarget()
+    {
+        method("square", [](const json& args) { int v = args[0].get<int>(); return json(v * v); });
+        method("list", [](const json&) { return json::array({ 1, 2, 3 }); });
+        method("fail", [](const json&) -> json { throw std::runtime_error("boom"); });
+        method("makeCounter", [this](const json&) { return exportTarget(data, counter); });
+        method("authenticate", [](const json& args) { return json{ {"id", args[0].get<std::string>() + "-id"} }; });
+        method("getProfile", [](const json& args) { return json{ {"name", "profile of " + args[0].get<std::string>()} }; });
+    }
+};
+
+static bool testCallsAndRelease()
+{
+    auto target = std::make_shared<TestTarget>();
+    LoopbackClient client(target);
+
+    bool ok = true;
+    ok &= require(client.callMethod("square", json::array({ 7 })) == 49, "loopback: call result");
+    ok &= require(client.callMethod("list", json::array()) == json::array({ 1, 2, 3 }), "loopback: array result unescaped");
+
+    bool threw = false;
+    try { client.callMethod("fail", json::array()); }
+    catch (const std::runtime_error& e) { threw = std::string(e.what()).find("boom") != std::string::npos; }
+    ok &= require(threw, "loopback: rejection surfaces as exception");
+
+    auto stats = client.serverSession().getStats(&client.serverData());
+    ok &= require(stats.exports == 0, "loopback: released imports leave no exports");
+    ok &= require(client.serverData().transport != nullptr, "loopback: session has a transport");
+    return ok;
+}
+
+static bool testPipelining()
+{
+    auto target = std::make_shared<TestTarget>();
+    LoopbackClient client(target);
+
+    // Pass a property of an unresolved result as an argument; only the final call is pulled.
+    int user = client.push(json::array({ "pipeline", 0, json::array({ "authenticate" }), json::array({ "alice" }) }));
+    json idRef = json::array({ "pipeline", user, json::array({ "id" }) });
+    int profile = client.push(json::array({ "pipeline", 0, json::array({ "getProfile" }), json::array({ idRef }) }));
+    client.pull(profile);
+
+    bool ok = true;
+    json result = client.await(profile);
+    ok &= require(result.is_object() && result["name"] == "profile of alice-id", "loopback: pipelined argument resolved");
+
+    client.release(profile);
+    client.release(user);
+    ok &= require(client.serverSession().getStats(&client.serverData()).exports == 0, "loopback: pipeline imports released");
+    return ok;
+}
+
+static bool testStubResult()
+{
+    auto target = std::make_shared<TestTarget>();
+    LoopbackClient client(target);
+    target->data = &client.serverData();
+
+    json stub = client.callMethod("makeCounter", json::array());
+    bool ok = require(RpcClient::isStub(stub), "loopback: stub result decoded");
+    if (!ok) return false;
+    ok &= require(client.callStubMethod(stub, "increment", json::array({ 3 })) == 3, "loopback: call on returned stub");
+    ok &= require(client.callStubMethod(stub, "increment", json::array({ 4 })) == 7, "loopback: stub keeps state");
+    ok &= require(target->counter->value == 7, "loopback: calls reached the exported target");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testCallsAndRelease()) failures++;
+    if (!testPipelining()) failures++;
+    if (!testStubResult()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All loopback tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " loopback test(s) failed" << std::endl;
+    return 1;
+}
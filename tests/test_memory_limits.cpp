@@ -0,0 +1,166 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/rpc_target.h>
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/memory_accounting.h>
+#include <capnwebcpp/transport.h>
+#include <capnwebcpp/transports/accum_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct TestTarget : public RpcTarget
+{
+    TestTarget()
+    {
+        method("echo", [](const json& args)
+        {
+            return args.is_array() && !args.empty() ? args[0] : json();
+        });
+    }
+};
+
+static std::string pushEcho(const std::string& payload)
+{
+    return json::array({
+        "push",
+        json::array({ "pipeline", 0, json::array({"echo"}), json::array({ payload }) })
+    }).dump();
+}
+
+static bool testAccounting()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    bool ok = true;
+
+    std::size_t processBefore = ProcessMemoryTotals::instance().total();
+    session.handleMessage(&data, pushEcho(std::string(4096, 'x')));
+    auto s1 = session.getStats(&data);
+    ok &= require(s1.pendingArgBytes >= 4096, "acct: pending args charged");
+    ok &= require(s1.microtaskBytes >= 4096, "acct: microtask payload charged");
+    ok &= require(ProcessMemoryTotals::instance().total() >= processBefore + s1.totalBytes,
+                  "acct: process-wide total includes session");
+
+    session.processTasks();
+    auto s2 = session.getStats(&data);
+    ok &= require(s2.microtaskBytes == 0 && s2.pendingArgBytes == 0, "acct: args released after evaluation");
+    ok &= require(s2.resultBytes >= 4096, "acct: result charged");
+
+    session.handleMessage(&data, json::array({ "pull", 1 }).dump());
+    auto s3 = session.getStats(&data);
+    ok &= require(s3.resultBytes >= 4096, "acct: result kept until released");
+
+    session.handleMessage(&data, json::array({ "release", 1, 1 }).dump());
+    ok &= require(session.getStats(&data).totalBytes == 0, "acct: nothing retained after release");
+    return ok;
+}
+
+static bool testSoftLimitRejectsPush()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    session.setMemoryLimits({ 1024, 0 });
+    RpcSessionData data; data.target = target;
+    bool ok = true;
+
+    session.handleMessage(&data, pushEcho(std::string(4096, 'x')));
+    session.processTasks();
+    session.handleMessage(&data, pushEcho("small"));
+
+    auto r2 = json::parse(session.handleMessage(&data, json::array({ "pull", 2 }).dump()));
+    ok &= require(r2[0] == "reject" && r2[2][1] == "ResourceExhausted", "soft: push over limit rejected");
+
+    auto r1 = json::parse(session.handleMessage(&data, json::array({ "pull", 1 }).dump()));
+    ok &= require(r1[0] == "resolve", "soft: earlier push still resolves");
+    ok &= require(!session.isAborted(), "soft: session not aborted");
+    return ok;
+}
+
+static bool testHardLimitAborts()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    session.setMemoryLimits({ 0, 2048 });
+    RpcSessionData data; data.target = target;
+    bool ok = true;
+
+    auto out = session.handleMessage(&data, pushEcho(std::string(4096, 'x')));
+    ok &= require(!out.empty(), "hard: abort frame returned");
+    auto frame = json::parse(out);
+    ok &= require(frame[0] == "abort" && frame[1][1] == "ResourceExhausted", "hard: abort carries error");
+    ok &= require(session.isAborted(), "hard: session aborted");
+    ok &= require(session.getStats(&data).totalBytes == 0, "hard: accounting cleared on abort");
+    return ok;
+}
+
+// One session shared by two connections, as setupRpcEndpoint() does: only the connection over the
+// hard limit is aborted.
+static bool testHardLimitAbortsOneConnection()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    session.setMemoryLimits({ 0, 64 * 1024 });
+    std::vector<std::string> outA, outB;
+    auto transportA = std::make_shared<AccumTransport>(outA);
+    auto transportB = std::make_shared<AccumTransport>(outB);
+    RpcSessionData a; a.target = target; a.transport = transportA;
+    RpcSessionData b; b.target = target; b.transport = transportB;
+    session.onOpen(&a);
+    session.onOpen(&b);
+    bool ok = true;
+
+    // B has work queued when A goes over the limit.
+    session.handleMessage(&b, pushEcho("queued"));
+    pumpInbound(session, &a, *transportA, pushEcho(std::string(128 * 1024, 'x')), 1024 * 1024);
+    ok &= require(!outA.empty() && json::parse(outA.back())[0] == "abort", "isolate: A gets the abort");
+    ok &= require(session.isAborted(&a) && !session.isAborted(&b), "isolate: only A aborted");
+
+    pumpInbound(session, &b, *transportB, pushEcho("after"), 1024 * 1024);
+    pumpInbound(session, &b, *transportB, json::array({ "pull", 1 }).dump(), 1024 * 1024);
+    pumpInbound(session, &b, *transportB, json::array({ "pull", 2 }).dump(), 1024 * 1024);
+    ok &= require(outB.size() == 2, "isolate: B still answered");
+    if (outB.size() == 2)
+    {
+        ok &= require(json::parse(outB[0]) == json::array({ "resolve", 1, "queued" }), "isolate: B's queued work kept");
+        ok &= require(json::parse(outB[1]) == json::array({ "resolve", 2, "after" }), "isolate: B's new work runs");
+    }
+
+    std::size_t aFrames = outA.size();
+    pumpInbound(session, &a, *transportA, pushEcho("late"), 1024 * 1024);
+    ok &= require(outA.size() == aFrames, "isolate: A stays aborted");
+    session.onClose(&a);
+    session.onClose(&b);
+    return ok;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += !testAccounting();
+    failed += !testSoftLimitRejectsPush();
+    failed += !testHardLimitAborts();
+    failed += !testHardLimitAbortsOneConnection();
+    if (failed == 0)
+    {
+        std::cout << "All memory limit tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failed << " memory limit test(s) failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,225 @@
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/batch.h>
+#include <capnwebcpp/metrics.h>
+#include <capnwebcpp/rpc_session.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct TestTarget : public RpcTarget
+{
+    TestTarget()
+    {
+        method("echo", [](const json& args){ return args.is_array() && !args.empty() ? args[0] : json(); });
+        method("fail", [](const json&) -> json { throw std::runtime_error("boom"); });
+    }
+};
+
+static std::string push(const std::string& method, const json& args = json::array())
+{
+    return json::array({ "push", json::array({ "pipeline", 0, json::array({ method }), args }) }).dump();
+}
+
+static std::int64_t in(protocol::MessageType t) { return Metrics::instance().messagesIn[static_cast<std::size_t>(t)].value(); }
+static std::int64_t out(protocol::MessageType t) { return Metrics::instance().messagesOut[static_cast<std::size_t>(t)].value(); }
+
+static std::int64_t pullCount()
+{
+    std::int64_t n = 0;
+    for (const auto& b : Metrics::instance().pullLatency.buckets) n += b.value();
+    return n;
+}
+
+static bool testMessageCounters()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    bool ok = true;
+
+    auto& m = Metrics::instance();
+    auto pushes = in(protocol::MessageType::Push);
+    auto pulls = in(protocol::MessageType::Pull);
+    auto resolves = out(protocol::MessageType::Resolve);
+    auto bytesIn = m.bytesIn.value();
+    auto bytesOut = m.bytesOut.value();
+    auto latencies = pullCount();
+
+    std::string p = push("echo", json::array({ "hi" }));
+    std::string q = json::array({ "pull", 1 }).dump();
+    session.handleMessage(&data, p);
+    std::string resolve = session.handleMessage(&data, q);
+
+    ok &= require(in(protocol::MessageType::Push) == pushes + 1, "push counted");
+    ok &= require(in(protocol::MessageType::Pull) == pulls + 1, "pull counted");
+    ok &= require(out(protocol::MessageType::Resolve) == resolves + 1, "resolve counted");
+    ok &= require(m.bytesIn.value() == bytesIn + static_cast<std::int64_t>(p.size() + q.size()), "inbound bytes");
+    ok &= require(m.bytesOut.value() == bytesOut + static_cast<std::int64_t>(resolve.size()), "outbound bytes");
+    ok &= require(pullCount() == latencies + 1, "pull latency recorded");
+    return ok;
+}
+
+static bool testMethodCounters()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    bool ok = true;
+
+    // Operations run when pulled.
+    session.handleMessage(&data, push("echo", json::array({ 1 })));
+    session.handleMessage(&data, push("fail"));
+    session.handleMessage(&data, push("fail"));
+    for (int id = 1; id <= 3; ++id)
+        session.handleMessage(&data, json::array({ "pull", id }).dump());
+
+    std::string text = Metrics::instance().renderPrometheus();
+    ok &= require(text.find("capnweb_method_seconds_count{method=\"echo\"}") != std::string::npos, "echo timed");
+    ok &= require(text.find("capnweb_method_errors_total{method=\"echo\"} 0") != std::string::npos, "echo no errors");
+    ok &= require(text.find("capnweb_method_errors_total{method=\"fail\"} 2") != std::string::npos, "fail errors counted");
+    return ok;
+}
+
+static bool testTableGauges()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    auto& m = Metrics::instance();
+    auto exports = m.liveExports.value();
+    bool ok = true;
+    {
+        RpcSessionData data; data.target = target;
+        session.handleMessage(&data, push("echo", json::array({ 1 })));
+        session.handleMessage(&data, push("echo", json::array({ 2 })));
+        ok &= require(m.liveExports.value() == exports + 2, "exports gauge after pushes");
+
+        session.handleMessage(&data, json::array({ "release", 1, 1 }).dump());
+        ok &= require(m.liveExports.value() == exports + 1, "exports gauge after release");
+    }
+    ok &= require(m.liveExports.value() == exports, "exports gauge after session destroyed");
+    return ok;
+}
+
+static bool testBatchSessionGauge()
+{
+    auto target = std::make_shared<TestTarget>();
+    auto& m = Metrics::instance();
+    auto sessions = m.liveSessions.value();
+    auto depth = m.microtaskQueueDepth.value();
+    bool ok = true;
+    {
+        auto lease = BatchSessionPool::local().acquire(target);
+        ok &= require(m.liveSessions.value() == sessions + 1, "batch session counted");
+        lease->run(push("echo", json::array({ "x" })) + "\n" + json::array({ "pull", 1 }).dump() + "\n");
+        ok &= require(lease->outbox.size() == 1, "batch response");
+    }
+    ok &= require(m.liveSessions.value() == sessions, "batch session released");
+    ok &= require(m.microtaskQueueDepth.value() == depth, "microtask depth settled");
+    return ok;
+}
+
+static bool testPrometheusFormat()
+{
+    bool ok = true;
+    std::string text = Metrics::instance().renderPrometheus();
+    ok &= require(text.find("# TYPE capnweb_messages_in_total counter") != std::string::npos, "counter type line");
+    ok &= require(text.find("capnweb_messages_in_total{type=\"push\"}") != std::string::npos, "push label");
+    ok &= require(text.find("capnweb_pull_latency_seconds_bucket{le=\"+Inf\"}") != std::string::npos, "+Inf bucket");
+    ok &= require(text.find("# TYPE capnweb_sessions gauge") != std::string::npos, "sessions gauge");
+    return ok;
+}
+
+static bool testDisabled()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    auto& m = Metrics::instance();
+    auto pushes = in(protocol::MessageType::Push);
+
+    m.setEnabled(false);
+    session.handleMessage(&data, push("echo", json::array({ 1 })));
+    m.setEnabled(true);
+    return require(in(protocol::MessageType::Push) == pushes, "no recording while disabled");
+}
+
+// Runs last: saturates the process-wide method label set.
+static bool testMethodCountersOfExitedThreads()
+{
+    auto& m = Metrics::instance();
+    std::size_t before = m.methodCounterInstances();
+    for (int i = 0; i < 20; ++i)
+    {
+        std::thread([&m]
+        {
+            m.recordMethod("threaded", std::chrono::milliseconds(1), false);
+            m.recordMethod("threaded", std::chrono::milliseconds(1), true);
+        }).join();
+    }
+
+    std::string text = m.renderPrometheus();
+    bool ok = require(m.methodCounterInstances() == before, "exited threads' counters freed");
+    ok &= require(text.find("capnweb_method_seconds_count{method=\"threaded\"} 40") != std::string::npos, "exited threads' calls kept");
+    ok &= require(text.find("capnweb_method_errors_total{method=\"threaded\"} 20") != std::string::npos, "exited threads' errors kept");
+    return ok;
+}
+
+static bool testMethodLabelCap()
+{
+    auto& m = Metrics::instance();
+    m.methodCounters("echo");
+    for (std::size_t i = 0; i < Metrics::kMaxMethodLabels; ++i)
+        m.methodCounters("m" + std::to_string(i));
+
+    MethodCounters& folded = m.methodCounters("late_a");
+    bool ok = require(folded.method == "_other", "late names folded");
+    ok &= require(&m.methodCounters("late_b") == &folded, "one _other entry per thread");
+
+    std::string echoLabel, lateLabel;
+    std::thread([&]
+    {
+        echoLabel = m.methodCounters("echo").method;
+        lateLabel = m.methodCounters("late_c").method;
+    }).join();
+    ok &= require(echoLabel == "echo", "known name keeps its label on other threads");
+    ok &= require(lateLabel == "_other", "late name folded on other threads");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testMessageCounters()) failures++;
+    if (!testMethodCounters()) failures++;
+    if (!testTableGauges()) failures++;
+    if (!testBatchSessionGauge()) failures++;
+    if (!testPrometheusFormat()) failures++;
+    if (!testDisabled()) failures++;
+    if (!testMethodCountersOfExitedThreads()) failures++;
+    if (!testMethodLabelCap()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All metrics tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " metrics test(s) failed" << std::endl;
+    return 1;
+}
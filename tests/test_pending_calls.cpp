@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/client_calls.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Many threads start calls concurrently; results settle out of order from one "loop" thread.
+static bool testManyCallsInFlight()
+{
+    PendingCalls pending;
+    std::vector<int> wire;          // Import IDs in the order their pushes were "sent"
+    std::atomic<int> completed{ 0 };
+    std::atomic<int> mismatched{ 0 };
+
+    const int threads = 8;
+    const int perThread = 1000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]
+        {
+            for (int i = 0; i < perThread; ++i)
+            {
+                auto expected = std::make_shared<int>(0);
+                int id = pending.start([&, expected](json value, std::string error)
+                {
+                    if (!error.empty() || value != *expected) mismatched++;
+                    completed++;
+                }, [&](int importId) { wire.push_back(importId); });
+                *expected = id * 10;
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    bool ok = require(pending.size() == static_cast<std::size_t>(threads * perThread), "pending: all calls in flight");
+    ok &= require(std::is_sorted(wire.begin(), wire.end()) && wire.size() == static_cast<std::size_t>(threads * perThread),
+                  "pending: sends ordered by import ID");
+
+    std::vector<int> order = wire;
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    std::thread loop([&] { for (int id : order) pending.settle(id, json(id * 10), ""); });
+    loop.join();
+
+    ok &= require(completed == threads * perThread, "pending: every completion ran");
+    ok &= require(mismatched == 0, "pending: each completion got its own result");
+    ok &= require(pending.size() == 0, "pending: slots returned");
+    ok &= require(!pending.settle(wire.front(), json(), ""), "pending: settled ID not matched twice");
+    return ok;
+}
+
+static bool testFuturesAndFailure()
+{
+    PendingCalls pending;
+    auto [done1, f1] = PendingCalls::makeFuture();
+    auto [done2, f2] = PendingCalls::makeFuture();
+    auto [done3, f3] = PendingCalls::makeFuture();
+    int id1 = pending.start(std::move(done1), [](int) {});
+    int id2 = pending.start(std::move(done2), [](int) {});
+    pending.start(std::move(done3), [](int) {});
+
+    pending.settle(id2, json(), "MethodError: boom");
+    pending.settle(id1, json{ {"ok", true} }, "");
+    bool ok = require(f1.get() == json{ {"ok", true} }, "future: value delivered");
+
+    bool threw = false;
+    try { f2.get(); } catch (const std::runtime_error& e) { threw = std::string(e.what()) == "MethodError: boom"; }
+    ok &= require(threw, "future: rejection as exception");
+
+    pending.failAll("connection closed");
+    threw = false;
+    try { f3.get(); } catch (const std::runtime_error& e) { threw = std::string(e.what()) == "connection closed"; }
+    ok &= require(threw, "future: failAll rejects outstanding calls");
+
+    // A send failure forgets the call.
+    threw = false;
+    try { pending.start([](json, std::string) {}, [](int) { throw std::runtime_error("not open"); }); }
+    catch (const std::runtime_error&) { threw = true; }
+    ok &= require(threw && pending.size() == 0, "pending: failed send leaves no slot");
+    return ok;
+}
+
+// Releases aggregate per ID and are taken as one set, in first-release order.
+static bool testDeferredReleases()
+{
+    DeferredReleases releases;
+    bool ok = require(releases.add(3), "releases: first add arms the flush");
+    ok &= require(!releases.add(1), "releases: later adds do not");
+    ok &= require(!releases.add(3, 2), "releases: repeated ID aggregates");
+    ok &= require(releases.size() == 2, "releases: one entry per ID");
+
+    auto frames = releases.take();
+    ok &= require(frames.size() == 2 && json::parse(frames[0]) == json::array({ "release", 3, 3 }) &&
+                  json::parse(frames[1]) == json::array({ "release", 1, 1 }), "releases: counts summed in order");
+    ok &= require(releases.take().empty(), "releases: take clears");
+    ok &= require(releases.add(3), "releases: next add after take arms again");
+    return ok;
+}
+
+// A zero delay sends releases as they come instead of arming the flush timer.
+static bool testZeroReleaseDelay()
+{
+    DeferredReleases releases;
+    std::vector<std::string> sent;
+    std::vector<int> armed;
+    auto send = [&](std::string frame) { sent.push_back(std::move(frame)); };
+    auto arm = [&](int delayMs) { armed.push_back(delayMs); };
+
+    releases.schedule(3, 0, send, arm);
+    releases.schedule(3, 0, send, arm);
+    bool ok = require(armed.empty(), "zero delay: timer not armed");
+    ok &= require(sent.size() == 2 && json::parse(sent[1]) == json::array({ "release", 3, 1 }), "zero delay: sent at once");
+    ok &= require(releases.size() == 0, "zero delay: nothing left queued");
+
+    releases.schedule(4, 5, send, arm);
+    releases.schedule(5, 5, send, arm);
+    ok &= require(armed == std::vector<int>({ 5 }) && sent.size() == 2, "delay: first release arms the timer once");
+    // A release queued before the delay dropped to zero goes out with the next one.
+    releases.schedule(6, 0, send, arm);
+    ok &= require(sent.size() == 5 && releases.size() == 0, "zero delay: flushes earlier releases");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testManyCallsInFlight()) failures++;
+    if (!testFuturesAndFailure()) failures++;
+    if (!testDeferredReleases()) failures++;
+    if (!testZeroReleaseDelay()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All pending call tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " pending call test(s) failed" << std::endl;
+    return 1;
+}
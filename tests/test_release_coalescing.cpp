@@ -0,0 +1,135 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/batch.h>
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/transport.h>
+#include <capnwebcpp/transports/accum_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct TestTarget : public RpcTarget
+{
+    TestTarget()
+    {
+        // Takes a client stub and drops it.
+        method("use", [](const json&) { return json("ok"); });
+    }
+};
+
+static std::string pushUse(int clientExportId)
+{
+    json args = json::array({ json::array({ "export", clientExportId }) });
+    return json::array({ "push", json::array({ "pipeline", 0, json::array({ "use" }), args }) }).dump();
+}
+
+static std::string pull(int id)
+{
+    return json::array({ "pull", id }).dump();
+}
+
+static std::vector<json> releasesIn(const std::vector<std::string>& frames)
+{
+    std::vector<json> out;
+    for (const auto& f : frames)
+    {
+        json m = json::parse(f);
+        if (m[0] == "release") out.push_back(m);
+    }
+    return out;
+}
+
+static bool testBatchSumsReleasesPerId()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+
+    std::string body = pushUse(7) + "\n" + pushUse(7) + "\n" + pushUse(8) + "\n" + pushUse(7) + "\n"
+                     + pull(1) + "\n" + pull(2) + "\n" + pull(3) + "\n" + pull(4);
+    auto outbox = processBatch(session, &data, body);
+
+    auto releases = releasesIn(outbox);
+    bool ok = require(releases.size() == 2, "batch: one release frame per client ID");
+    ok &= require(releases.size() == 2 && releases[0] == json::array({ "release", 7, 3 }), "batch: refcounts summed for ID 7");
+    ok &= require(releases.size() == 2 && releases[1] == json::array({ "release", 8, 1 }), "batch: ID 8 released once");
+    ok &= require(json::parse(outbox.back())[0] == "release", "batch: releases follow the results");
+    return ok;
+}
+
+static bool testInboundWindowFlushesOnce()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    std::vector<std::string> sent;
+    AccumTransport transport(sent);
+
+    // One read window: frames run as they arrive, releases wait for the flush.
+    for (int i = 1; i <= 3; ++i)
+        pumpInbound(session, &data, transport, pushUse(9), 0);
+    for (int i = 1; i <= 3; ++i)
+        pumpInbound(session, &data, transport, pull(i), 0);
+
+    bool ok = require(sent.size() == 3 && releasesIn(sent).empty(), "window: results sent, releases queued");
+    flushReleases(&data, transport);
+    auto releases = releasesIn(sent);
+    ok &= require(releases.size() == 1 && releases[0] == json::array({ "release", 9, 3 }), "window: one summed release on flush");
+    ok &= require(data.releases.empty(), "window: queue cleared");
+
+    // Settling imports the server called out on queues their releases too.
+    data.importer.setRefcounts(1, 2, 1);
+    data.importer.setRefcounts(2, 1, 1);
+    std::size_t before = sent.size();
+    pumpInbound(session, &data, transport, json::array({ "resolve", 1, "done" }).dump(), 0);
+    pumpInbound(session, &data, transport, json::array({ "reject", 2, json::array({ "error", "Error", "x" }) }).dump(), 0);
+    ok &= require(sent.size() == before, "window: settle releases queued");
+    flushReleases(&data, transport);
+    std::vector<std::string> tail(sent.begin() + static_cast<std::ptrdiff_t>(before), sent.end());
+    ok &= require(releasesIn(tail) == std::vector<json>{ json::array({ "release", 1, 2 }), json::array({ "release", 2, 1 }) },
+                  "window: settled imports released with their refcounts");
+    return ok;
+}
+
+static bool testPumpMessageStillFlushes()
+{
+    auto target = std::make_shared<TestTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    std::vector<std::string> sent;
+    AccumTransport transport(sent);
+
+    pumpMessage(session, &data, transport, pushUse(5));
+    pumpMessage(session, &data, transport, pull(1));
+    auto releases = releasesIn(sent);
+    return require(releases.size() == 1 && releases[0] == json::array({ "release", 5, 1 }), "pumpMessage: release sent with the result");
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testBatchSumsReleasesPerId()) failures++;
+    if (!testInboundWindowFlushesOnce()) failures++;
+    if (!testPumpMessageStillFlushes()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All release coalescing tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " release coalescing test(s) failed" << std::endl;
+    return 1;
+}
@@ -51,10 +51,52 @@ static bool testRemapExportCaptureRejects()
     return ok;
 }
 
+struct UserTarget : public RpcTarget
+{
+    UserTarget()
+    {
+        method("makeUser", [](const json&) { return json{ {"id", "u1"} }; });
+        method("getProfile", [](const json& args) { return json{ {"id", args[0]}, {"bio", "ok"} }; });
+    }
+};
+
+// With the strict mapper scope, a mapper reaches session exports only through import captures.
+static bool testRemapStrictScope()
+{
+    auto target = std::make_shared<UserTarget>();
+    RpcSession session(target);
+    RpcSessionData data; data.target = target;
+    session.setMapperScope(serialize::Evaluator::MapperScope::Strict);
+
+    session.handleMessage(&data, json::array({"push", json::array({"pipeline", 0, json::array({"makeUser"})})}).dump());
+
+    // Export 1 is not a mapper variable, so the strict scope rejects it...
+    json captures = json::array({ json::array({"import", 0}) });
+    json instrs = json::array({
+        json::array({"pipeline", -1, json::array({"getProfile"}), json::array({ json::array({"pipeline", 1, json::array({"id"}) }) })})
+    });
+    session.handleMessage(&data, json::array({"push", json::array({"remap", 0, json::array(), captures, instrs})}).dump());
+    json m1 = parse(session.handleMessage(&data, json::array({"pull", 2}).dump()));
+
+    // ...while capturing it reaches the same value.
+    json captured = json::array({ json::array({"import", 0}), json::array({"import", 1}) });
+    json viaCapture = json::array({
+        json::array({"pipeline", -1, json::array({"getProfile"}), json::array({ json::array({"pipeline", -2, json::array({"id"}) }) })})
+    });
+    session.handleMessage(&data, json::array({"push", json::array({"remap", 0, json::array(), captured, viaCapture})}).dump());
+    json m2 = parse(session.handleMessage(&data, json::array({"pull", 3}).dump()));
+
+    bool ok = true;
+    ok &= require(m1[0] == "reject" && m1[1] == 2, "remap strict: out-of-range variable rejected");
+    ok &= require(m2[0] == "resolve" && m2[1] == 3 && m2[2]["id"] == "u1", "remap strict: capture resolves");
+    return ok;
+}
+
 int main()
 {
     int failed = 0;
     failed += !testRemapExportCaptureRejects();
+    failed += !testRemapStrictScope();
     if (failed == 0)
     {
         std::cout << "All remap capture tests passed" << std::endl;
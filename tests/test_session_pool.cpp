@@ -0,0 +1,116 @@
+#include <iostream>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/rpc_target.h>
+#include <capnwebcpp/batch.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct TestTarget : public RpcTarget
+{
+    TestTarget()
+    {
+        method("echo", [](const json& args)
+        {
+            return args.is_array() && !args.empty() ? args[0] : json();
+        });
+    }
+};
+
+static std::string echoBatch(const std::string& value)
+{
+    std::string body;
+    body += json::array({"push", json::array({"pipeline", 0, json::array({"echo"}), json::array({ value })})}).dump();
+    body += "\n";
+    body += json::array({"pull", 1}).dump();
+    return body;
+}
+
+static bool testLeaseIsRecycledAndCleared()
+{
+    auto target = std::make_shared<TestTarget>();
+    BatchSessionPool pool;
+    bool ok = true;
+
+    PooledBatchSession* first = nullptr;
+    {
+        auto lease = pool.acquire(target);
+        first = &*lease;
+        lease->session.setMemoryLimits({ 1, 0 });
+        lease->run(echoBatch("A"));
+        ok &= require(lease->outbox.size() == 1, "pool: first batch produced one response");
+        ok &= require(lease->data.exports.size() == 1, "pool: export retained until release");
+    }
+    ok &= require(pool.idleCount() == 1, "pool: session returned to pool");
+
+    {
+        auto lease = pool.acquire(target);
+        ok &= require(&*lease == first, "pool: same session object reused");
+        ok &= require(lease->outbox.empty() && lease->data.exports.empty() && lease->data.imports.empty(),
+                      "pool: state cleared between leases");
+        ok &= require(lease->data.memory.total() == 0, "pool: memory account cleared");
+        ok &= require(lease->session.getMemoryLimits().softLimit == 0, "pool: session configuration reset");
+        lease->run(echoBatch("B"));
+        ok &= require(lease->outbox.size() == 1, "pool: second batch produced one response");
+        json msg = json::parse(lease->outbox[0]);
+        ok &= require(msg[0] == "resolve" && msg[1] == 1 && msg[2] == "B", "pool: export IDs restart at 1");
+    }
+    return ok;
+}
+
+static bool testMaxIdle()
+{
+    auto target = std::make_shared<TestTarget>();
+    BatchSessionPool pool;
+    pool.setMaxIdle(1);
+    auto sessions = Metrics::instance().liveSessions.value();
+    {
+        auto a = pool.acquire(target);
+        auto b = pool.acquire(target);
+    }
+    bool ok = require(pool.idleCount() == 1, "pool: idle sessions bounded");
+    ok &= require(Metrics::instance().liveSessions.value() == sessions, "pool: dropped session leaves the gauge");
+    return ok;
+}
+
+static bool testPooledProcessBatch()
+{
+    auto target = std::make_shared<TestTarget>();
+    bool ok = true;
+    for (const char* v : { "X", "Y" })
+    {
+        auto responses = processBatch(target, echoBatch(v));
+        ok &= require(responses.size() == 1, "processBatch: one response");
+        ok &= require(json::parse(responses[0]) == json::array({ "resolve", 1, v }), "processBatch: resolves value");
+    }
+    ok &= require(BatchSessionPool::local().idleCount() == 1, "processBatch: thread-local pool reused");
+    return ok;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += !testLeaseIsRecycledAndCleared();
+    failed += !testMaxIdle();
+    failed += !testPooledProcessBatch();
+    if (failed == 0)
+    {
+        std::cout << "All session pool tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failed << " session pool test(s) failed" << std::endl;
+    return 1;
+}
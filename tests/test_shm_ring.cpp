@@ -0,0 +1,235 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/transports/shm_ring_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+#if defined(__linux__)
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct TestTarget : public RpcTarget
+{
+    TestTarget()
+    {
+        method("echo", [](const json& args){ return args.is_array() && !args.empty() ? args[0] : json(); });
+    }
+};
+
+static std::string push(const std::string& method, const json& args)
+{
+    return json::array({ "push", json::array({ "pipeline", 0, json::array({ method }), args }) }).dump();
+}
+
+static bool testWrapAroundAndQueueing()
+{
+    auto handles = ShmRingEndpoint::create(4096);
+    ShmRingEndpoint a(handles, ShmRingEndpoint::Side::First);
+    ShmRingEndpoint b(handles, ShmRingEndpoint::Side::Second);
+    handles.close();
+    bool ok = true;
+
+    // Frames of varying size wrap around the ring many times.
+    std::string got;
+    for (int i = 0; i < 200; ++i)
+    {
+        std::string frame(100 + (i * 37) % 900, static_cast<char>('a' + i % 26));
+        a.send(std::string_view(frame));
+        ok &= require(b.receive(got) && got == frame, "wrap: frame " + std::to_string(i));
+    }
+    ok &= require(!b.receive(got), "wrap: ring empty");
+
+    // Fill the ring; the overflow is queued locally and flushed once the peer reads.
+    std::string big(1500, 'x');
+    for (int i = 0; i < 4; ++i) a.send(std::string_view(big));
+    ok &= require(a.queuedBytes() == 1500 * 2, "queue: two frames queued");
+    ok &= require(b.wait(0), "queue: doorbell rung for data");
+    int received = 0;
+    while (b.receive(got)) ++received;
+    ok &= require(received == 2, "queue: two frames in ring");
+    ok &= require(a.wait(0), "queue: writer woken when space freed");
+    a.flush();
+    ok &= require(a.queuedBytes() == 0, "queue: flushed");
+    while (b.receive(got)) ++received;
+    ok &= require(received == 4, "queue: all frames delivered");
+
+    bool threw = false;
+    try { a.send(std::string(a.maxFrameSize() + 1, 'y')); } catch (const std::length_error&) { threw = true; }
+    ok &= require(threw, "oversized frame rejected");
+    return ok;
+}
+
+static bool testRejectsCorruptRing()
+{
+    auto handles = ShmRingEndpoint::create(4096);
+    ShmRingEndpoint a(handles, ShmRingEndpoint::Side::First);
+    ShmRingEndpoint b(handles, ShmRingEndpoint::Side::Second);
+    bool ok = true;
+
+    // Overwrite the length prefix of a written frame with one past the bytes available.
+    a.send(std::string_view("hello"));
+    auto* data = static_cast<char*>(::mmap(nullptr, ShmRingRegion::kDataOffset + 2 * 4096,
+                                           PROT_READ | PROT_WRITE, MAP_SHARED, handles.memFd, 0));
+    std::uint32_t bogus = 0xFFFFFFF0u;
+    std::memcpy(data + ShmRingRegion::kDataOffset, &bogus, sizeof(bogus));
+    std::string got;
+    ok &= require(!b.receive(got) && got.empty(), "corrupt: frame rejected");
+    ok &= require(b.isClosed() && a.isClosed(), "corrupt: channel closed");
+    a.send(std::string_view("more"));
+    ok &= require(!b.receive(got), "corrupt: nothing read after");
+
+    // A capacity that is not a power of two is refused when opening.
+    reinterpret_cast<ShmRingRegion*>(data)->capacity = 3000;
+    bool threw = false;
+    try { ShmRingEndpoint c(handles, ShmRingEndpoint::Side::First); } catch (const std::invalid_argument&) { threw = true; }
+    ok &= require(threw, "corrupt: bad capacity refused");
+    ::munmap(data, ShmRingRegion::kDataOffset + 2 * 4096);
+    handles.close();
+    return ok;
+}
+
+static bool testNoLostWakeup()
+{
+    auto handles = ShmRingEndpoint::create(4096);
+    ShmRingEndpoint a(handles, ShmRingEndpoint::Side::First);
+    ShmRingEndpoint b(handles, ShmRingEndpoint::Side::Second);
+    handles.close();
+    bool ok = true;
+
+    // A frame already in the ring needs no doorbell: wait() returns at once.
+    a.send(std::string_view("one"));
+    b.wait(0);
+    auto start = std::chrono::steady_clock::now();
+    ok &= require(b.wait(1000), "wakeup: wait sees an unread frame");
+    ok &= require(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500), "wakeup: no sleep on an unread frame");
+    std::string got;
+    ok &= require(b.receive(got) && got == "one", "wakeup: frame read");
+
+    // A writer racing a reader going to sleep on a non-empty ring still wakes it.
+    const int frames = 20000;
+    std::thread writer([&a]()
+    {
+        for (int i = 0; i < frames; ++i)
+        {
+            a.send(std::string(16, static_cast<char>('a' + i % 26)));
+            if (i % 64 == 0) std::this_thread::yield();
+            while (a.queuedBytes() > 0)
+            {
+                a.wait(100, false);
+                a.flush();
+            }
+        }
+    });
+    int received = 0;
+    int timeouts = 0;
+    while (received < frames && timeouts < 3)
+    {
+        if (b.receive(got)) { ++received; continue; }
+        if (!b.wait(2000)) ++timeouts;
+    }
+    writer.join();
+    ok &= require(received == frames && timeouts == 0, "wakeup: every frame delivered without a missed doorbell");
+    return ok;
+}
+
+static bool testSessionAcrossProcesses()
+{
+    auto handles = ShmRingEndpoint::create(64 * 1024);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        // Server process.
+        int status = 1;
+        {
+            ShmRingEndpoint endpoint(handles, ShmRingEndpoint::Side::Second);
+            handles.close();
+            auto target = std::make_shared<TestTarget>();
+            RpcSession session(target);
+            RpcSessionData data; data.target = target;
+            ShmRingTransport transport(&endpoint);
+            while (pumpShmRing(session, &data, endpoint, transport, 1024 * 1024, 1000)) {}
+            status = 0;
+        }
+        _exit(status);
+    }
+
+    ShmRingEndpoint client(handles, ShmRingEndpoint::Side::First);
+    handles.close();
+    bool ok = true;
+
+    const int calls = 50;
+    for (int i = 1; i <= calls; ++i)
+    {
+        client.send(push("echo", json::array({ i })));
+        client.send(json::array({ "pull", i }).dump());
+    }
+
+    std::vector<json> responses;
+    std::string frame;
+    while (static_cast<int>(responses.size()) < calls)
+    {
+        if (!client.receive(frame))
+        {
+            if (!client.wait(5000)) break;
+            continue;
+        }
+        responses.push_back(json::parse(frame));
+    }
+    client.close();
+
+    int status = -1;
+    waitpid(child, &status, 0);
+
+    ok &= require(static_cast<int>(responses.size()) == calls, "ipc: all calls answered");
+    for (int i = 0; i < static_cast<int>(responses.size()); ++i)
+        ok &= require(responses[i] == json::array({ "resolve", i + 1, i + 1 }), "ipc: resolve " + std::to_string(i + 1));
+    ok &= require(WIFEXITED(status) && WEXITSTATUS(status) == 0, "ipc: server exited cleanly on close");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testWrapAroundAndQueueing()) failures++;
+    if (!testRejectsCorruptRing()) failures++;
+    if (!testNoLostWakeup()) failures++;
+    if (!testSessionAcrossProcesses()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All shared-memory ring tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " shared-memory ring test(s) failed" << std::endl;
+    return 1;
+}
+
+#else
+
+int main()
+{
+    std::cout << "shared-memory transport not available on this platform" << std::endl;
+    return 0;
+}
+
+#endif
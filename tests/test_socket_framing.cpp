@@ -0,0 +1,151 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/client_api.h>
+#include <capnwebcpp/framing.h>
+#include <capnwebcpp/rpc_session.h>
+#include <capnwebcpp/transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static std::string frame(const std::string& payload)
+{
+    auto header = encodeFrameHeader(payload.size());
+    return std::string(header.data(), header.size()) + payload;
+}
+
+static bool testDecoderChunking()
+{
+    std::vector<std::string> payloads = { "a", "", std::string(70000, 'b'), "[\"pull\",1]" };
+    std::string stream;
+    for (const auto& p : payloads) stream += frame(p);
+    bool ok = true;
+
+    // Whole stream at once, then every split into one-byte and odd-sized chunks.
+    for (std::size_t chunk : { stream.size(), std::size_t(1), std::size_t(3), std::size_t(4096) })
+    {
+        FrameDecoder decoder;
+        std::vector<std::string> got;
+        for (std::size_t i = 0; i < stream.size(); i += chunk)
+            decoder.feed(std::string_view(stream).substr(i, chunk), [&](std::string_view f) { got.emplace_back(f); });
+        ok &= require(got == payloads, "decoder: chunk size " + std::to_string(chunk));
+        ok &= require(decoder.buffered() == 0, "decoder: nothing left over");
+    }
+
+    FrameDecoder limited(16);
+    bool threw = false;
+    try { limited.feed(frame(std::string(17, 'x')), [](std::string_view) {}); }
+    catch (const std::length_error&) { threw = true; }
+    ok &= require(threw, "decoder: oversized frame rejected");
+    return ok;
+}
+
+#if !defined(_WIN32)
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <capnwebcpp/transports/socket_client_transport.h>
+
+// Server side of the test: writes length-prefixed frames to a socket, like UsSocketTransport.
+class FdFrameTransport : public RpcTransport
+{
+public:
+    explicit FdFrameTransport(int fd) : fd(fd) {}
+
+    void send(const std::string& message) override
+    {
+        std::string f = frame(message);
+        std::size_t off = 0;
+        while (off < f.size())
+        {
+            ssize_t n = ::write(fd, f.data() + off, f.size() - off);
+            if (n <= 0) return;
+            off += static_cast<std::size_t>(n);
+        }
+    }
+    void abort(const std::string&) override {}
+
+private:
+    int fd;
+};
+
+struct TestTarget : public RpcTarget
+{
+    TestTarget()
+    {
+        method("hello", [](const json& args){ return json("Hello, " + args[0].get<std::string>() + "!"); });
+        method("add", [](const json& args){ return json(args[0].get<int>() + args[1].get<int>()); });
+    }
+};
+
+static bool testClientOverSocket()
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        return require(false, "socketpair");
+
+    std::thread server([fd = fds[1]]()
+    {
+        auto target = std::make_shared<TestTarget>();
+        RpcSession session(target);
+        RpcSessionData data; data.target = target;
+        FdFrameTransport transport(fd);
+        FrameDecoder decoder;
+        char buf[4096];
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+        {
+            decoder.feed(std::string_view(buf, static_cast<std::size_t>(n)), [&](std::string_view f)
+            {
+                pumpInbound(session, &data, transport, f, 0);
+            });
+        }
+        ::close(fd);
+    });
+
+    bool ok = true;
+    {
+        auto transport = std::make_shared<SocketClientTransport>(fds[0]);
+        RpcClient client(transport);
+        ok &= require(client.callMethod("hello", json::array({ "World" })) == "Hello, World!", "socket: first call");
+        ok &= require(client.callMethod("add", json::array({ 2, 3 })) == 5, "socket: second call on same connection");
+        ok &= require(client.callMethod("hello", json::array({ std::string(100000, 'z') })).get<std::string>().size() == 100008,
+                      "socket: large frame");
+    }
+    server.join();
+    return ok;
+}
+
+#endif
+
+int main()
+{
+    int failures = 0;
+    if (!testDecoderChunking()) failures++;
+#if !defined(_WIN32)
+    if (!testClientOverSocket()) failures++;
+#endif
+    if (failures == 0)
+    {
+        std::cout << "All socket framing tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " socket framing test(s) failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,90 @@
+#include <array>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/transport.h>
+#include <capnwebcpp/transports/accum_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Transport implementing only the copying send(); relies on the base defaults.
+class CopyOnlyTransport : public RpcTransport
+{
+public:
+    void send(const std::string& message) override { out.push_back(message); }
+    void abort(const std::string&) override {}
+
+    std::vector<std::string> out;
+};
+
+static bool testDefaultOverloads()
+{
+    CopyOnlyTransport t;
+    RpcTransport& base = t;
+    bool ok = true;
+
+    base.send(std::string("moved"));
+    std::array<std::string_view, 3> parts = { "[\"resolve\",1,", "{\"big\":true}", "]" };
+    base.sendv(parts);
+    base.sendv({});
+
+    ok &= require(t.out.size() == 3, "default: three frames");
+    ok &= require(t.out[0] == "moved", "default: rvalue send delivered");
+    ok &= require(t.out[1] == "[\"resolve\",1,{\"big\":true}]", "default: fragments joined in order");
+    ok &= require(t.out[2].empty(), "default: empty gather sends empty frame");
+    return ok;
+}
+
+static bool testAccumMovesFrames()
+{
+    std::vector<std::string> outbox;
+    MemoryAccount memory;
+    AccumTransport t(outbox, &memory);
+    bool ok = true;
+
+    std::string payload(4096, 'p');
+    const char* data = payload.data();
+    t.send(std::move(payload));
+    ok &= require(outbox.size() == 1 && outbox[0].data() == data, "accum: buffer taken over, not copied");
+    ok &= require(memory.bytes(MemoryCategory::Outbound) == 4096, "accum: moved frame accounted");
+
+    std::string body(1000, 'b');
+    std::array<std::string_view, 3> parts = { "[\"resolve\",7,", body, "]" };
+    t.sendv(parts);
+    ok &= require(outbox.size() == 2 && outbox[1] == "[\"resolve\",7," + body + "]", "accum: gathered frame");
+    ok &= require(memory.bytes(MemoryCategory::Outbound) == 4096 + outbox[1].size(), "accum: gathered frame accounted");
+
+    const std::string copy = "copy";
+    t.send(copy);
+    ok &= require(outbox.size() == 3 && outbox[2] == "copy" && copy == "copy", "accum: lvalue send copies");
+    return ok;
+}
+
+int main()
+{
+    int failures = 0;
+    if (!testDefaultOverloads()) failures++;
+    if (!testAccumMovesFrames()) failures++;
+    if (failures == 0)
+    {
+        std::cout << "All transport send tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failures << " transport send test(s) failed" << std::endl;
+    return 1;
+}
@@ -0,0 +1,158 @@
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <capnwebcpp/rpc_target.h>
+#include <capnwebcpp/transports/loopback_transport.h>
+
+using json = nlohmann::json;
+using namespace capnwebcpp;
+
+static bool require(bool cond, const std::string& msg)
+{
+    if (!cond)
+    {
+        std::cerr << "TEST FAILED: " << msg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct Profile
+{
+    std::string id;
+    int age = 0;
+};
+
+void to_json(json& j, const Profile& p) { j = json{ {"id", p.id}, {"age", p.age} }; }
+void from_json(const json& j, Profile& p) { j.at("id").get_to(p.id); j.at("age").get_to(p.age); }
+
+class TypedTarget : public RpcTarget
+{
+public:
+    TypedTarget()
+    {
+        method("add", &TypedTarget::add);
+        method("greet", &TypedTarget::greet);
+        method("length", &TypedTarget::length);
+        method("echo", &TypedTarget::echo);
+        method("profile", &TypedTarget::profile);
+        method("store", &TypedTarget::store);
+        method("older", &TypedTarget::older);
+        method("count", &TypedTarget::count);
+        method("ids", &TypedTarget::ids);
+    }
+
+    std::vector<Profile> stored;
+
+private:
+    int add(int a, int b) { return a + b; }
+
+    std::string greet(const std::string& name, std::optional<std::string> greeting)
+    {
+        return greeting.value_or("Hello") + ", " + name + "!";
+    }
+
+    std::size_t length(std::string_view text) const { return text.size(); }
+    json echo(const json& value) const { return value; }
+    Profile profile(const std::string& id) const { return Profile{ id, 42 }; }
+    void store(Profile p) { stored.push_back(std::move(p)); }
+    Profile older(Profile p, int years) const { p.age += years; return p; }
+    std::size_t count() const { return stored.size(); }
+
+    std::vector<std::string> ids() const
+    {
+        std::vector<std::string> out;
+        for (const auto& p : stored) out.push_back(p.id);
+        return out;
+    }
+};
+
+static std::string errorOf(TypedTarget& t, const std::string& method, const json& args)
+{
+    try
+    {
+        t.dispatch(method, args);
+    }
+    catch (const std::exception& e)
+    {
+        return e.what();
+    }
+    return std::string();
+}
+
+static bool testDecodesAndEncodes()
+{
+    TypedTarget t;
+    bool ok = true;
+    ok &= require(t.dispatch("add", json::array({ 2, 3 })) == 5, "ints");
+    ok &= require(t.dispatch("greet", json::array({ "Ada" })) == "Hello, Ada!", "optional missing");
+    ok &= require(t.dispatch("greet", json::array({ "Ada", nullptr })) == "Hello, Ada!", "optional null");
+    ok &= require(t.dispatch("greet", json::array({ "Ada", "Hi" })) == "Hi, Ada!", "optional given");
+    ok &= require(t.dispatch("greet", json("Ada")) == "Hello, Ada!", "lone argument");
+    ok &= require(t.dispatch("length", json::array({ "four" })) == 4, "string_view");
+    ok &= require(t.dispatch("echo", json::array({ json{ {"k", 1} } })) == json{ {"k", 1} }, "json passthrough");
+    ok &= require(t.dispatch("profile", json::array({ "u_1" })) == json{ {"id", "u_1"}, {"age", 42} }, "struct result");
+    ok &= require(t.dispatch("store", json::array({ json{ {"id", "u_2"}, {"age", 7} } })).is_null(), "void gives null");
+    ok &= require(t.stored.size() == 1 && t.stored[0].id == "u_2" && t.stored[0].age == 7, "struct argument");
+    ok &= require(t.dispatch("older", json::array({ json{ {"id", "u_3"}, {"age", 1} }, 2 }))["age"] == 3, "mixed");
+    ok &= require(t.dispatch("count", json::array()) == 1, "no parameters");
+    ok &= require(t.dispatch("count", json::array({ "extra" })) == 1, "extra arguments ignored");
+    ok &= require(t.dispatch("ids", json::array()) == json::array({ "u_2" }), "container result");
+    return ok;
+}
+
+static bool testRejectsBadArguments()
+{
+    TypedTarget t;
+    bool ok = true;
+    ok &= require(errorOf(t, "add", json::array({ 1 })) == "add: missing argument 2", "missing");
+    std::string wrongType = errorOf(t, "add", json::array({ 1, "two" }));
+    ok &= require(wrongType.rfind("add: argument 2: ", 0) == 0 && wrongType.find("json.exception") == std::string::npos,
+                  "wrong type: " + wrongType);
+    ok &= require(errorOf(t, "length", json::array({ 5 })) == "length: argument 1: type must be string, but is number", "not a string");
+    ok &= require(errorOf(t, "profile", json::array({ true })) == "profile: argument 1: type must be string, but is boolean", "not a string ref");
+    ok &= require(errorOf(t, "profile", json()) == "profile: missing argument 1", "null is no argument");
+    ok &= require(errorOf(t, "store", json::array({ json{ {"id", "x"} } })).rfind("store: argument 1: ", 0) == 0, "bad struct");
+    ok &= require(t.stored.empty(), "nothing stored");
+    return ok;
+}
+
+static bool testOverTheWire()
+{
+    auto target = std::make_shared<TypedTarget>();
+    LoopbackClient client(target);
+    bool ok = true;
+    ok &= require(client.callMethod("add", json::array({ 20, 22 })) == 42, "call");
+    bool threw = false;
+    try
+    {
+        client.callMethod("add", json::array({ "x", 1 }));
+    }
+    catch (const std::exception& e)
+    {
+        threw = std::string(e.what()).find("add: argument 1") != std::string::npos;
+    }
+    ok &= require(threw, "rejection carries the argument error");
+    return ok;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += !testDecodesAndEncodes();
+    failed += !testRejectsBadArguments();
+    failed += !testOverTheWire();
+    if (failed == 0)
+    {
+        std::cout << "All typed method tests passed" << std::endl;
+        return 0;
+    }
+    std::cerr << failed << " typed method test(s) failed" << std::endl;
+    return 1;
+}